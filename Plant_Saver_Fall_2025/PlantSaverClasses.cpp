@@ -7,15 +7,26 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <ESP32Time.h>  //necessary for keeping track of time through deep-sleep cycles
+#include "driver/ledc.h"
+#include "esp_sleep.h"
+#include "ff.h"  // FatFs underneath the SD library, for preallocating the sensor log
+
+#if !FF_USE_EXPAND
+#error "The sensor log needs f_expand(), enable FF_USE_EXPAND in the FatFs configuration of the core"
+#endif
 /*------------------------------------------------------ Object Instantiation -----------------------------------------------------*/
 
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RESET);  // Create OLED display object
+BlockCache blockCache;                                                     // Read cache under readSDFile() & the streamed readers
 
 /*--------------------------------------------------------- DBPlant Class ---------------------------------------------------------*/
 
 // Initialization
 DBPlant::DBPlant()
-  : commonName{}, scientificName{}, fact{}, lightReq{}, waterReq{}, hardiness{} {}
+  : commonName{}, scientificName{}, fact{}, lightReq{}, waterReq{}, hardiness{} {
+  id = 0;
+  score = -1;
+}
 
 /*---------------------------------------------------------- Plant Class ----------------------------------------------------------*/
 
@@ -32,18 +43,26 @@ Plant::Plant()
   waterEval = 0;
   humidityEval = 0;
   tempEval = 0;
+  lightInRange = -1;
+  waterInRange = -1;
+  humidityInRange = -1;
+  tempInRange = -1;
+  hoursToWater = NAN;
+  useDerivedMetrics = 0;
 }
 
 // Take average of sensor readings
-float Plant::getAvgReading(JsonDocument sensorDoc) {
+float Plant::getAvgReading(SensorFile &sensorFile) {
   float avg = 0;
-  int numReadings = sensorDoc["numReadings"];
-  if (numReadings > 0) {
-    JsonArray readings = sensorDoc["readings"];
-    for (int i = 0; i < numReadings; i++) {
-      avg = avg + (float)readings[i];
+  int numValid = 0;  // Readings taken while a sensor was missing are NAN in memory & null on the card
+  for (int i = 0; i < sensorFile.numReadings; i++) {
+    if (!isnan(sensorFile.readings[i])) {
+      avg = avg + sensorFile.readings[i];
+      numValid++;
     }
-    avg = avg / (float)numReadings;
+  }
+  if (numValid > 0) {
+    avg = avg / (float)numValid;
   } else {
     avg = 0; // Prevent divide by 0 errors
   }
@@ -58,27 +77,25 @@ void Plant::checkThresholds() {
   humidityCheck();
 }
 
-// Map light requirements to thresholds, then check average reading
+// Map light requirements to thresholds, then check average reading (or DLI if enabled)
 void Plant::lightCheck() {
-  int lightReqLowHigh[2] = { 0 };  // [0] = low value, [1] = high value
-  lightReqLowHigh[0] = lightReq[0];
-  lightReqLowHigh[1] = (lightReq[1] != 0) ? lightReq[1] : lightReq[0];
   int thresholds[2] = { 0 };  // in lux
-  for (int i = 0; i < 2; i++) {
-    switch (lightReqLowHigh[i]) {
-      case fullShade:
-        thresholds[i] = 0 + 1075 * i;  // 0 to 1075 lux
-        break;
-      case partialSun:
-        thresholds[i] = 1075 + 9675 * i;  // 1075 to 10750 lux
-        break;
-      case fullSun:
-        thresholds[i] = 10750 + 999999 * i;  // 10750+ , top end is arbitrary
-        break;
-      default:
-        lightEval = evalUnknown;
-        return;
+  if (!getLightThresholds(lightReq, thresholds)) {
+    lightEval = evalUnknown;
+    lightInRange = -1;
+    return;
+  }
+  lightInRange = stats[lightFile].percentInRange(lightFile, thresholds);
+  float dliThresholds[2];
+  if (useDerivedMetrics && derived.dliDays > 0 && getDLIThresholds(lightReq, dliThresholds)) {  // Judge total daily light instead
+    if (derived.dli >= dliThresholds[0] && derived.dli <= dliThresholds[1]) {
+      lightEval = evalOK;
+    } else if (derived.dli < dliThresholds[0]) {
+      lightEval = evalLow;
+    } else {
+      lightEval = evalHigh;
     }
+    return;
   }
   if (avgLight >= thresholds[0] && avgLight <= thresholds[1]) {
     lightEval = evalOK;
@@ -91,53 +108,13 @@ void Plant::lightCheck() {
 
 // Map hardiness zones to temperature thresholds, then check average reading
 void Plant::tempCheck() {
-  int hardinessLowHigh[2];  // [0] = low value, [1] = high value
-  hardinessLowHigh[0] = hardiness[0];
-  hardinessLowHigh[1] = (hardiness[1] != 0) ? hardiness[1] : hardiness[0];
   int thresholds[2];  // in degrees F
-  for (int i = 0; i < 2; i++) {
-    switch (hardinessLowHigh[i]) {
-      case 2:
-        thresholds[i] = 26 + 4 * i;
-        break;
-      case 3:
-        thresholds[i] = 32 + 4 * i;
-        break;
-      case 4:
-        thresholds[i] = 39 + 4 * i;
-        break;
-      case 5:
-        thresholds[i] = 45 + 3 * i;
-        break;
-      case 6:
-        thresholds[i] = 50 + 4 * i;
-        break;
-      case 7:
-        thresholds[i] = 54 + 3 * i;
-        break;
-      case 8:
-        thresholds[i] = 61 + 3 * i;
-        break;
-      case 9:
-        thresholds[i] = 64 + 4 * i;
-        break;
-      case 10:
-        thresholds[i] = 68 + 4 * i;
-        break;
-      case 11:
-        thresholds[i] = 75 + 4 * i;
-        break;
-      case 12:
-        thresholds[i] = 80 + 20 * i;
-        break;
-      case 13:
-        thresholds[i] = 80 + 20 * i;
-        break;
-      default:
-        tempEval = evalUnknown;
-        return;
-    }
+  if (!getTempThresholds(hardiness, thresholds)) {
+    tempEval = evalUnknown;
+    tempInRange = -1;
+    return;
   }
+  tempInRange = stats[tempFile].percentInRange(tempFile, thresholds);
   if (avgTemp >= thresholds[0] && avgTemp <= thresholds[1]) {
     tempEval = evalOK;
   } else if (avgTemp < thresholds[0]) {
@@ -149,29 +126,17 @@ void Plant::tempCheck() {
 
 // Map water requirements and humidity readings to thresholds, then check average readings
 void Plant::waterCheck() {
-  int waterReqLowHigh[2];  // [0] = low value, [1] = high value
-  waterReqLowHigh[0] = waterReq[0];
-  waterReqLowHigh[1] = (waterReq[1] != 0) ? waterReq[1] : waterReq[0];
   int thresholds[2];  // in ADC counts
-  for (int i = 0; i < 2; i++) {
-    switch (waterReqLowHigh[i]) {
-      case water:
-        thresholds[i] = 0 + 1000 * i;  // 0 to 1000
-        break;
-      case wet:
-        thresholds[i] = 1000 + 650 * i;  // 1000 to 1650
-        break;
-      case moist:
-        thresholds[i] = 1650 + 650 * i;  // 1650 to 2300
-        break;
-      case dry:
-        thresholds[i] = 2300 + 1795 * i;  // 2300 to 4095 (max)
-        break;
-      default:
-        lightEval = evalUnknown;
-        return;
-    }
+  if (!getWaterThresholds(waterReq, thresholds)) {
+    waterEval = evalUnknown;
+    waterInRange = -1;
+    hoursToWater = NAN;
+    return;
   }
+  waterInRange = stats[waterFile].percentInRange(waterFile, thresholds);
+  time_t now;
+  time(&now);
+  hoursToWater = waterForecast.hoursUntil(thresholds[1], now);  // Readings above the band are too dry
   if (avgWater >= thresholds[0] && avgWater <= thresholds[1]) {
     waterEval = evalOK;
   } else if (avgWater < thresholds[0]) {  // lower reading = more water
@@ -181,13 +146,27 @@ void Plant::waterCheck() {
   }
 }
 
-// Check average humidity values against static thresholds
+// Check average humidity values (or VPD if enabled) against static thresholds
 void Plant::humidityCheck() {
-  if (avgHumidity <= 60 && avgHumidity >= 30) {
+  int thresholds[2];  // in %RH
+  getHumidityThresholds(thresholds);
+  humidityInRange = stats[humidityFile].percentInRange(humidityFile, thresholds);
+  float vpdThresholds[2];
+  if (useDerivedMetrics && derived.lastVPDTime != 0 && getVPDThresholds(vpdThresholds)) {  // Judge drying power of the air instead
+    if (derived.avgVPD >= vpdThresholds[0] && derived.avgVPD <= vpdThresholds[1]) {
+      humidityEval = evalOK;
+    } else if (derived.avgVPD > vpdThresholds[1]) {  // high deficit = dry air
+      humidityEval = evalLow;
+    } else {
+      humidityEval = evalHigh;
+    }
+    return;
+  }
+  if (avgHumidity <= thresholds[1] && avgHumidity >= thresholds[0]) {
     humidityEval = evalOK;
-  } else if (avgHumidity < 30) {
+  } else if (avgHumidity < thresholds[0]) {
     humidityEval = evalLow;
-  } else if (avgHumidity > 60) {
+  } else if (avgHumidity > thresholds[1]) {
     humidityEval = evalHigh;
   }
 }
@@ -202,6 +181,123 @@ SensorReading::SensorReading()
   humidityReading = 0;
   lightReading = 0;
   plantID = 0;
+  channelMask = ALL_CHANNELS_MASK;
+  time = 0;
+}
+
+// Reading of one channel, indexed by FileTypes
+float SensorReading::getReading(int channel) {
+  switch (channel) {
+    case lightFile:
+      return lightReading;
+    case waterFile:
+      return waterReading;
+    case humidityFile:
+      return humidityReading;
+    case tempFile:
+      return tempReading;
+  }
+  return NAN;
+}
+
+/*--------------------------------------------------------- DerivedMetrics Class ---------------------------------------------------------*/
+
+// Initialization
+DerivedMetrics::DerivedMetrics() {
+  dli = 0;
+  dliToday = 0;
+  dliDays = 0;
+  lightCoveredS = 0;
+  lastPPFD = 0;
+  lastLightTime = 0;
+  vpd = 0;
+  avgVPD = 0;
+  lastVPDTime = 0;
+  gdd = 0;
+  lastTempF = NAN;
+  lastTempTime = 0;
+  lastHumidity = NAN;
+}
+
+// Fold the light integral of a finished day into the running DLI. Days with large gaps would read low, so they are dropped
+void DerivedMetrics::closeDay() {
+  if (lightCoveredS >= DLI_MIN_COVERAGE * SECONDS_PER_DAY) {
+    dliDays++;
+    int weight = (dliDays < DLI_AVG_DAYS) ? dliDays : DLI_AVG_DAYS;
+    dli = dli + (dliToday - dli) / weight;
+  }
+  dliToday = 0;
+  lightCoveredS = 0;
+}
+
+// Update every metric from the channels present in a reading (channels not read are NAN). now is in seconds
+void DerivedMetrics::add(SensorReading reading, unsigned long now) {
+  if (!isnan(reading.lightReading)) {
+    float ppfd = reading.lightReading * LUX_TO_PPFD;
+    unsigned long midnight = (lastLightTime / SECONDS_PER_DAY + 1) * SECONDS_PER_DAY;
+    if (lastLightTime != 0 && now > lastLightTime && now - lastLightTime <= MAX_METRIC_GAP_S) {
+      float meanPPFD = (lastPPFD + ppfd) / 2;
+      if (now >= midnight) {  // Split the interval at midnight
+        dliToday += meanPPFD * (midnight - lastLightTime) / 1e6;
+        lightCoveredS += midnight - lastLightTime;
+        closeDay();
+        dliToday = meanPPFD * (now - midnight) / 1e6;
+        lightCoveredS = now - midnight;
+      } else {
+        dliToday += meanPPFD * (now - lastLightTime) / 1e6;
+        lightCoveredS += now - lastLightTime;
+      }
+    } else if (lastLightTime != 0 && now >= midnight) {  // Gap over midnight
+      closeDay();
+    }
+    lastPPFD = ppfd;
+    lastLightTime = now;
+  }
+  if (!isnan(reading.tempReading)) {
+    if (lastTempTime != 0 && now > lastTempTime && now - lastTempTime <= MAX_METRIC_GAP_S) {
+      float lastExcess = (lastTempF > GDD_BASE_TEMP_F) ? lastTempF - GDD_BASE_TEMP_F : 0;
+      float excess = (reading.tempReading > GDD_BASE_TEMP_F) ? reading.tempReading - GDD_BASE_TEMP_F : 0;
+      gdd += (lastExcess + excess) / 2 * (now - lastTempTime) / SECONDS_PER_DAY;
+    }
+    lastTempF = reading.tempReading;
+    lastTempTime = now;
+  }
+  if (!isnan(reading.humidityReading)) {
+    lastHumidity = reading.humidityReading;
+  }
+  if ((!isnan(reading.tempReading) || !isnan(reading.humidityReading)) && !isnan(lastTempF) && !isnan(lastHumidity)) {
+    float tempC = (lastTempF - 32) / 1.8;
+    float saturation = 0.6108 * expf(17.27 * tempC / (tempC + 237.3));  // Tetens equation, kPa
+    vpd = saturation * (1 - lastHumidity / 100);
+    if (lastVPDTime != 0 && now > lastVPDTime && now - lastVPDTime <= MAX_METRIC_GAP_S) {
+      avgVPD = avgVPD + (vpd - avgVPD) * (1 - expf(-(float)(now - lastVPDTime) / SECONDS_PER_DAY));  // Time-weighted
+    } else {
+      avgVPD = vpd;
+    }
+    lastVPDTime = now;
+  }
+}
+
+/*------------------------------------------------------------ RangeStats Class ------------------------------------------------------------*/
+
+// Initialization
+RangeStats::RangeStats() {
+  count = 0;
+  min = 0;
+  max = 0;
+  mean = 0;
+}
+
+// Fold one reading into the running count/min/max/mean
+void RangeStats::add(float reading) {
+  if (count == 0 || reading < min) {
+    min = reading;
+  }
+  if (count == 0 || reading > max) {
+    max = reading;
+  }
+  count++;
+  mean = mean + (reading - mean) / (float)count;
 }
 
 /*----------------------------------------------------------- Container Class --------------------------------------------------------------*/
@@ -213,20 +309,10 @@ Container::Container()
   plantPulled = 0;
   dbPlantsPulled = 0;
   headerPulled = 0;
-}
-
-// Add new sensor data to the JsonDocument.
-// Each sensor reading array is treated as a circular buffer
-JsonDocument Container::addSensorReading(JsonDocument sensorDoc, float reading) {
-  int startIndex = sensorDoc["startIndex"];
-  sensorDoc["readings"][startIndex] = reading;
-  startIndex = (startIndex + 1) % MAX_SENSOR_READINGS;
-  sensorDoc["startIndex"] = startIndex;
-  int numReadings = sensorDoc["numReadings"];
-  if (numReadings < MAX_SENSOR_READINGS) {
-    sensorDoc["numReadings"] = numReadings + 1;
-  }
-  return sensorDoc;
+  environmentPulled = 0;
+  plantChanged = 0;
+  deferredWake = 0;
+  logStarted = 0;
 }
 
 // Add a new timestamp to the array in FIFO format. numReadings is stored as JSON, readings are just raw text data
@@ -235,11 +321,11 @@ JsonDocument Container::addSensorReading(JsonDocument sensorDoc, float reading)
 // 2. Places the new timestamp at the top of the data
 // 3. Reads from the temporary file character by character into the original file
 // 4. Deletes the temporary file, leaving the modified original file
-void Container::addTimeStamp() {
+void Container::addTimeStamp(SensorReading readings[], int numNew) {
   char fileName[MAX_CHARS_FILENAME] = { 0 };
-  snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/dates.txt", header.activePlantID);
-  char tempFileName[MAX_CHARS_FILENAME] = { 0 };
-  snprintf(tempFileName, MAX_CHARS_FILENAME, "/plant%i/tmp.txt", header.activePlantID);
+  snprintf(fileName, MAX_CHARS_FILENAME, "/env/dates.txt");
+  char tempFileName[MAX_CHARS_FILENAME] = "/env/tmp.txt";
+  blockCache.invalidate(fileName);
   File inputFile = SD.open(fileName, FILE_READ);
   File outputFile = SD.open(tempFileName, FILE_WRITE);
   if (!inputFile || !outputFile) {
@@ -261,21 +347,27 @@ void Container::addTimeStamp() {
     return;
   }
   int numReadings = timeParamsDoc["numReadings"];
-  numReadings = (numReadings < MAX_SENSOR_READINGS) ? numReadings + 1 : numReadings;
+  numReadings = (numReadings + numNew < MAX_SENSOR_READINGS) ? numReadings + numNew : MAX_SENSOR_READINGS;
   timeParamsDoc["numReadings"] = numReadings;
   serializeJson(timeParamsDoc, outputFile);
   timeParamsDoc.clear();
   outputFile.print("\r\n"); // Need a newline after every timestamp for future operations
   inputFile.seek(0);
   inputFile.find("}");
-  outputFile.println(sensorReading.timeStamp);
-  if (numReadings - 1 > 0) {
+  for (int i = numNew - 1; i >= 0; i--) {  // Newest first, recording which channels were read
+    outputFile.printf("%s,%X\r\n", readings[i].timeStamp, readings[i].channelMask);
+  }
+  if (numReadings - numNew > 0) {
     inputFile.seek(inputFile.position() + 2);  // go past newline to start reading
   }
-  for (int i = 1; i < numReadings; i++) {
+  for (int i = numNew; i < numReadings; i++) {
     char timeStampCopy[NUM_CHARS_TIMESTAMP] = { 0 };
-    inputFile.readBytesUntil('\r', timeStampCopy, NUM_CHARS_TIMESTAMP);
-    outputFile.println(timeStampCopy);
+    inputFile.readBytesUntil('\r', timeStampCopy, NUM_CHARS_TIMESTAMP - 1);
+    if (strlen(timeStampCopy) == TIMESTAMP_LEN) {  // Line from before channel masks, every channel was read
+      outputFile.printf("%s,%X\r\n", timeStampCopy, ALL_CHANNELS_MASK);
+    } else {
+      outputFile.println(timeStampCopy);
+    }
     inputFile.seek(inputFile.position() + 1);
   }
   inputFile.close();
@@ -299,62 +391,139 @@ void Container::addTimeStamp() {
   SD.remove(tempFileName);
 }
 
-// Pull in plant data, add new readings, take averages, then push back to storage files
+// Pull in plant data, add new readings, take averages, then push back to storage files.
+// Readings are given oldest first; a batch costs the same file rewrites as a single reading.
 // To avoid excessive memory usage, each file is modified separately
-void Container::updatePlantData() {
-  int plantID = header.activePlantID;
+void Container::updatePlantData(SensorReading readings[], int numReadings) {
   char fileName[MAX_CHARS_FILENAME] = { 0 };
-  JsonDocument sensorDoc;
+  int channelMask = 0;
+  for (int j = 0; j < numReadings; j++) {
+    channelMask |= readings[j].channelMask;
+  }
   for (int i = 0; i < 4; i++) {
+    if (!(channelMask & (1 << i))) {
+      continue;  // Channel not due in this batch, its file is left untouched
+    }
     switch (i) {
       case lightFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/light.txt", plantID);
-        sensorDoc = readSDFile(fileName);
-        if (sensorDoc.isNull()) {
-          error.addError(fileOperation);
-          return;
-        }
-        sensorDoc = addSensorReading(sensorDoc, sensorReading.lightReading);
-        activePlant.avgLight = activePlant.getAvgReading(sensorDoc);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/light.txt");
         break;
       case waterFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/water.txt", plantID);
-        sensorDoc = readSDFile(fileName);
-        if (sensorDoc.isNull()) {
-          error.addError(fileOperation);
-          return;
-        }
-        sensorDoc = addSensorReading(sensorDoc, sensorReading.waterReading);
-        activePlant.avgWater = activePlant.getAvgReading(sensorDoc);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/water.txt");
         break;
       case humidityFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/humidity.txt", plantID);
-        sensorDoc = readSDFile(fileName);
-        if (sensorDoc.isNull()) {
-          error.addError(fileOperation);
-          return;
-        }
-        sensorDoc = addSensorReading(sensorDoc, sensorReading.humidityReading);
-        activePlant.avgHumidity = activePlant.getAvgReading(sensorDoc);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/humidity.txt");
         break;
       case tempFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/temp.txt", plantID);
-        sensorDoc = readSDFile(fileName);
-        if (sensorDoc.isNull()) {
-          error.addError(fileOperation);
-          return;
-        }
-        sensorDoc = addSensorReading(sensorDoc, sensorReading.tempReading);
-        activePlant.avgTemp = activePlant.getAvgReading(sensorDoc);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/temp.txt");
         break;
     }
-    int pushJsonError = pushJsonDoc(sensorDoc, fileName);
-    if (pushJsonError) {
-      error.addError(jsonError);
+    SensorFile sensorFile;
+    int loadError = sensorFile.load(fileName);
+    if (loadError) {
+      error.addError(loadError);
+      return;
+    }
+    for (int j = 0; j < numReadings; j++) {
+      if (readings[j].channelMask & (1 << i)) {
+        sensorFile.add(readings[j].getReading(i));
+        activePlant.stats[i].add(readings[j].getReading(i), i);
+      }
+    }
+    switch (i) {
+      case lightFile:
+        activePlant.avgLight = activePlant.getAvgReading(sensorFile);
+        break;
+      case waterFile:
+        activePlant.avgWater = activePlant.getAvgReading(sensorFile);
+        break;
+      case humidityFile:
+        activePlant.avgHumidity = activePlant.getAvgReading(sensorFile);
+        break;
+      case tempFile:
+        activePlant.avgTemp = activePlant.getAvgReading(sensorFile);
+        break;
+    }
+    int saveError = sensorFile.save();
+    if (saveError) {
+      error.addError(saveError);
+    }
+  }
+  for (int j = 0; j < numReadings; j++) {
+    activePlant.derived.add(readings[j], readings[j].time);
+    this->detectEvents(readings[j]);
+  }
+  this->addTimeStamp(readings, numReadings);
+  if (uplink.batch > 0) {
+    for (int j = 0; j < numReadings; j++) {
+      if (!uplink.queueReading(readings[j].timeStamp, readings[j].lightReading, readings[j].waterReading,
+                               readings[j].humidityReading, readings[j].tempReading)) {
+        error.addError(fileOperation);
+        break;
+      }
     }
-    sensorDoc.clear();
   }
-  this->addTimeStamp();
+}
+
+// Run the change-point detectors on the new reading and log any watering or lights on/off events.
+// The soil sensor reads lower when wetter, so only drops in the water channel are waterings, and each restarts the drying forecast
+void Container::detectEvents(SensorReading reading) {
+  if (reading.channelMask & (1 << waterFile)) {
+    int shift = activePlant.waterDetector.add(reading.waterReading, WATER_CUSUM_DRIFT, WATER_CUSUM_THRESHOLD);
+    if (shift < 0) {
+      activePlant.waterForecast = DryingForecast();
+      int logError = logEvent(wateringEvent, activePlant.waterDetector.shiftFrom, reading.waterReading, reading.timeStamp);
+      if (logError) {
+        error.addError(logError);
+      }
+    }
+    activePlant.waterForecast.add(reading.waterReading, reading.time);
+  }
+  if ((reading.channelMask & (1 << lightFile)) && !isnan(reading.lightReading)) {
+    float lightLevel = log10f(reading.lightReading + 1);  // +1 keeps darkness finite
+    int lastShift = activePlant.lightDetector.lastShift;
+    int shift = activePlant.lightDetector.add(lightLevel, LIGHT_CUSUM_DRIFT, LIGHT_CUSUM_THRESHOLD);
+    if (shift != 0 && shift != lastShift) {  // A slow dawn can step up more than once, only log changes of state
+      float from = powf(10, activePlant.lightDetector.shiftFrom) - 1;
+      int logError = logEvent((shift > 0) ? lightsOnEvent : lightsOffEvent, from, reading.lightReading, reading.timeStamp);
+      if (logError) {
+        error.addError(logError);
+      }
+    }
+  }
+}
+
+// Append an event to the event log. The log is a circular buffer like the sensor files,
+// and is only read and written when an event occurs
+int Container::logEvent(int eventType, float from, float to, char timeStamp[]) {
+  static const char* eventNames[] = { "watering", "lightsOn", "lightsOff" };  // Ordered by EventType
+  char fileName[MAX_CHARS_FILENAME] = { 0 };
+  snprintf(fileName, MAX_CHARS_FILENAME, "/env/events.txt");
+  JsonDocument eventDoc = readSDFile(fileName);
+  if (eventDoc.isNull()) {  // First event in this environment, start a new log
+    File eventFile = SD.open(fileName, FILE_WRITE);
+    if (!eventFile) {
+      return fileOperation;
+    }
+    eventFile.close();
+    eventDoc["startIndex"] = 0;
+    eventDoc["numEvents"] = 0;
+    eventDoc["events"].to<JsonArray>();
+  }
+  int startIndex = eventDoc["startIndex"];
+  JsonObject event = eventDoc["events"][startIndex].to<JsonObject>();
+  event["time"] = timeStamp;
+  event["type"] = eventNames[eventType];
+  event["from"] = from;
+  event["to"] = to;
+  eventDoc["startIndex"] = (startIndex + 1) % MAX_EVENTS;
+  int numEvents = eventDoc["numEvents"];
+  if (numEvents < MAX_EVENTS) {
+    eventDoc["numEvents"] = numEvents + 1;
+  }
+  int pushJsonError = pushJsonDoc(eventDoc, fileName);
+  eventDoc.clear();
+  return pushJsonError;
 }
 
 // Pull in the header data from the SD and parse it into a header object
@@ -374,6 +543,29 @@ void Container::pullHeader() {
   header.tempThreshold = headerDoc["tempThreshold"];
   header.waterThreshold = headerDoc["waterThreshold"];
   header.humidityThreshold = headerDoc["humidityThreshold"];
+  header.samplePeriodM[lightFile] = headerDoc["lightPeriodM"] | DEFAULT_SAMPLING_PERIOD_M;  // Per-channel periods are optional
+  header.samplePeriodM[waterFile] = headerDoc["waterPeriodM"] | DEFAULT_SAMPLING_PERIOD_M;
+  header.samplePeriodM[humidityFile] = headerDoc["humidityPeriodM"] | DEFAULT_SAMPLING_PERIOD_M;
+  header.samplePeriodM[tempFile] = headerDoc["tempPeriodM"] | DEFAULT_SAMPLING_PERIOD_M;
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    header.samplePeriodM[i] = (header.samplePeriodM[i] > 0) ? header.samplePeriodM[i] : DEFAULT_SAMPLING_PERIOD_M;
+  }
+  header.useDerivedMetrics = headerDoc["useDerivedMetrics"];
+  activePlant.useDerivedMetrics = header.useDerivedMetrics;
+  const char* wifiSSID = headerDoc["wifiSSID"] | "";  // Uplink fields are optional
+  snprintf(uplink.wifiSSID, NUM_CHARS_SSID, "%s", wifiSSID);
+  const char* wifiPassword = headerDoc["wifiPassword"] | "";
+  snprintf(uplink.wifiPassword, NUM_CHARS_PASSWORD, "%s", wifiPassword);
+  const char* mqttHost = headerDoc["mqttHost"] | "";
+  snprintf(uplink.mqttHost, NUM_CHARS_HOST, "%s", mqttHost);
+  uplink.mqttPort = headerDoc["mqttPort"] | 1883;
+  uplink.batch = headerDoc["uplinkBatch"];
+  uplink.cursor = headerDoc["uplinkCursor"];
+  uplink.pending = headerDoc["uplinkPending"];
+  uplink.dropped = headerDoc["uplinkDropped"];
+  uplink.radioOnTimeMs = headerDoc["uplinkOnTimeMs"];
+  header.logID = headerDoc["logID"];
+  header.logApplied = headerDoc["logApplied"];
   headerDoc.clear();
   headerPulled = 1;
 }
@@ -389,6 +581,22 @@ void Container::pushHeader() {
   headerDoc["tempThreshold"] = header.tempThreshold;
   headerDoc["waterThreshold"] = header.waterThreshold;
   headerDoc["humidityThreshold"] = header.humidityThreshold;
+  headerDoc["lightPeriodM"] = header.samplePeriodM[lightFile];
+  headerDoc["waterPeriodM"] = header.samplePeriodM[waterFile];
+  headerDoc["humidityPeriodM"] = header.samplePeriodM[humidityFile];
+  headerDoc["tempPeriodM"] = header.samplePeriodM[tempFile];
+  headerDoc["useDerivedMetrics"] = header.useDerivedMetrics;
+  headerDoc["wifiSSID"] = uplink.wifiSSID;
+  headerDoc["wifiPassword"] = uplink.wifiPassword;
+  headerDoc["mqttHost"] = uplink.mqttHost;
+  headerDoc["mqttPort"] = uplink.mqttPort;
+  headerDoc["uplinkBatch"] = uplink.batch;
+  headerDoc["uplinkCursor"] = uplink.cursor;
+  headerDoc["uplinkPending"] = uplink.pending;
+  headerDoc["uplinkDropped"] = uplink.dropped;
+  headerDoc["uplinkOnTimeMs"] = uplink.radioOnTimeMs;
+  headerDoc["logID"] = header.logID;
+  headerDoc["logApplied"] = header.logApplied;
   char fileName[MAX_CHARS_FILENAME] = "/header.txt";
   int pushJsonError = pushJsonDoc(headerDoc, fileName);
   if (pushJsonError) {
@@ -397,6 +605,67 @@ void Container::pushHeader() {
   headerDoc.clear();
 }
 
+// Fill the statistics of one channel from env.txt. Files of earlier firmware hold 9 P-square markers & 16-bit counts of
+// the readings between band edges: every other marker is kept, and each count moves to the gap below its upper edge
+static void pullStats(JsonVariant jsonStats, ChannelStats &stats) {
+  JsonArray jsonMarkers = jsonStats["markers"];
+  JsonArray jsonPositions = jsonStats["positions"];
+  JsonArray jsonBins = jsonStats["bins"];
+  stats.count = jsonStats["count"];
+  if (jsonMarkers.size() <= NUM_QUANTILE_MARKERS) {
+    for (int j = 0; j < NUM_QUANTILE_MARKERS; j++) {
+      stats.markers[j] = jsonMarkers[j];
+      stats.positions[j] = jsonPositions[j];
+    }
+    for (int j = 0; j < MAX_STAT_BINS; j++) {
+      stats.bins[j] = jsonBins[j];
+    }
+    return;
+  }
+  int stride = 2;
+  if (stats.count < jsonMarkers.size()) {  // Still collecting its first readings, keep them unsorted
+    stride = 1;
+    if (stats.count >= NUM_QUANTILE_MARKERS) {
+      stats.count = NUM_QUANTILE_MARKERS - 1;
+    }
+  }
+  for (int j = 0; j < NUM_QUANTILE_MARKERS; j++) {
+    stats.markers[j] = jsonMarkers[j * stride];
+    stats.positions[j] = jsonPositions[j * stride];
+  }
+  int shift = 0;
+  for (int j = 0; j < (int)jsonBins.size(); j++) {
+    while (((unsigned long)jsonBins[j] >> shift) > UINT8_MAX) {
+      shift++;
+    }
+  }
+  for (int j = 0; j < (int)jsonBins.size() && 2 * j < MAX_STAT_BINS; j++) {
+    stats.bins[2 * j] = (unsigned long)jsonBins[j] >> shift;
+  }
+}
+
+// Restore a change detector from the plant file. Missing fields leave it empty, so it restarts on the next reading
+static void pullDetector(JsonVariant jsonDetector, ChangeDetector &detector) {
+  detector.baseline = jsonDetector["baseline"];
+  detector.upSum = jsonDetector["upSum"];
+  detector.downSum = jsonDetector["downSum"];
+  detector.shiftFrom = jsonDetector["shiftFrom"];
+  detector.lastShift = jsonDetector["lastShift"];
+  detector.settling = jsonDetector["settling"];
+  detector.count = jsonDetector["count"];
+}
+
+// Store a change detector in the plant file
+static void pushDetector(JsonObject jsonDetector, ChangeDetector &detector) {
+  jsonDetector["baseline"] = detector.baseline;
+  jsonDetector["upSum"] = detector.upSum;
+  jsonDetector["downSum"] = detector.downSum;
+  jsonDetector["shiftFrom"] = detector.shiftFrom;
+  jsonDetector["lastShift"] = detector.lastShift;
+  jsonDetector["settling"] = detector.settling;
+  jsonDetector["count"] = detector.count;
+}
+
 // Pull data from the plant file of the active plant's folder and parse it into a plant object
 void Container::pullPlant() {
   char fileName[MAX_CHARS_FILENAME] = { 0 };
@@ -420,14 +689,104 @@ void Container::pullPlant() {
   activePlant.waterReq[1] = plantDoc["waterReq"][1];
   activePlant.hardiness[0] = plantDoc["hardiness"][0];
   activePlant.hardiness[1] = plantDoc["hardiness"][1];
-  activePlant.avgLight = plantDoc["avgLight"];
-  activePlant.avgWater = plantDoc["avgWater"];
-  activePlant.avgHumidity = plantDoc["avgHumidity"];
-  activePlant.avgTemp = plantDoc["avgTemp"];
   plantPulled = 1;
   plantDoc.clear();
 }
 
+// Pull the aggregates of the environment history into the active plant. Cards from before the history was moved out
+// of the plant folders are migrated on the first pull, taking the aggregates from the active plant's plant.txt
+void Container::pullEnvironment() {
+  char fileName[MAX_CHARS_FILENAME] = "/env/env.txt";
+  JsonDocument envDoc = readSDFile(fileName);
+  if (envDoc.isNull()) {
+    migrateEnvironment();
+    if (header.activePlantID != 0) {  // Null on a fresh card, every aggregate then starts empty
+      char legacyName[MAX_CHARS_FILENAME] = { 0 };
+      snprintf(legacyName, MAX_CHARS_FILENAME, "/plant%i/plant.txt", header.activePlantID);
+      envDoc = readSDFile(legacyName);
+    }
+    if (!SD.exists(fileName)) {  // pushJsonDoc() only writes existing files
+      File envFile = SD.open(fileName, FILE_WRITE);
+      if (!envFile) {
+        error.addError(fileOperation);
+        return;
+      }
+      envFile.close();
+    }
+  }
+  activePlant.avgLight = envDoc["avgLight"];
+  activePlant.avgWater = envDoc["avgWater"];
+  activePlant.avgHumidity = envDoc["avgHumidity"];
+  activePlant.avgTemp = envDoc["avgTemp"];
+  JsonArray jsonStats = envDoc["stats"];
+  for (int i = 0; i < NUM_CHANNELS && i < (int)jsonStats.size(); i++) {
+    pullStats(jsonStats[i], activePlant.stats[i]);
+  }
+  pullDetector(envDoc["waterDetector"], activePlant.waterDetector);
+  pullDetector(envDoc["lightDetector"], activePlant.lightDetector);
+  JsonObject jsonDerived = envDoc["derived"];
+  DerivedMetrics &derived = activePlant.derived;
+  derived.dli = jsonDerived["dli"];
+  derived.dliToday = jsonDerived["dliToday"];
+  derived.dliDays = jsonDerived["dliDays"];
+  derived.lightCoveredS = jsonDerived["lightCoveredS"];
+  derived.lastPPFD = jsonDerived["lastPPFD"];
+  derived.lastLightTime = jsonDerived["lastLightTime"];
+  derived.vpd = jsonDerived["vpd"];
+  derived.avgVPD = jsonDerived["avgVPD"];
+  derived.lastVPDTime = jsonDerived["lastVPDTime"];
+  derived.gdd = jsonDerived["gdd"];
+  derived.lastTempF = jsonDerived["lastTempF"] | NAN;  // null until a temperature has been read
+  derived.lastTempTime = jsonDerived["lastTempTime"];
+  derived.lastHumidity = jsonDerived["lastHumidity"] | NAN;
+  JsonObject jsonForecast = envDoc["waterForecast"];
+  DryingForecast &forecast = activePlant.waterForecast;
+  forecast.weight = jsonForecast["weight"];
+  forecast.meanT = jsonForecast["meanT"];
+  forecast.meanY = jsonForecast["meanY"];
+  forecast.varT = jsonForecast["varT"];
+  forecast.covTY = jsonForecast["covTY"];
+  forecast.rateWeight = jsonForecast["rateWeight"];
+  forecast.meanLevel = jsonForecast["meanLevel"];
+  forecast.meanRate = jsonForecast["meanRate"];
+  forecast.varLevel = jsonForecast["varLevel"];
+  forecast.covLR = jsonForecast["covLR"];
+  forecast.startTime = jsonForecast["startTime"];
+  forecast.lastTime = jsonForecast["lastTime"];
+  forecast.count = jsonForecast["count"];
+  environmentPulled = 1;
+  envDoc.clear();
+}
+
+// Move the history files of the active plant folder into /env/. Files are renamed, so nothing is copied. A card without
+// a complete history gets an empty one, and a sensor log is started if there is none to move. Before the first plant is
+// chosen there is no plant folder to move from
+void Container::migrateEnvironment() {
+  static const char* historyFiles[] = { "light.txt", "water.txt", "humidity.txt", "temp.txt", "dates.txt", "events.txt", "log.bin" };
+  if (!SD.exists("/env")) {
+    SD.mkdir("/env");
+  }
+  bool complete = 1;
+  for (int i = 0; i < (int)(sizeof(historyFiles) / sizeof(historyFiles[0])); i++) {
+    char from[MAX_CHARS_FILENAME] = { 0 };
+    char to[MAX_CHARS_FILENAME] = { 0 };
+    snprintf(from, MAX_CHARS_FILENAME, "/plant%i/%s", header.activePlantID, historyFiles[i]);
+    snprintf(to, MAX_CHARS_FILENAME, "/env/%s", historyFiles[i]);
+    if (header.activePlantID != 0 && !SD.exists(to) && SD.exists(from)) {
+      blockCache.invalidate(from);
+      SD.rename(from, to);
+    }
+    if (i <= datesFile && !SD.exists(to)) {  // Indexed like FileTypes up to the dates file
+      complete = 0;
+    }
+  }
+  if (!complete) {
+    clearSensorData();
+  } else if (!SD.exists("/env/log.bin")) {
+    startLog();
+  }
+}
+
 // Take data from a plant object and push it into the plant file of the active plant's folder
 void Container::pushPlant() {
   char fileName[MAX_CHARS_FILENAME] = { 0 };
@@ -447,57 +806,174 @@ void Container::pushPlant() {
   JsonArray jsonHardiness = plantDoc["hardiness"].to<JsonArray>();
   jsonHardiness.add(activePlant.hardiness[0]);
   jsonHardiness.add(activePlant.hardiness[1]);
-  plantDoc["avgLight"] = activePlant.avgLight;
-  plantDoc["avgWater"] = activePlant.avgWater;
-  plantDoc["avgHumidity"] = activePlant.avgHumidity;
-  plantDoc["avgTemp"] = activePlant.avgTemp;
   int pushJsonError = pushJsonDoc(plantDoc, fileName);
   if (pushJsonError) {
     error.addError(pushJsonError);
   }
+  plantChanged = 0;
   plantDoc.clear();
 }
 
-// Pull up to NUM_DISPLAY_PLANTS from the database and parse into an array of DBPlant objects
+// Push the aggregates of the environment history back into its file
+void Container::pushEnvironment() {
+  char fileName[MAX_CHARS_FILENAME] = "/env/env.txt";
+  JsonDocument envDoc;
+  envDoc["avgLight"] = activePlant.avgLight;
+  envDoc["avgWater"] = activePlant.avgWater;
+  envDoc["avgHumidity"] = activePlant.avgHumidity;
+  envDoc["avgTemp"] = activePlant.avgTemp;
+  JsonArray jsonStats = envDoc["stats"].to<JsonArray>();  // Indexed by FileTypes
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    ChannelStats &stats = activePlant.stats[i];
+    JsonObject jsonChannel = jsonStats.add<JsonObject>();
+    jsonChannel["count"] = stats.count;
+    JsonArray jsonMarkers = jsonChannel["markers"].to<JsonArray>();
+    JsonArray jsonPositions = jsonChannel["positions"].to<JsonArray>();
+    for (int j = 0; j < NUM_QUANTILE_MARKERS; j++) {
+      jsonMarkers.add(stats.markers[j]);
+      jsonPositions.add(stats.positions[j]);
+    }
+    JsonArray jsonBins = jsonChannel["bins"].to<JsonArray>();
+    for (int j = 0; j < MAX_STAT_BINS; j++) {
+      jsonBins.add(stats.bins[j]);
+    }
+  }
+  pushDetector(envDoc["waterDetector"].to<JsonObject>(), activePlant.waterDetector);
+  pushDetector(envDoc["lightDetector"].to<JsonObject>(), activePlant.lightDetector);
+  JsonObject jsonDerived = envDoc["derived"].to<JsonObject>();
+  DerivedMetrics &derived = activePlant.derived;
+  jsonDerived["dli"] = derived.dli;
+  jsonDerived["dliToday"] = derived.dliToday;
+  jsonDerived["dliDays"] = derived.dliDays;
+  jsonDerived["lightCoveredS"] = derived.lightCoveredS;
+  jsonDerived["lastPPFD"] = derived.lastPPFD;
+  jsonDerived["lastLightTime"] = derived.lastLightTime;
+  jsonDerived["vpd"] = derived.vpd;
+  jsonDerived["avgVPD"] = derived.avgVPD;
+  jsonDerived["lastVPDTime"] = derived.lastVPDTime;
+  jsonDerived["gdd"] = derived.gdd;
+  jsonDerived["lastTempF"] = derived.lastTempF;
+  jsonDerived["lastTempTime"] = derived.lastTempTime;
+  jsonDerived["lastHumidity"] = derived.lastHumidity;
+  JsonObject jsonForecast = envDoc["waterForecast"].to<JsonObject>();
+  DryingForecast &forecast = activePlant.waterForecast;
+  jsonForecast["weight"] = forecast.weight;
+  jsonForecast["meanT"] = forecast.meanT;
+  jsonForecast["meanY"] = forecast.meanY;
+  jsonForecast["varT"] = forecast.varT;
+  jsonForecast["covTY"] = forecast.covTY;
+  jsonForecast["rateWeight"] = forecast.rateWeight;
+  jsonForecast["meanLevel"] = forecast.meanLevel;
+  jsonForecast["meanRate"] = forecast.meanRate;
+  jsonForecast["varLevel"] = forecast.varLevel;
+  jsonForecast["covLR"] = forecast.covLR;
+  jsonForecast["startTime"] = forecast.startTime;
+  jsonForecast["lastTime"] = forecast.lastTime;
+  jsonForecast["count"] = forecast.count;
+  int pushJsonError = pushJsonDoc(envDoc, fileName);
+  if (pushJsonError) {
+    error.addError(pushJsonError);
+  }
+  envDoc.clear();
+}
+
+// Pull the requirement ranges of a database plant. Only the first and last elements of each are needed
+static void getDBRequirements(JsonVariant plant, int hardiness[2], int lightReq[2], int waterReq[2]) {
+  JsonArray jsonHardinessVals = plant["data"][0]["value"];
+  JsonArray jsonLightReqs = plant["data"][1]["value"];
+  JsonArray jsonWaterReqs = plant["data"][2]["value"];
+  hardiness[0] = jsonHardinessVals[0];
+  hardiness[1] = (jsonHardinessVals.size() > 1) ? jsonHardinessVals[jsonHardinessVals.size() - 1] : 0;
+  lightReq[0] = jsonLightReqs[0];
+  lightReq[1] = (jsonLightReqs.size() > 1) ? jsonLightReqs[jsonLightReqs.size() - 1] : 0;
+  waterReq[0] = jsonWaterReqs[0];
+  waterReq[1] = (jsonWaterReqs.size() > 1) ? jsonWaterReqs[jsonWaterReqs.size() - 1] : 0;
+}
+
+// Pull the NUM_DISPLAY_PLANTS database plants that best fit the measured environment, best first.
+// The database is streamed one plant at a time so it never has to fit in memory: requirements are collected into a
+// RequirementBlock, each full block is scored against the environment statistics, and only the winners are re-read in full.
+// With no readings yet every score is 0 and the first plants of the database are shown, as before
 void Container::getDBPlants() {
-  char fileName[MAX_CHARS_FILENAME] = "/plantDB.txt";
-  JsonDocument plantsDoc = readSDFile(fileName);
-  if (plantsDoc.isNull()) {
+  CachedFile dbFile("/plantDB.txt");
+  if (!dbFile) {
     error.addError(fileOperation);
     return;
   }
-  JsonArray jsonPlants = plantsDoc["plants"];
-  int index = 0;
-  for (JsonVariant plant : jsonPlants) {
-    if (index >= NUM_DISPLAY_PLANTS) {
+  if (!dbFile.find("\"plants\":[")) {
+    dbFile.close();
+    error.addError(jsonError);
+    return;
+  }
+  JsonDocument filter;
+  filter["data"][0]["value"] = true;  // Only the requirement values are needed to rank
+  JsonDocument plantDoc;              // One document for every plant, deserializeJson() clears it
+  static RequirementBlock block;  // Static to keep it off the loop task stack
+  float blockScores[RANK_BLOCK_SIZE];
+  float topScores[NUM_DISPLAY_PLANTS] = { 0 };
+  unsigned long topOffsets[NUM_DISPLAY_PLANTS] = { 0 };
+  int numTop = 0;
+  block.size = 0;
+  bool morePlants = 1;
+  while (morePlants) {
+    while (dbFile.available() && isspace(dbFile.peek())) {
+      dbFile.read();
+    }
+    if (!dbFile.available() || dbFile.peek() == ']') {
+      break;  // Empty database
+    }
+    unsigned long offset = dbFile.position();
+    DeserializationError jsonDeserializationError = deserializeJson(plantDoc, dbFile, DeserializationOption::Filter(filter));
+    if (jsonDeserializationError) {
+      dbFile.close();
+      error.addError(jsonError);
+      return;
+    }
+    int hardiness[2];
+    int lightReq[2];
+    int waterReq[2];
+    getDBRequirements(plantDoc, hardiness, lightReq, waterReq);
+    block.add(hardiness, lightReq, waterReq, offset);
+    morePlants = dbFile.findUntil(",", "]");
+    if (block.size == RANK_BLOCK_SIZE || !morePlants) {
+      block.score(activePlant.stats, blockScores);
+      for (int i = 0; i < block.size; i++) {
+        insertTopPlant(blockScores[i], block.offsets[i], topScores, topOffsets, numTop, NUM_DISPLAY_PLANTS);
+      }
+      block.size = 0;
+    }
+  }
+  bool ranked = 0;  // Only show scores once there are readings to rank against
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    ranked = ranked || activePlant.stats[i].count > 0;
+  }
+  for (int index = 0; index < numTop; index++) {
+    dbFile.seek(topOffsets[index]);
+    if (deserializeJson(plantDoc, dbFile)) {
+      error.addError(jsonError);
       break;
     }
-    plants[index].id = plant["id"];
-    const char* commonName = plant["name"];
+    plants[index].id = plantDoc["id"];
+    const char* commonName = plantDoc["name"];
     snprintf(plants[index].commonName, NUM_CHARS_NAME, "%s", commonName);
-    JsonArray jsonHardinessVals = plant["data"][0]["value"];
-    JsonArray jsonLightReqs = plant["data"][1]["value"];
-    JsonArray jsonWaterReqs = plant["data"][2]["value"];
-    plants[index].hardiness[0] = jsonHardinessVals[0];  // Only need first and last elements of each
-    plants[index].hardiness[1] = (jsonHardinessVals.size() > 1) ? jsonHardinessVals[jsonHardinessVals.size() - 1] : 0;
-    plants[index].lightReq[0] = jsonLightReqs[0];
-    plants[index].lightReq[1] = (jsonLightReqs.size() > 1) ? jsonLightReqs[jsonLightReqs.size() - 1] : 0;
-    plants[index].waterReq[0] = jsonWaterReqs[0];
-    plants[index].waterReq[1] = (jsonWaterReqs.size() > 1) ? jsonWaterReqs[jsonWaterReqs.size() - 1] : 0;
-    const char* scientificName = plant["scientific_name"];
+    getDBRequirements(plantDoc, plants[index].hardiness, plants[index].lightReq, plants[index].waterReq);
+    const char* scientificName = plantDoc["scientific_name"];
     snprintf(plants[index].scientificName, NUM_CHARS_NAME, "%s", scientificName);
-    const char* fact = plant["cultivation_fact"];
+    const char* fact = plantDoc["cultivation_fact"];
     snprintf(plants[index].fact, NUM_CHARS_FACT, "%s", fact);
-    index++;
+    plants[index].score = ranked ? (int)(100 * topScores[index] / NUM_RANKED_CHANNELS + 0.5) : -1;
   }
-  plantsDoc.clear();
+  dbFile.close();
   dbPlantsPulled = 1;
 }
 
-// Clear out data associated with the existing user plant (apart from average readings)
-// Create a new user plant from selected DB plant data
+// Create a new user plant from selected DB plant data. The environment history is kept, so this only swaps the
+// profile that the existing aggregates are judged against
 void Container::newUserPlant(int newSelfID) {
-  clearSensorData();
+  if (!environmentPulled) {
+    pullEnvironment();  // First plant on this card, the history is migrated or started here
+  }
+  header.activePlantID = newSelfID;
   int index = interface.selectedPlantIndex;
   activePlant.selfID = newSelfID;
   activePlant.baseID = plants[index].id;
@@ -510,45 +986,63 @@ void Container::newUserPlant(int newSelfID) {
   activePlant.waterReq[1] = plants[index].waterReq[1];
   activePlant.hardiness[0] = plants[index].hardiness[0];
   activePlant.hardiness[1] = plants[index].hardiness[1];
-  header.activePlantID = newSelfID;
+  plantPulled = 1;
+  plantChanged = 1;
 }
 
-// Remove all sensor readings for the currently selected plant
+// Start an empty environment history: remove all sensor readings, running statistics and logged events
 void Container::clearSensorData() {
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    activePlant.stats[i] = ChannelStats();
+  }
+  activePlant.waterDetector = ChangeDetector();
+  activePlant.lightDetector = ChangeDetector();
+  activePlant.waterForecast = DryingForecast();
+  activePlant.derived = DerivedMetrics();
+  char eventFileName[MAX_CHARS_FILENAME] = { 0 };
+  snprintf(eventFileName, MAX_CHARS_FILENAME, "/env/events.txt");
+  if (SD.exists(eventFileName)) {
+    blockCache.invalidate(eventFileName);
+    SD.remove(eventFileName);  // Recreated on the next event
+  }
   for (int i = 0; i < 5; i++) {
     char fileName[MAX_CHARS_FILENAME] = { 0 };
     JsonDocument emptyDoc;
     JsonArray readings;
     switch (i) {
       case lightFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/light.txt", header.activePlantID);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/light.txt");
         emptyDoc["startIndex"] = 0;
         emptyDoc["numReadings"] = 0;
         readings = emptyDoc["readings"].to<JsonArray>();
         break;
       case waterFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/water.txt", header.activePlantID);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/water.txt");
         emptyDoc["startIndex"] = 0;
         emptyDoc["numReadings"] = 0;
         readings = emptyDoc["readings"].to<JsonArray>();
         break;
       case humidityFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/humidity.txt", header.activePlantID);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/humidity.txt");
         emptyDoc["startIndex"] = 0;
         emptyDoc["numReadings"] = 0;
         readings = emptyDoc["readings"].to<JsonArray>();
         break;
       case tempFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/temp.txt", header.activePlantID);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/temp.txt");
         emptyDoc["startIndex"] = 0;
         emptyDoc["numReadings"] = 0;
         readings = emptyDoc["readings"].to<JsonArray>();
         break;
       case datesFile:
-        snprintf(fileName, MAX_CHARS_FILENAME, "/plant%i/dates.txt", header.activePlantID);
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/dates.txt");
         emptyDoc["numReadings"] = 0;
         break;
     }
+    if (!SD.exists(fileName)) {  // pushJsonDoc() only writes existing files
+      File newFile = SD.open(fileName, FILE_WRITE);
+      newFile.close();
+    }
     int pushJsonError = pushJsonDoc(emptyDoc, fileName);
     emptyDoc.clear();
     readings.clear();
@@ -557,6 +1051,914 @@ void Container::clearSensorData() {
       return;
     }
   }
+  startLog();
+}
+
+// Preallocate a fresh sensor log. Without one, readings are written straight to the storage files.
+// The new logID only reaches the card with the header, so this wake is not deferred
+void Container::startLog() {
+  uint32_t newLogID = esp_random() | 1;  // Never 0, which marks a card without a log
+  header.logApplied = 0;
+  header.logID = sensorLog.create(newLogID) ? newLogID : 0;
+  logStarted = 1;
+}
+
+// Store the latest reading. With a sensor log it is appended there, and the storage files are only rewritten once
+// LOG_CHECKPOINT_RECORDS readings are pending or the wake cannot be deferred (someone may look at the data)
+void Container::recordReading(bool deferrable) {
+  if (sensorLog.ready && sensorLog.append(sensorReading)) {
+    if (deferrable && !logStarted && sensorLog.nextSeq - 1 - header.logApplied < LOG_CHECKPOINT_RECORDS) {
+      deferredWake = 1;
+    } else {
+      checkpointLog();
+    }
+    return;
+  }
+  checkpointLog();  // Keep readings in order if the log just failed
+  updatePlantData(&sensorReading, 1);
+}
+
+// Fold the readings logged since the last checkpoint into the storage files, LOG_CHECKPOINT_RECORDS at a time
+void Container::checkpointLog() {
+  if (!sensorLog.ready) {
+    return;
+  }
+  uint32_t lastSeq = sensorLog.nextSeq - 1;
+  uint32_t seq = header.logApplied + 1;
+  if (lastSeq > LOG_RECORDS && seq <= lastSeq - LOG_RECORDS) {
+    seq = lastSeq - LOG_RECORDS + 1;  // Older records have been overwritten
+  }
+  SensorReading batch[LOG_CHECKPOINT_RECORDS];
+  while (seq <= lastSeq) {
+    int numBatch = 0;
+    for (; seq <= lastSeq && numBatch < LOG_CHECKPOINT_RECORDS; seq++) {
+      LogRecord record;
+      if (!sensorLog.read(seq, record)) {
+        continue;  // Lost to a failed write, skip it
+      }
+      SensorReading &reading = batch[numBatch++];
+      reading.channelMask = record.channelMask;
+      reading.lightReading = record.readings[lightFile];
+      reading.waterReading = record.readings[waterFile];
+      reading.humidityReading = record.readings[humidityFile];
+      reading.tempReading = record.readings[tempFile];
+      reading.plantID = header.activePlantID;
+      reading.time = record.time;
+      formatTimeStr(reading.timeStamp, record.time);
+    }
+    if (numBatch > 0) {
+      updatePlantData(batch, numBatch);
+    }
+    header.logApplied = seq - 1;
+  }
+}
+
+// Read the timestamp on a given line of a dates file. Lines are fixed width, so only the sector holding it is touched
+static bool readDateLine(CachedFile &file, unsigned long dataStart, int lineLen, int index, char buffer[]) {
+  if (!file.seek(dataStart + (unsigned long)index * lineLen)) {
+    return 0;
+  }
+  return file.readBytes(buffer, TIMESTAMP_LEN) == TIMESTAMP_LEN;
+}
+
+// Read the channel mask of a given line of a dates file, lines without one had every channel read
+static int readDateMask(CachedFile &file, unsigned long dataStart, int lineLen, int index) {
+  if (lineLen == OLD_DATE_LINE_LEN || !file.seek(dataStart + (unsigned long)index * lineLen + TIMESTAMP_LEN + 1)) {
+    return ALL_CHANNELS_MASK;
+  }
+  char hex[2] = { (char)file.read(), '\0' };
+  return (int)strtol(hex, NULL, 16);
+}
+
+// Read the next value of a readings array into a buffer. Returns 0 once the end of the array is reached
+static bool readNextValue(CachedFile &file, char buffer[], int bufferLen) {
+  int length = 0;
+  while (file.available()) {
+    char c = file.read();
+    if (c == ',' || c == ']') {
+      buffer[length] = '\0';
+      return length > 0 || c == ',';
+    }
+    if (c != ' ' && length < bufferLen - 1) {
+      buffer[length++] = c;
+    }
+  }
+  return 0;
+}
+
+// Add the readings of one sensor file whose age (0 = newest) falls within [newestIndex, oldestIndex] to stats.
+// The readings array is streamed and reading stops after the last slot needed, so no JsonDocument is built
+static int readChannelRange(char fileName[], int newestIndex, int oldestIndex, RangeStats &stats) {
+  CachedFile file(fileName);
+  if (!file) {
+    return fileOperation;
+  }
+  if (!file.find("\"startIndex\":")) {
+    file.close();
+    return jsonError;
+  }
+  int startIndex = file.parseInt();
+  file.seek(0);
+  if (!file.find("\"numReadings\":")) {
+    file.close();
+    return jsonError;
+  }
+  int numReadings = file.parseInt();
+  oldestIndex = (oldestIndex < numReadings - 1) ? oldestIndex : numReadings - 1;
+  if (newestIndex > oldestIndex) {
+    file.close();
+    return noError;
+  }
+  file.seek(0);
+  if (!file.find("\"readings\":[")) {
+    file.close();
+    return jsonError;
+  }
+  // Circular buffer: the reading of age k sits in slot (startIndex - 1 - k)
+  int highSlot = (startIndex - 1 - newestIndex + MAX_SENSOR_READINGS) % MAX_SENSOR_READINGS;
+  int lowSlot = (startIndex - 1 - oldestIndex + MAX_SENSOR_READINGS) % MAX_SENSOR_READINGS;
+  bool wrapped = lowSlot > highSlot;
+  int lastSlot = wrapped ? numReadings - 1 : highSlot;
+  char value[16] = { 0 };
+  for (int slot = 0; slot <= lastSlot && readNextValue(file, value, sizeof(value)); slot++) {
+    bool inRange = wrapped ? (slot <= highSlot || slot >= lowSlot) : (slot >= lowSlot);
+    if (inRange && value[0] != 'n') {  // Skip null entries
+      stats.add(atof(value));
+    }
+  }
+  file.close();
+  return noError;
+}
+
+// Compute count/min/max/mean of each channel for readings taken between two timestamps (inclusive).
+// The timestamp index is binary searched, then only the slots covering the range are read from each sensor file.
+// stats must hold NUM_CHANNELS entries, indexed by FileTypes
+int Container::queryRange(char startTime[], char endTime[], RangeStats stats[]) {
+  if (strlen(startTime) < TIMESTAMP_LEN || strlen(endTime) < TIMESTAMP_LEN) {
+    return jsonError;
+  }
+  char fileName[MAX_CHARS_FILENAME] = { 0 };
+  snprintf(fileName, MAX_CHARS_FILENAME, "/env/dates.txt");
+  CachedFile datesFile(fileName);
+  if (!datesFile) {
+    return fileOperation;
+  }
+  if (!datesFile.find("\"numReadings\":")) {
+    datesFile.close();
+    return jsonError;
+  }
+  int numReadings = datesFile.parseInt();
+  datesFile.find("}");
+  unsigned long dataStart = datesFile.position() + 2;  // Skip the CRLF after the JSON
+  char timeStamp[NUM_CHARS_TIMESTAMP] = { 0 };
+  int lineLen = DATE_LINE_LEN;
+  datesFile.seek(dataStart + TIMESTAMP_LEN);
+  if (datesFile.read() == '\r') {
+    lineLen = OLD_DATE_LINE_LEN;  // Dates file not yet rewritten since channel masks were added
+  }
+  // Dates are stored newest first. Find the first line at or before endTime...
+  int low = 0;
+  int high = numReadings;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (!readDateLine(datesFile, dataStart, lineLen, mid, timeStamp)) {
+      datesFile.close();
+      return fileOperation;
+    }
+    if (strncmp(timeStamp, endTime, TIMESTAMP_LEN) <= 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  int newestIndex = low;
+  // ...then the first line before startTime
+  high = numReadings;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (!readDateLine(datesFile, dataStart, lineLen, mid, timeStamp)) {
+      datesFile.close();
+      return fileOperation;
+    }
+    if (strncmp(timeStamp, startTime, TIMESTAMP_LEN) < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  int oldestIndex = low - 1;
+  if (newestIndex > oldestIndex) {
+    datesFile.close();
+    return noError;  // Nothing recorded within the range
+  }
+  // Channels are sampled at their own rates, so a date line maps to a different age in each sensor file.
+  // Count the lines carrying each channel to translate the range into per-channel ages
+  int newestAge[NUM_CHANNELS] = { 0 };
+  int oldestAge[NUM_CHANNELS] = { 0 };
+  for (int line = 0; line <= oldestIndex; line++) {
+    int mask = readDateMask(datesFile, dataStart, lineLen, line);
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      if (mask & (1 << i)) {
+        newestAge[i] += (line < newestIndex);
+        oldestAge[i]++;
+      }
+    }
+  }
+  datesFile.close();
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    switch (i) {
+      case lightFile:
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/light.txt");
+        break;
+      case waterFile:
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/water.txt");
+        break;
+      case humidityFile:
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/humidity.txt");
+        break;
+      case tempFile:
+        snprintf(fileName, MAX_CHARS_FILENAME, "/env/temp.txt");
+        break;
+    }
+    int queryError = readChannelRange(fileName, newestAge[i], oldestAge[i] - 1, stats[i]);
+    if (queryError) {
+      return queryError;
+    }
+  }
+  return noError;
+}
+
+/*------------------------------------------------------------ SensorLog Class ------------------------------------------------------------*/
+
+// Initialization
+SensorLog::SensorLog()
+  : _sector{} {
+  ready = 0;
+  logID = 0;
+  baseSector = 0;
+  nextSeq = 1;
+  lastTime = 0;
+  _loadedSector = 0;
+  _sectorLoaded = 0;
+  _verified = 0;
+}
+
+// The SD library keeps the FatFs drive number of the mounted card protected. A derived class may still name the member,
+// which reads it from the SD object without constructing one
+class SDDrive : public SDFS {
+public:
+  static uint8_t get(SDFS &sd) {
+    return sd.*(&SDDrive::_pdrv);
+  }
+};
+
+// Find the log file and the first sector of its extent, optionally (re)creating it preallocated as one
+// contiguous extent first. The SD library does not expose file placement, so this goes to FatFs directly
+bool SensorLog::locate(bool preallocate) {
+  uint8_t drive = SDDrive::get(SD);  // Logical drive the SD library mounted the card as, 0xFF if none
+  if (drive == 0xFF) {
+    return 0;
+  }
+  char path[MAX_CHARS_FILENAME] = { 0 };
+  snprintf(path, MAX_CHARS_FILENAME, "%u:/env/log.bin", drive);
+  FIL file;
+  if (f_open(&file, path, preallocate ? (FA_CREATE_ALWAYS | FA_WRITE) : FA_READ) != FR_OK) {
+    return 0;
+  }
+  bool located = 1;
+  if (preallocate && f_expand(&file, (FSIZE_t)LOG_RECORDS * LOG_RECORD_SIZE, 1) != FR_OK) {  // Fails rather than fragment
+    located = 0;
+  }
+  if (f_size(&file) < (FSIZE_t)LOG_RECORDS * LOG_RECORD_SIZE) {
+    located = 0;
+  }
+  if (located) {
+    // FatFs internals, as laid out in the FatFs R0.15 of arduino-esp32 3.0 (ESP-IDF 5.1) this was written for; re-check
+    // them when the core changes. fs->database is the sector of cluster 2, fs->csize the sectors per cluster and
+    // obj.sclust the first cluster of the file, which f_expand() made contiguous
+    FATFS* fs = file.obj.fs;
+    baseSector = fs->database + (uint32_t)fs->csize * (file.obj.sclust - 2);  // First sector of the first cluster
+  }
+  f_close(&file);
+  return located;
+}
+
+// Read a sector of the log into the sector buffer unless it is already there
+bool SensorLog::loadSector(uint32_t sector) {
+  if (_sectorLoaded && _loadedSector == sector) {
+    return 1;
+  }
+  _sectorLoaded = 0;
+  if (!SD.readRAW(_sector, sector)) {
+    return 0;
+  }
+  _loadedSector = sector;
+  _sectorLoaded = 1;
+  return 1;
+}
+
+// Preallocate an empty log
+bool SensorLog::create(uint32_t newLogID) {
+  ready = locate(1);
+  logID = newLogID;
+  nextSeq = 1;
+  lastTime = 0;
+  _sectorLoaded = 0;
+  _verified = ready;
+  return ready;
+}
+
+// Open the existing log, recovering the next sequence number and the newest time from the highest one stored
+bool SensorLog::open(uint32_t existingLogID) {
+  ready = 0;
+  _sectorLoaded = 0;
+  if (!locate(0)) {
+    return 0;
+  }
+  logID = existingLogID;
+  nextSeq = 1;
+  lastTime = 0;
+  for (uint32_t i = 0; i < LOG_RECORDS / LOG_RECORDS_PER_SECTOR; i++) {
+    if (!loadSector(baseSector + i)) {
+      return 0;
+    }
+    for (int j = 0; j < LOG_RECORDS_PER_SECTOR; j++) {
+      LogRecord record;
+      memcpy(&record, _sector + j * LOG_RECORD_SIZE, LOG_RECORD_SIZE);
+      if (record.logID == logID && record.seq >= nextSeq) {
+        nextSeq = record.seq + 1;
+        lastTime = record.time;
+      }
+    }
+  }
+  ready = 1;
+  _verified = 1;
+  return 1;
+}
+
+// Pick up a log whose position was kept through deep sleep, without touching the card. append() checks it before writing
+void SensorLog::resume(uint32_t existingLogID, uint32_t sector, uint32_t seq) {
+  logID = existingLogID;
+  baseSector = sector;
+  nextSeq = seq;
+  _sectorLoaded = 0;
+  _verified = 0;
+  ready = 1;
+}
+
+// Whether a resumed position still points at this log: the slot before the next one must hold the last record written.
+// Before the first record there is none, so the file must still start at the same sector. Only reads the card
+bool SensorLog::verify() {
+  if (nextSeq == 1) {
+    uint32_t cachedSector = baseSector;
+    return locate(0) && baseSector == cachedSector;
+  }
+  uint32_t slot = (nextSeq - 2) % LOG_RECORDS;
+  if (!loadSector(baseSector + slot / LOG_RECORDS_PER_SECTOR)) {
+    return 0;
+  }
+  LogRecord record;
+  memcpy(&record, _sector + (slot % LOG_RECORDS_PER_SECTOR) * LOG_RECORD_SIZE, LOG_RECORD_SIZE);
+  return record.logID == logID && record.seq == nextSeq - 1;
+}
+
+// Write a reading into the next slot. The first record of a sector clears the rest of it, so no read is needed
+bool SensorLog::append(SensorReading reading) {
+  if (!ready) {
+    return 0;
+  }
+  if (!_verified) {
+    if (!verify() && !open(logID)) {  // The card was edited or swapped while asleep, find the log again before writing
+      return 0;
+    }
+    _verified = 1;
+  }
+  uint32_t slot = (nextSeq - 1) % LOG_RECORDS;
+  uint32_t sector = baseSector + slot / LOG_RECORDS_PER_SECTOR;
+  if (slot % LOG_RECORDS_PER_SECTOR == 0) {
+    memset(_sector, 0, SECTOR_SIZE);
+    _loadedSector = sector;
+    _sectorLoaded = 1;
+  } else if (!loadSector(sector)) {
+    return 0;
+  }
+  LogRecord record = {};
+  record.logID = logID;
+  record.seq = nextSeq;
+  record.time = reading.time;
+  record.channelMask = reading.channelMask;
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    record.readings[i] = reading.getReading(i);
+  }
+  memcpy(_sector + (slot % LOG_RECORDS_PER_SECTOR) * LOG_RECORD_SIZE, &record, LOG_RECORD_SIZE);
+  if (!SD.writeRAW(_sector, sector)) {
+    _sectorLoaded = 0;
+    return 0;
+  }
+  nextSeq++;
+  return 1;
+}
+
+// Read back a record, failing if its slot holds anything else
+bool SensorLog::read(uint32_t seq, LogRecord &record) {
+  if (!ready || seq == 0 || seq >= nextSeq) {
+    return 0;
+  }
+  uint32_t slot = (seq - 1) % LOG_RECORDS;
+  if (!loadSector(baseSector + slot / LOG_RECORDS_PER_SECTOR)) {
+    return 0;
+  }
+  memcpy(&record, _sector + (slot % LOG_RECORDS_PER_SECTOR) * LOG_RECORD_SIZE, LOG_RECORD_SIZE);
+  return record.logID == logID && record.seq == seq;
+}
+
+/*------------------------------------------------------------ BlockCache Class ------------------------------------------------------------*/
+
+// Initialization, a couple of blocks are usable straight away
+BlockCache::BlockCache()
+  : _minSlots{}, _minData{}, _fileNames{}, _fileKeys{}, _fileSizes{}, _fileUsed{} {
+  hits = 0;
+  misses = 0;
+  numBlocks = CACHE_MIN_BLOCKS;
+  _slots = _minSlots;
+  _data = _minData;
+  _nextKey = 1;
+  _tick = 0;
+  _openKey = 0;
+}
+
+// Give the cache a RAM budget, each block costs CACHE_BLOCK_SIZE bytes plus its slot. Cached blocks are dropped
+bool BlockCache::begin(size_t budgetBytes) {
+  int blocks = budgetBytes / (CACHE_BLOCK_SIZE + sizeof(CacheSlot));
+  if (blocks <= numBlocks) {
+    return 0;
+  }
+  CacheSlot* slots = (CacheSlot*)calloc(blocks, sizeof(CacheSlot));
+  uint8_t* data = (uint8_t*)malloc((size_t)blocks * CACHE_BLOCK_SIZE);
+  if (!slots || !data) {
+    free(slots);
+    free(data);
+    return 0;
+  }
+  if (_slots != _minSlots) {
+    free(_slots);
+    free(_data);
+  }
+  _slots = slots;
+  _data = data;
+  numBlocks = blocks;
+  return 1;
+}
+
+// Entry of a file in the file table, -1 if it has been evicted or written since
+int BlockCache::fileIndex(uint32_t fileKey) {
+  for (int i = 0; i < CACHE_MAX_FILES; i++) {
+    if (fileKey != 0 && _fileKeys[i] == fileKey) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Look up a file, opening it on the card only if it is not already known. Returns its key, 0 if it does not exist
+uint32_t BlockCache::openFile(const char* fileName, uint32_t &size) {
+  int oldest = 0;
+  for (int i = 0; i < CACHE_MAX_FILES; i++) {
+    if (_fileKeys[i] != 0 && strcmp(_fileNames[i], fileName) == 0) {
+      _fileUsed[i] = ++_tick;
+      size = _fileSizes[i];
+      return _fileKeys[i];
+    }
+    if (_fileKeys[i] == 0 || (_fileKeys[oldest] != 0 && _fileUsed[i] < _fileUsed[oldest])) {
+      oldest = i;  // Free entries first, then the least recently used
+    }
+  }
+  if (_fileKeys[oldest] != 0) {
+    invalidate(_fileNames[oldest]);  // Table full, forget the least recently used file
+  }
+  if (_file) {
+    _file.close();
+  }
+  _file = SD.open(fileName, FILE_READ);
+  if (!_file) {
+    _openKey = 0;
+    return 0;
+  }
+  snprintf(_fileNames[oldest], MAX_CHARS_FILENAME, "%s", fileName);
+  _fileKeys[oldest] = _nextKey++;
+  _fileSizes[oldest] = _file.size();
+  _fileUsed[oldest] = ++_tick;
+  _openKey = _fileKeys[oldest];
+  size = _fileSizes[oldest];
+  return _openKey;
+}
+
+// Cache slot holding a block of a file, reading it from the card into the least recently used slot on a miss.
+// Returns -1 if the block cannot be read
+int BlockCache::getBlock(uint32_t fileKey, uint32_t index) {
+  int oldest = 0;
+  for (int i = 0; i < numBlocks; i++) {
+    if (_slots[i].fileKey == fileKey && _slots[i].index == index) {
+      _slots[i].lastUsed = ++_tick;
+      hits++;
+      return i;
+    }
+    if (_slots[i].lastUsed < _slots[oldest].lastUsed) {
+      oldest = i;  // Free slots were never used, so they come first
+    }
+  }
+  int file = fileIndex(fileKey);
+  if (file < 0) {
+    return -1;
+  }
+  misses++;
+  if (_openKey != fileKey) {
+    if (_file) {
+      _file.close();
+    }
+    _file = SD.open(_fileNames[file], FILE_READ);
+    _openKey = _file ? fileKey : 0;
+    if (!_file) {
+      return -1;
+    }
+  }
+  _slots[oldest].fileKey = 0;
+  uint8_t* data = _data + (size_t)oldest * CACHE_BLOCK_SIZE;
+  if (!_file.seek(index * CACHE_BLOCK_SIZE)) {
+    return -1;
+  }
+  int length = _file.read(data, CACHE_BLOCK_SIZE);
+  if (length <= 0) {
+    return -1;
+  }
+  _slots[oldest].fileKey = fileKey;
+  _slots[oldest].index = index;
+  _slots[oldest].lastUsed = ++_tick;
+  _slots[oldest].length = length;
+  return oldest;
+}
+
+// Whether a slot still holds the given block
+bool BlockCache::holds(int slot, uint32_t fileKey, uint32_t index) {
+  return slot >= 0 && _slots[slot].fileKey == fileKey && _slots[slot].index == index;
+}
+
+const uint8_t* BlockCache::blockData(int slot) {
+  return _data + (size_t)slot * CACHE_BLOCK_SIZE;
+}
+
+int BlockCache::blockLength(int slot) {
+  return _slots[slot].length;
+}
+
+// Forget a file before it is written or removed. Its blocks become unreachable and are reused first
+void BlockCache::invalidate(const char* fileName) {
+  for (int i = 0; i < CACHE_MAX_FILES; i++) {
+    if (_fileKeys[i] == 0 || strcmp(_fileNames[i], fileName) != 0) {
+      continue;
+    }
+    for (int j = 0; j < numBlocks; j++) {
+      if (_slots[j].fileKey == _fileKeys[i]) {
+        _slots[j].fileKey = 0;
+        _slots[j].lastUsed = 0;
+      }
+    }
+    if (_openKey == _fileKeys[i]) {
+      _file.close();  // The handle must not be open while the file is written
+      _openKey = 0;
+    }
+    _fileKeys[i] = 0;
+  }
+}
+
+/*------------------------------------------------------------ CachedFile Class ------------------------------------------------------------*/
+
+// Initialization, the file is looked up straight away
+CachedFile::CachedFile(const char* fileName) {
+  _size = 0;
+  _pos = 0;
+  _slot = -1;
+  _key = blockCache.openFile(fileName, _size);
+  setTimeout(0);  // Reads past the end fail at once instead of waiting for more data
+}
+
+CachedFile::operator bool() const {
+  return _key != 0;
+}
+
+int CachedFile::available() {
+  return (_key != 0 && _pos < _size) ? _size - _pos : 0;
+}
+
+int CachedFile::read() {
+  int c = peek();
+  if (c >= 0) {
+    _pos++;
+  }
+  return c;
+}
+
+int CachedFile::peek() {
+  if (!available()) {
+    return -1;
+  }
+  uint32_t index = _pos / CACHE_BLOCK_SIZE;
+  if (!blockCache.holds(_slot, _key, index)) {
+    _slot = blockCache.getBlock(_key, index);
+    if (_slot < 0) {
+      return -1;
+    }
+  }
+  uint32_t offset = _pos % CACHE_BLOCK_SIZE;
+  if ((int)offset >= blockCache.blockLength(_slot)) {
+    return -1;
+  }
+  return blockCache.blockData(_slot)[offset];
+}
+
+// Read-only
+size_t CachedFile::write(uint8_t) {
+  return 0;
+}
+
+bool CachedFile::seek(uint32_t pos) {
+  if (_key == 0 || pos > _size) {
+    return 0;
+  }
+  _pos = pos;
+  return 1;
+}
+
+size_t CachedFile::position() {
+  return _pos;
+}
+
+size_t CachedFile::size() {
+  return _size;
+}
+
+// Blocks stay cached after the file is closed
+void CachedFile::close() {
+  _key = 0;
+}
+
+/*------------------------------------------------------------ SensorFile Class ------------------------------------------------------------*/
+
+// Edits are numbered by slot, with the two header fields after the last slot
+static const int startIndexField = MAX_SENSOR_READINGS;
+static const int numReadingsField = MAX_SENSOR_READINGS + 1;
+
+// Initialization
+SensorFile::SensorFile()
+  : readings{}, _fileName{}, _fieldPos{}, _fieldLen{}, _slotPos{}, _slotLen{}, _changed{} {
+  startIndex = 0;
+  numReadings = 0;
+  arrayLen = 0;
+  _text = NULL;
+  _textLen = 0;
+  _closePos = 0;
+  _loadedLen = 0;
+  _loaded = 0;
+}
+
+SensorFile::~SensorFile() {
+  free(_text);
+}
+
+// Position after any JSON whitespace at pos
+static int skipSpace(const char text[], int pos) {
+  while (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n') {
+    pos++;
+  }
+  return pos;
+}
+
+// Parse the number or null at pos, null as NAN. Returns the position after it, -1 if there is neither
+static int parseJsonNumber(const char text[], int pos, float &value) {
+  if (strncmp(&text[pos], "null", 4) == 0) {
+    value = NAN;
+    return pos + 4;
+  }
+  char* end;
+  value = strtof(&text[pos], &end);
+  return (end == &text[pos]) ? -1 : end - text;
+}
+
+// Read a sensor file into memory and parse it, noting where each value sits for save(). Keys may be in any order
+int SensorFile::load(char fileName[]) {
+  CachedFile file(fileName);
+  if (!file) {
+    return fileOperation;
+  }
+  free(_text);
+  _loaded = 0;
+  _textLen = file.size();
+  _text = (_textLen > 0 && _textLen <= UINT16_MAX) ? (char*)malloc(_textLen + 1) : NULL;
+  bool readOK = _text && file.readBytes(_text, _textLen) == (size_t)_textLen;
+  file.close();
+  if (!readOK) {
+    return _text ? fileOperation : jsonError;
+  }
+  _text[_textLen] = '\0';
+  strncpy(_fileName, fileName, MAX_CHARS_FILENAME - 1);
+  bool found[3] = { 0 };  // startIndex, numReadings, readings
+  int pos = skipSpace(_text, 0);
+  if (_text[pos] != '{') {
+    return jsonError;
+  }
+  pos = skipSpace(_text, pos + 1);
+  while (_text[pos] == '"') {
+    const char* key = &_text[pos + 1];
+    const char* keyEnd = strchr(key, '"');
+    if (!keyEnd) {
+      return jsonError;
+    }
+    pos = skipSpace(_text, keyEnd - _text + 1);
+    if (_text[pos] != ':') {
+      return jsonError;
+    }
+    pos = skipSpace(_text, pos + 1);
+    if (strncmp(key, "readings\"", 9) == 0) {
+      if (_text[pos] != '[') {
+        return jsonError;
+      }
+      pos = skipSpace(_text, pos + 1);
+      arrayLen = 0;
+      while (_text[pos] != ']') {
+        if (arrayLen == MAX_SENSOR_READINGS) {
+          return jsonError;
+        }
+        int end = parseJsonNumber(_text, pos, readings[arrayLen]);
+        if (end < 0 || end - pos > UINT8_MAX) {
+          return jsonError;
+        }
+        _slotPos[arrayLen] = pos;
+        _slotLen[arrayLen] = end - pos;
+        arrayLen++;
+        pos = skipSpace(_text, end);
+        if (_text[pos] == ',') {
+          pos = skipSpace(_text, pos + 1);
+        } else if (_text[pos] != ']') {
+          return jsonError;
+        }
+      }
+      _closePos = pos;
+      found[2] = 1;
+      pos++;
+    } else {
+      int field;
+      if (strncmp(key, "startIndex\"", 11) == 0) {
+        field = 0;
+      } else if (strncmp(key, "numReadings\"", 12) == 0) {
+        field = 1;
+      } else {
+        return jsonError;  // Not a sensor file
+      }
+      char* end;
+      int value = strtol(&_text[pos], &end, 10);
+      if (end == &_text[pos]) {
+        return jsonError;
+      }
+      _fieldPos[field] = pos;
+      _fieldLen[field] = end - &_text[pos];
+      (field == 0 ? startIndex : numReadings) = value;
+      found[field] = 1;
+      pos = end - _text;
+    }
+    pos = skipSpace(_text, pos);
+    if (_text[pos] == ',') {
+      pos = skipSpace(_text, pos + 1);
+    }
+  }
+  if (_text[pos] != '}' || !found[0] || !found[1] || !found[2]) {
+    return jsonError;
+  }
+  if (startIndex < 0 || startIndex >= MAX_SENSOR_READINGS || numReadings < 0 || numReadings > MAX_SENSOR_READINGS) {
+    return jsonError;
+  }
+  _loadedLen = arrayLen;
+  _loaded = 1;
+  return noError;
+}
+
+// Add a reading to the circular buffer. As with a JsonArray, writing past the end of the array extends it with nulls
+void SensorFile::add(float reading) {
+  for (int i = arrayLen; i < startIndex; i++) {
+    readings[i] = NAN;
+    _changed[i / 32] |= 1UL << (i % 32);
+  }
+  readings[startIndex] = reading;
+  _changed[startIndex / 32] |= 1UL << (startIndex % 32);
+  if (startIndex >= arrayLen) {
+    arrayLen = startIndex + 1;
+  }
+  startIndex = (startIndex + 1) % MAX_SENSOR_READINGS;
+  if (numReadings < MAX_SENSOR_READINGS) {
+    numReadings++;
+  }
+}
+
+// New text of an edited field, a slot added to the array carries its separating comma. Returns its length
+int SensorFile::editText(int field, char buffer[]) {
+  if (field == startIndexField || field == numReadingsField) {
+    return snprintf(buffer, NUM_CHARS_JSON_NUMBER, "%i", (field == startIndexField) ? startIndex : numReadings);
+  }
+  if (field >= _loadedLen && field > 0) {
+    buffer[0] = ',';
+    return formatJsonFloat(readings[field], &buffer[1]) + 1;
+  }
+  return formatJsonFloat(readings[field], buffer);
+}
+
+// Position in the loaded text of an edited field, added slots go before the closing ']'
+int SensorFile::editPos(int field) {
+  if (field == startIndexField || field == numReadingsField) {
+    return _fieldPos[field - startIndexField];
+  }
+  return (field < _loadedLen) ? _slotPos[field] : _closePos;
+}
+
+// Length of the text an edited field replaces
+int SensorFile::editLen(int field) {
+  if (field == startIndexField || field == numReadingsField) {
+    return _fieldLen[field - startIndexField];
+  }
+  return (field < _loadedLen) ? _slotLen[field] : 0;
+}
+
+// Write the changes back, leaving every other byte as it was. Edits that keep their length are patched in place, a write of
+// a few bytes. From the first edit that changes length the rest of the file is rewritten, and a file that would shrink is
+// rewritten whole as it cannot be truncated. Ends the edit
+int SensorFile::save() {
+  if (!_loaded) {
+    return fileOperation;
+  }
+  // Order the edits as they appear in the file. Slots are in order, the header fields may be anywhere around them
+  uint8_t fields[MAX_SENSOR_READINGS + 2];
+  int numFields = 0;
+  int header[2] = { startIndexField, numReadingsField };
+  if (_fieldPos[1] < _fieldPos[0]) {
+    header[0] = numReadingsField;
+    header[1] = startIndexField;
+  }
+  int nextHeader = 0;
+  for (int slot = 0; slot < arrayLen; slot++) {
+    if (!(_changed[slot / 32] & (1UL << (slot % 32)))) {
+      continue;
+    }
+    while (nextHeader < 2 && editPos(header[nextHeader]) < editPos(slot)) {
+      fields[numFields++] = header[nextHeader++];
+    }
+    fields[numFields++] = slot;
+  }
+  while (nextHeader < 2) {
+    fields[numFields++] = header[nextHeader++];
+  }
+  char text[NUM_CHARS_JSON_NUMBER + 1];  // Room for an added slot's comma
+  int from = _textLen;  // Start of the rewritten tail, none while every edit keeps its length
+  int newLen = _textLen;
+  for (int i = 0; i < numFields; i++) {
+    int length = editText(fields[i], text);
+    if (length != editLen(fields[i]) && from == _textLen) {
+      from = editPos(fields[i]);
+    }
+    newLen += length - editLen(fields[i]);
+  }
+  bool shrinks = newLen < _textLen;
+  if (shrinks) {
+    from = 0;
+  }
+  blockCache.invalidate(_fileName);
+  File file = SD.open(_fileName, shrinks ? FILE_WRITE : "r+");
+  if (!file) {
+    return fileOperation;
+  }
+  bool writeOK = 1;
+  int i = 0;
+  for (; i < numFields && editPos(fields[i]) < from; i++) {  // Same length, only rewritten if different
+    int pos = editPos(fields[i]);
+    int length = editText(fields[i], text);
+    if (memcmp(&_text[pos], text, length) != 0) {
+      writeOK &= file.seek(pos) && file.write((uint8_t*)text, length) == (size_t)length;
+    }
+  }
+  if (from < _textLen) {
+    writeOK &= file.seek(from);
+    int copied = from;  // Loaded text before this has been written
+    for (; i < numFields; i++) {
+      int pos = editPos(fields[i]);
+      int length = editText(fields[i], text);
+      writeOK &= file.write((uint8_t*)&_text[copied], pos - copied) == (size_t)(pos - copied);
+      writeOK &= file.write((uint8_t*)text, length) == (size_t)length;
+      copied = pos + editLen(fields[i]);
+    }
+    writeOK &= file.write((uint8_t*)&_text[copied], _textLen - copied) == (size_t)(_textLen - copied);
+  }
+  file.close();
+  free(_text);
+  _text = NULL;
+  _loaded = 0;
+  return writeOK ? noError : fileOperation;
 }
 
 /*-------------------------------------------------------------- Header Class --------------------------------------------------------------*/
@@ -570,15 +1972,19 @@ Header::Header()
   tempThreshold = 0;
   waterThreshold = 0;
   humidityThreshold = 0;
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    samplePeriodM[i] = DEFAULT_SAMPLING_PERIOD_M;
+  }
+  useDerivedMetrics = 0;
+  logID = 0;
+  logApplied = 0;
 }
 
 /*------------------------------------------------------------------- Error Class ------------------------------------------------------------------*/
 
 // Initialization
 Error::Error()
-  : _errorList{}, highestPriority{}, _flashCt{}, _indicatorOn{}, _startTime{} {
-  _flashDuration = 100;
-}
+  : _errorList{}, highestPriority{}, _flashCt{}, _ledcReady{}, _indicatorOn{}, _startTime{} {}
 
 // Check for presence of a specific error
 int Error::getError(int errorStatus) {
@@ -599,7 +2005,7 @@ void Error::addError(int errorStatus) {
 void Error::clearError(int errorStatus) {
   _errorList[errorStatus] = noError;
   highestPriority = 0;
-  for (int i = errorStatus; i > 0; i--) {
+  for (int i = SDInit; i > 0; i--) {
     if (_errorList[i]) {
       highestPriority = _errorList[i];
       return;
@@ -607,42 +2013,78 @@ void Error::clearError(int errorStatus) {
   }
 }
 
-// Flash the indicator LED a number of times equal to the highest priority error code
-void Error::indicateError() {
+// Check for an error that prevents sensing. A missing display or light/temperature sensor only degrades operation
+bool Error::getCriticalError() {
+  for (int i = 1; i <= SDInit; i++) {
+    if (_errorList[i] && i != displayInit && i != lightSensorInit && i != tempSensorInit) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Flash the indicator LED a number of times equal to the highest priority error code.
+// The flashes are generated by an LEDC channel clocked from the RTC 8 MHz oscillator, which keeps running in light sleep,
+// so the CPU only has to step in to start and stop each sequence. Returns the time in ms until it next needs to be called
+unsigned long Error::indicateError() {
   if (highestPriority == noError) {
-    digitalWrite(ERROR_IND_PIN, LOW);
+    if (_ledcReady) {
+      ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
+    } else {
+      digitalWrite(ERROR_IND_PIN, LOW);
+    }
     _indicatorOn = 0;
-    return;
+    return 0;
+  }
+  if (!_ledcReady) {
+    ledc_timer_config_t timerConfig = {};
+    timerConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+    timerConfig.duty_resolution = LEDC_TIMER_13_BIT;  // Lowest resolution that lets the 8 MHz clock divide down to 1 Hz
+    timerConfig.timer_num = LEDC_TIMER_0;
+    timerConfig.freq_hz = 1000 / ERROR_FLASH_PERIOD_MS;
+    timerConfig.clk_cfg = LEDC_USE_RTC8M_CLK;
+    ledc_timer_config(&timerConfig);
+    ledc_channel_config_t channelConfig = {};
+    channelConfig.gpio_num = ERROR_IND_PIN;
+    channelConfig.speed_mode = LEDC_LOW_SPEED_MODE;
+    channelConfig.channel = LEDC_CHANNEL_0;
+    channelConfig.intr_type = LEDC_INTR_DISABLE;
+    channelConfig.timer_sel = LEDC_TIMER_0;
+    channelConfig.duty = 0;
+    channelConfig.hpoint = 0;
+    ledc_channel_config(&channelConfig);
+    esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON);  // Keep the LEDC clock alive in light sleep
+    _ledcReady = 1;
+    _startTime = millis() - ERROR_PAUSE_MS;  // Start the first sequence right away
   }
   unsigned long currentTime = millis();
-  if (_flashCt < highestPriority) {
-    if (!_indicatorOn && currentTime - _startTime >= 600) {
-      digitalWrite(ERROR_IND_PIN, HIGH);
-      _startTime = currentTime;
-      _indicatorOn = 1;
-    } else if (_indicatorOn && currentTime - _startTime >= 600) {
-      digitalWrite(ERROR_IND_PIN, LOW);
-      _startTime = currentTime;
-      _flashCt++;
-      _indicatorOn = 0;
-    }
-  } else {
-    if (currentTime - _startTime >= 3000) {
-      _startTime = currentTime;
-      _flashCt = 0;
-    }
+  if (!_indicatorOn && currentTime - _startTime >= ERROR_PAUSE_MS) {  // Start a sequence: 50% duty, LED on for the first half of each period
+    _flashCt = highestPriority;
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 1 << (LEDC_TIMER_13_BIT - 1));
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0);
+    ledc_timer_rst(LEDC_LOW_SPEED_MODE, LEDC_TIMER_0);
+    _indicatorOn = 1;
+    _startTime = currentTime;
+  } else if (_indicatorOn && currentTime - _startTime >= (unsigned long)_flashCt * ERROR_FLASH_PERIOD_MS) {  // Stop in the dark half of the last period
+    ledc_stop(LEDC_LOW_SPEED_MODE, LEDC_CHANNEL_0, 0);
+    _indicatorOn = 0;
+    _startTime = currentTime;
   }
+  unsigned long phaseLength = _indicatorOn ? (unsigned long)_flashCt * ERROR_FLASH_PERIOD_MS : ERROR_PAUSE_MS;
+  unsigned long elapsed = millis() - _startTime;
+  return (elapsed < phaseLength) ? phaseLength - elapsed : 0;
 }
 
 /*----------------------------------------------------------------- Interface Class ----------------------------------------------------------------*/
 
 // Initialization
 Interface::Interface()
-  : activeMenu{}, selectedPlantIndex{} {}
+  : activeMenu{}, selectedPlantIndex{}, displayReady{}, quantileView{} {}
 
 // Initialize the display
 bool Interface::begin(uint8_t vcs, uint8_t addr) {
-  return display.begin(vcs, addr);
+  displayReady = display.begin(vcs, addr);
+  return displayReady;
 }
 
 // Return a character to represent a threshold evaluation
@@ -660,21 +2102,56 @@ char Interface::getEvalIndicator(int eval) {
   return '?';
 }
 
-// Build and display the main menu
+// Build and display the main menu. Shows each average with its evaluation and the share of readings within the plant's band,
+// or the P10/P50/P90 of each channel when quantileView is set. The next-watering forecast goes below when there is one.
+// DLI & VPD rows have no distribution of their own, so they show no share and the quantile view keeps the lux & RH rows
 void Interface::displayMainMenu(Plant activePlant) {
   display.clearDisplay();
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 0);
   display.println(activePlant.commonName);
-  display.setCursor(0, 10);
-  display.printf("Water lvl %.0f %c", activePlant.avgWater, getEvalIndicator(activePlant.waterEval));
-  display.setCursor(0, 20);
-  display.printf("Light lvl %.0f %c", activePlant.avgLight, getEvalIndicator(activePlant.lightEval));
-  display.setCursor(0, 30);
-  display.printf("Temp lvl %.0f %c", activePlant.avgTemp, getEvalIndicator(activePlant.tempEval));
-  display.setCursor(0, 40);
-  display.printf("RH lvl %.0f %c", activePlant.avgHumidity, getEvalIndicator(activePlant.humidityEval));
+  const char* statLabels[NUM_CHANNELS] = { "Light", "Water", "RH", "Temp" };  // Ordered by FileTypes, for the recorded readings
+  const char* labels[NUM_CHANNELS] = { "Light", "Water", "RH", "Temp" };
+  float averages[NUM_CHANNELS] = { activePlant.avgLight, activePlant.avgWater, activePlant.avgHumidity, activePlant.avgTemp };
+  int evals[NUM_CHANNELS] = { activePlant.lightEval, activePlant.waterEval, activePlant.humidityEval, activePlant.tempEval };
+  int inRange[NUM_CHANNELS] = { activePlant.lightInRange, activePlant.waterInRange, activePlant.humidityInRange, activePlant.tempInRange };
+  int decimals[NUM_CHANNELS] = { 0 };
+  if (activePlant.useDerivedMetrics && activePlant.derived.dliDays > 0) {  // Show the values the evaluations are based on
+    labels[lightFile] = "DLI";
+    averages[lightFile] = activePlant.derived.dli;
+    decimals[lightFile] = 1;
+    inRange[lightFile] = -1;  // The share is of lux readings
+  }
+  if (activePlant.useDerivedMetrics && activePlant.derived.lastVPDTime != 0) {
+    labels[humidityFile] = "VPD";
+    averages[humidityFile] = activePlant.derived.avgVPD;
+    decimals[humidityFile] = 2;
+    inRange[humidityFile] = -1;  // The share is of RH readings
+  }
+  int order[NUM_CHANNELS] = { waterFile, lightFile, tempFile, humidityFile };  // Display order
+  for (int row = 0; row < NUM_CHANNELS; row++) {
+    int i = order[row];
+    display.setCursor(0, 10 + 10 * row);
+    if (quantileView) {
+      display.printf("%s %.0f/%.0f/%.0f", statLabels[i], activePlant.stats[i].getQuantile(10),
+                     activePlant.stats[i].getQuantile(50), activePlant.stats[i].getQuantile(90));
+    } else if (inRange[i] >= 0) {
+      display.printf("%s %.*f %c %i%%", labels[i], decimals[i], averages[i], getEvalIndicator(evals[i]), inRange[i]);
+    } else {
+      display.printf("%s %.*f %c", labels[i], decimals[i], averages[i], getEvalIndicator(evals[i]));
+    }
+  }
+  if (!quantileView && !isnan(activePlant.hoursToWater)) {
+    display.setCursor(0, 10 + 10 * NUM_CHANNELS);
+    if (activePlant.hoursToWater < 0.5) {
+      display.print("Water now");
+    } else if (activePlant.hoursToWater < 48) {
+      display.printf("Water in ~%.0fh", activePlant.hoursToWater);
+    } else {
+      display.printf("Water in ~%.0fd", activePlant.hoursToWater / 24);
+    }
+  }
   display.display();
   activeMenu = mainMenu;
 }
@@ -695,18 +2172,23 @@ void Interface::displayInfoMenu(Plant activePlant) {
 }
 
 // Build and display the plant selection menu
-void Interface::displaySelectMenu(char plantName[]) {
+void Interface::displaySelectMenu(DBPlant plant) {
   display.clearDisplay();
   display.setTextSize(2);
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 20);
-  display.println(plantName);
+  display.println(plant.commonName);
+  if (plant.score >= 0) {
+    display.setTextSize(1);
+    display.setCursor(0, 56);
+    display.printf("#%i  %i%% fit", selectedPlantIndex + 1, plant.score);
+  }
   display.display();
   activeMenu = selectMenu;
 }
 
 // Cycle through available screens
-void Interface::nextScreen(Plant activePlant, char plantName[]) {
+void Interface::nextScreen(Plant activePlant, DBPlant selectedPlant) {
   activeMenu = (activeMenu + 1) % (NUM_MENUS + 1);
   activeMenu = activeMenu == 0 ? 1 : activeMenu;
   switch (activeMenu) {
@@ -720,7 +2202,7 @@ void Interface::nextScreen(Plant activePlant, char plantName[]) {
       displayInfoMenu(activePlant);
       break;
     case selectMenu:
-      displaySelectMenu(plantName);
+      displaySelectMenu(selectedPlant);
       break;
   }
 }
@@ -728,6 +2210,9 @@ void Interface::nextScreen(Plant activePlant, char plantName[]) {
 // Set all pixels to 0 and send a display off command
 void Interface::displayOff() {
   activeMenu = 0;
+  if (!displayReady) {
+    return;  // Never started this wake (timer wake or missing display)
+  }
   display.clearDisplay();
   display.display();
   display.ssd1306_command(SSD1306_DISPLAYOFF);
@@ -738,7 +2223,7 @@ void Interface::displayOff() {
 // Returns a JsonDocument contianing the deserialized file contents
 JsonDocument readSDFile(char fileName[]) {
   JsonDocument doc;
-  File file = SD.open(fileName, FILE_READ);
+  CachedFile file(fileName);
   if (!file) {
     return doc;
   }
@@ -753,6 +2238,7 @@ int pushJsonDoc(JsonDocument doc, char fileName[MAX_CHARS_FILENAME]) {
   if (!SD.exists(fileName)) {
     return fileOperation;
   }
+  blockCache.invalidate(fileName);
   File file = SD.open(fileName, FILE_WRITE);
   if (!file) {
     return fileOperation;
@@ -765,10 +2251,14 @@ int pushJsonDoc(JsonDocument doc, char fileName[MAX_CHARS_FILENAME]) {
 // Fills a pre-allocated buffer with a date string matching ISO 8601, millseconds excluded
 void getTimeStr(char* buffer) {
   time_t now;
-  struct tm timeInfo;
-
   time(&now);
-  localtime_r(&now, &timeInfo);
+  formatTimeStr(buffer, now);
+}
+
+// Fills a pre-allocated buffer with the date string of a given time
+void formatTimeStr(char* buffer, time_t when) {
+  struct tm timeInfo;
+  localtime_r(&when, &timeInfo);
 
   snprintf(buffer, NUM_CHARS_TIMESTAMP, "%d-%02d-%02d %02d:%02d:%02d",
            timeInfo.tm_year + 1900, timeInfo.tm_mon + 1, timeInfo.tm_mday,
@@ -6,10 +6,15 @@
 #include <ArduinoJson.h>
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
+#include <SD.h>
+#include "PlantSaverModels.h"
+#include "Uplink.h"
 
 /*------------------------------------------------------------ Macros ------------------------------------------------------------*/
 
-#define ERROR_IND_PIN 4  // Error indication LED
+#define ERROR_IND_PIN 4            // Error indication LED
+#define ERROR_FLASH_PERIOD_MS 1000  // One indicator flash per LEDC period, LEDC cannot run slower than 1 Hz
+#define ERROR_PAUSE_MS 3000         // Dark time between flash sequences
 
 #define NUM_MENUS 3
 #define SCREEN_WIDTH 128  // OLED display width, in pixels
@@ -22,6 +27,30 @@
 #define NUM_CHARS_NAME 50
 #define NUM_CHARS_FACT 100
 #define NUM_DB_FILES 2
+#define NUM_CHANNELS 4        // Light, water, humidity & temperature
+#define TIMESTAMP_LEN 19      // Characters in a formatted timestamp, terminator excluded
+#define DATE_LINE_LEN 23      // Timestamp + ',' + channel mask hex digit + CRLF, every line in a dates file is this wide
+#define OLD_DATE_LINE_LEN 21  // Lines written before channel masks were added, timestamp + CRLF
+#define ALL_CHANNELS_MASK 0xF
+#define DEFAULT_SAMPLING_PERIOD_M 1  // Sampling period of channels without one set in the header
+#define MAX_CHARS_COMMAND 64  // Longest serial command accepted
+#define LUX_TO_PPFD 0.0185        // umol/m^2/s of PAR per lux of sunlight
+#define GDD_BASE_TEMP_F 50        // Growing degree-day base temperature
+#define MAX_METRIC_GAP_S 7200     // Longer gaps between samples are not integrated across
+#define DLI_MIN_COVERAGE 0.9      // Fraction of a day that must be integrated for its DLI to count
+#define DLI_AVG_DAYS 7            // Daily light integrals are averaged over about this many days
+#define SECONDS_PER_DAY 86400
+#define MAX_EVENTS 50                 // Events kept in each plant's event log
+#define SECTOR_SIZE 512               // SD card block size
+#define LOG_RECORD_SIZE 32            // Bytes per sensor log record, a whole number of records fills each sector
+#define LOG_RECORDS_PER_SECTOR (SECTOR_SIZE / LOG_RECORD_SIZE)
+#define LOG_RECORDS 1024              // Records held in each plant's sensor log before it wraps, 32 KiB
+#define LOG_CHECKPOINT_RECORDS 16     // Logged readings folded into the storage files at once
+#define CACHE_BLOCK_SIZE 512             // Bytes per block of the read cache
+#define CACHE_MIN_BLOCKS 2               // Blocks available before begin(), enough for the two files a range query reads at once
+#define CACHE_MAX_FILES 8                // Files whose names & sizes are remembered, saving an SD.open() per cached read
+#define READ_CACHE_BUDGET_BYTES 16384    // RAM given to the read cache during display sessions
+#define LIGHT_CONVERSION_SLACK_MS 5      // Allowance on top of the nominal conversion time before reading anyway
 
 /*------------------------------------------------------- Class Definitions -------------------------------------------------------*/
 
@@ -36,13 +65,177 @@ public:
   int waterReq[2];
   char scientificName[NUM_CHARS_NAME];
   char fact[NUM_CHARS_FACT];
+  int score;  // Percent fit to the measured environment, -1 if not ranked
+};
+
+// Data associated with an instanced multi-sensor reading
+class SensorReading {
+public:
+  SensorReading();
+  float getReading(int channel);
+  float tempReading;
+  float waterReading;
+  float humidityReading;
+  float lightReading;
+  int plantID;  // Self ID of the associated user plant - might be able to remove this since all are associated with a datagroup
+  int channelMask;  // Channels taken in this reading, one bit per FileTypes entry
+  char timeStamp[NUM_CHARS_TIMESTAMP];
+  unsigned long time;  // timeStamp in seconds since the epoch
+};
+
+// One reading as stored in the sensor log, exactly LOG_RECORD_SIZE bytes
+struct LogRecord {
+  uint32_t logID;  // Log the record was written to, records left over from an earlier log never match
+  uint32_t seq;    // Sequence number within the log, starting at 1
+  uint32_t time;   // Seconds since the epoch
+  uint8_t channelMask;
+  uint8_t reserved[3];
+  float readings[NUM_CHANNELS];  // Indexed by FileTypes
+};
+
+// Circular log of sensor readings in a file preallocated as one contiguous extent. Records are written straight to the
+// card's sectors, so an append costs a single sector write and never touches the FAT or the directory entry
+class SensorLog {
+public:
+  SensorLog();
+  bool create(uint32_t newLogID);
+  bool open(uint32_t existingLogID);
+  void resume(uint32_t existingLogID, uint32_t sector, uint32_t seq);
+  bool append(SensorReading reading);
+  bool read(uint32_t seq, LogRecord &record);
+  bool ready;
+  uint32_t logID;
+  uint32_t baseSector;  // First sector of the extent
+  uint32_t nextSeq;     // Sequence number the next record is written with
+  uint32_t lastTime;    // Time of the newest record open() found, 0 if none
+private:
+  bool locate(bool preallocate);
+  bool loadSector(uint32_t sector);
+  bool verify();
+  uint8_t _sector[SECTOR_SIZE];  // Last sector read or written, records are packed into it before it is written back
+  uint32_t _loadedSector;
+  bool _sectorLoaded;
+  bool _verified;  // The position is known to match the card, false after resume() until the first append checks it
+};
+
+// Position of one block in the read cache
+struct CacheSlot {
+  uint32_t fileKey;   // File the block belongs to, 0 if the slot is free
+  uint32_t index;     // Block number within the file
+  uint32_t lastUsed;  // Access tick, the lowest is evicted first
+  uint16_t length;    // Bytes held, short only for the last block of a file
+};
+
+// LRU cache of file blocks between the firmware's file reads and the SD library. Files are identified by a key that
+// changes whenever the file is written, so blocks of a file written since are never served
+class BlockCache {
+public:
+  BlockCache();
+  bool begin(size_t budgetBytes);
+  uint32_t openFile(const char* fileName, uint32_t &size);
+  int getBlock(uint32_t fileKey, uint32_t index);
+  bool holds(int slot, uint32_t fileKey, uint32_t index);
+  const uint8_t* blockData(int slot);
+  int blockLength(int slot);
+  void invalidate(const char* fileName);
+  unsigned long hits;    // Blocks served from RAM
+  unsigned long misses;  // Blocks read from the card
+  int numBlocks;
+private:
+  int fileIndex(uint32_t fileKey);
+  CacheSlot _minSlots[CACHE_MIN_BLOCKS];  // Used until begin() allocates the budget
+  uint8_t _minData[CACHE_MIN_BLOCKS * CACHE_BLOCK_SIZE];
+  CacheSlot* _slots;
+  uint8_t* _data;
+  char _fileNames[CACHE_MAX_FILES][MAX_CHARS_FILENAME];
+  uint32_t _fileKeys[CACHE_MAX_FILES];  // 0 if the entry is free
+  uint32_t _fileSizes[CACHE_MAX_FILES];
+  uint32_t _fileUsed[CACHE_MAX_FILES];
+  uint32_t _nextKey;
+  uint32_t _tick;
+  File _file;  // Handle of the file last read from the card, kept open for its next miss
+  uint32_t _openKey;
+};
+
+// Read-only file served through the block cache. Supports the Stream reads, seek() and position() the firmware uses
+class CachedFile : public Stream {
+public:
+  CachedFile(const char* fileName);
+  operator bool() const;
+  int available();
+  int read();
+  int peek();
+  size_t write(uint8_t c);
+  bool seek(uint32_t pos);
+  size_t position();
+  size_t size();
+  void close();
+private:
+  uint32_t _key;
+  uint32_t _size;
+  uint32_t _pos;
+  int _slot;  // Cache slot last read from, re-fetched if it has been reused since
+};
+
+// One channel's sensor file, {"startIndex":..,"numReadings":..,"readings":[..]}, handled without a JsonDocument. Values are parsed
+// straight into a float buffer, and save() rewrites only the fields and slots that changed, formatted as serializeJson() would.
+// Load, add readings, then save once; the file text is held until then
+class SensorFile {
+public:
+  SensorFile();
+  ~SensorFile();
+  int load(char fileName[]);
+  void add(float reading);
+  int save();
+  int startIndex;
+  int numReadings;
+  int arrayLen;                         // Entries in the readings array, numReadings until the buffer wraps
+  float readings[MAX_SENSOR_READINGS];  // Stored nulls are NAN
+private:
+  int editText(int field, char buffer[]);
+  int editPos(int field);
+  int editLen(int field);
+  char _fileName[MAX_CHARS_FILENAME];
+  char* _text;  // File contents as loaded
+  int _textLen;
+  int _fieldPos[2];  // Values of startIndex & numReadings in _text
+  int _fieldLen[2];
+  uint16_t _slotPos[MAX_SENSOR_READINGS];  // Value of each loaded slot in _text
+  uint8_t _slotLen[MAX_SENSOR_READINGS];
+  int _closePos;   // The readings array's ']', where added slots go
+  int _loadedLen;  // arrayLen as loaded
+  bool _loaded;
+  uint32_t _changed[(MAX_SENSOR_READINGS + 31) / 32];  // Slots written since load
+};
+
+// Daily Light Integral, vapor pressure deficit and growing degree-days, each updated in a few operations per sample.
+// Light and temperature are integrated with the trapezoidal rule over the time since the previous sample
+class DerivedMetrics {
+public:
+  DerivedMetrics();
+  void add(SensorReading reading, unsigned long now);
+  float dli;                    // Average DLI of recent complete days, mol/m^2/day
+  float dliToday;               // Light integrated so far today, mol/m^2
+  int dliDays;                  // Complete days folded into dli
+  unsigned long lightCoveredS;  // Seconds of today that have been integrated
+  float lastPPFD;
+  unsigned long lastLightTime;
+  float vpd;     // Latest vapor pressure deficit, kPa
+  float avgVPD;  // VPD averaged over about a day
+  unsigned long lastVPDTime;
+  float gdd;  // Degree-days F above GDD_BASE_TEMP_F since the plant was created
+  float lastTempF;
+  unsigned long lastTempTime;
+  float lastHumidity;
+private:
+  void closeDay();
 };
 
 // Data of plants actively being monitored
 class Plant {
 public:
   Plant();
-  float getAvgReading(JsonDocument sensorDoc);
+  float getAvgReading(SensorFile &sensorFile);
   void checkThresholds();
   int selfID;  // User Plant DB ID (1-5)
   int baseID;  // ID within the larger plant database
@@ -52,15 +245,27 @@ public:
   int lightReq[2];
   int waterReq[2];
   int hardiness[2];
+  // Aggregates of the environment history, stored in /env/env.txt and kept when the plant changes:
   float avgLight;
   float avgWater;
   float avgHumidity;
   float avgTemp;
+  ChannelStats stats[NUM_CHANNELS];  // Indexed by FileTypes
+  ChangeDetector waterDetector;      // Soil moisture ADC counts
+  ChangeDetector lightDetector;      // log10 of lux, so steps are judged relative to the light level
+  DryingForecast waterForecast;      // Soil moisture ADC counts, restarted at each watering
+  DerivedMetrics derived;
   // These variables ARE NOT stored:
+  bool useDerivedMetrics;  // Judge light by DLI and humidity by VPD, set from the header
   int lightEval;
   int waterEval;
   int humidityEval;
   int tempEval;
+  int lightInRange;  // Percent of readings within the plant's band, -1 if unknown
+  int waterInRange;
+  int humidityInRange;
+  int tempInRange;
+  float hoursToWater;  // Forecast time until the soil reaches the plant's dry bound, NAN if unknown
 private:
   void tempCheck();
   void waterCheck();
@@ -68,16 +273,16 @@ private:
   void humidityCheck();
 };
 
-// Data associated with an instanced multi-sensor reading
-class SensorReading {
+
+// Count/min/max/mean of the readings of one channel within a time range
+class RangeStats {
 public:
-  SensorReading();
-  float tempReading;
-  float waterReading;
-  float humidityReading;
-  float lightReading;
-  int plantID;  // Self ID of the associated user plant - might be able to remove this since all are associated with a datagroup
-  char timeStamp[NUM_CHARS_TIMESTAMP];
+  RangeStats();
+  void add(float reading);
+  int count;
+  float min;
+  float max;
+  float mean;
 };
 
 // Class for storing/retrieving header file data
@@ -91,6 +296,10 @@ public:
   int tempThreshold;
   int waterThreshold;
   int humidityThreshold;
+  int samplePeriodM[NUM_CHANNELS];  // Sampling period of each channel in minutes, indexed by FileTypes
+  bool useDerivedMetrics;           // Evaluate light by DLI and humidity by VPD instead of averages
+  unsigned long logID;              // Sensor log of the active plant, 0 if it has none
+  unsigned long logApplied;         // Sequence number of the last log record folded into the storage files
 };
 
 // Class to store/manipulate/report system errors
@@ -100,12 +309,13 @@ public:
   int getError(int errorStatus);
   void clearError(int errorStatus);
   void addError(int errorStatus);
-  void indicateError();
+  bool getCriticalError();
+  unsigned long indicateError();
   int highestPriority;
 private:
   int _errorList[8];
   int _flashCt;
-  int _flashDuration;
+  bool _ledcReady;
   bool _indicatorOn;
   unsigned long _startTime;
 };
@@ -118,50 +328,70 @@ public:
   char getEvalIndicator(int eval);
   void displayMainMenu(Plant activePlant);
   void displayInfoMenu(Plant activePlant);
-  void displaySelectMenu(char plantName[]);
-  void nextScreen(Plant activePlant, char plantName[]);
+  void displaySelectMenu(DBPlant plant);
+  void nextScreen(Plant activePlant, DBPlant selectedPlant);
   void displayOff();
   int selectedPlantIndex;
   int activeMenu;
+  bool displayReady;  // begin() has succeeded this wake
+  bool quantileView;  // Main menu shows P10/P50/P90 instead of averages
 };
 
 // Class to store/pass around multiple objects between functions
 class Container {
 public:
   Container();
-  void updatePlantData();
+  void updatePlantData(SensorReading readings[], int numReadings);
   void pullHeader();
   void pushHeader();
   void pullPlant();
   void pushPlant();
+  void pullEnvironment();
+  void pushEnvironment();
   void getDBPlants();
   void newUserPlant(int newSelfID);
-  void addTimeStamp();
+  void addTimeStamp(SensorReading readings[], int numNew);
   void clearSensorData();
+  int queryRange(char startTime[], char endTime[], RangeStats stats[]);
+  void detectEvents(SensorReading reading);
+  void recordReading(bool deferrable);
+  void checkpointLog();
   Plant activePlant;
   Error error;
   Header header;
   SensorReading sensorReading;
   Interface interface;
+  Uplink uplink;
+  SensorLog sensorLog;
   DBPlant plants[NUM_DISPLAY_PLANTS];
   int activeMode;
   bool plantPulled;
   bool dbPlantsPulled;
   bool headerPulled;
+  bool environmentPulled;
+  bool plantChanged;  // Profile differs from plant.txt
+  bool deferredWake;  // Reading only went to the sensor log, header & plant files are unchanged
+  bool logStarted;    // A new sensor log was started this wake, its logID is not in header.txt yet
 private:
-  JsonDocument addSensorReading(JsonDocument sensorDoc, float reading);
+  void startLog();
+  void migrateEnvironment();
+  int logEvent(int eventType, float from, float to, char timeStamp[]);
 };
 
 /*------------------------------------------------------- Standalone Helpers -------------------------------------------------------*/
 
+// Read cache shared by every file read
+extern BlockCache blockCache;
+
 // Standalone file reader
 JsonDocument readSDFile(char fileName[]);
 
 // Standalone file writer
 int pushJsonDoc(JsonDocument doc, char fileName[]);
 
-// Standalone time utility
+// Standalone time utilities
 void getTimeStr(char* buffer);
+void formatTimeStr(char* buffer, time_t when);
 
 // Standalone timekeeping utility
 bool setTimeFromTimeStr(char timeStr[]);
@@ -174,6 +404,7 @@ enum StateTracker {
   displayMode,
   sensingMode,
   triggerMode,
+  uplinkMode,
   shutdownMode,
   errorMode
 };
@@ -199,15 +430,6 @@ enum ErrorStatus {
   SDInit
 };
 
-// For iterating through multiple files
-enum FileTypes {
-  lightFile,
-  waterFile,
-  humidityFile,
-  tempFile,
-  datesFile
-};
-
 // For iterating/checking threshold evaluations
 enum Eval {
   evalUnknown,
@@ -216,19 +438,11 @@ enum Eval {
   evalOK
 };
 
-// For checking light requirements
-enum LightValues {
-  fullShade = 1,
-  partialSun = 2,
-  fullSun = 3
-};
-
-// For checking water requirements
-enum waterValues {
-  water = 1,
-  wet = 2,
-  moist = 3,
-  dry = 4
+// For tagging entries in the event log
+enum EventType {
+  wateringEvent,
+  lightsOnEvent,
+  lightsOffEvent
 };
 
 #endif
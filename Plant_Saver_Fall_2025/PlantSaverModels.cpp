@@ -0,0 +1,690 @@
+#include "PlantSaverModels.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/*-------------------------------------------------------- Channel Stats Class --------------------------------------------------------*/
+
+// Every distinct band edge produced by the threshold mappings, per channel and in ascending order.
+// Bin 2i+1 of a histogram counts readings equal to edge i and bin 2i those between edge i-1 and edge i, so any band maps onto
+// a run of whole bins that includes both of its edges, as the threshold checks do
+static const int lightEdges[] = { 0, 1075, 10750, 1010749 };
+static const int waterEdges[] = { 0, 1000, 1650, 2300, 4095 };
+static const int humidityEdges[] = { 30, 60 };
+static const int tempEdges[] = { 26, 30, 32, 36, 39, 43, 45, 48, 50, 54, 57, 61, 64, 68, 72, 75, 79, 80, 100 };
+
+// Point edges at the band edge table of a channel, return the number of edges
+static int getBandEdges(int channel, const int** edges) {
+  switch (channel) {
+    case lightFile:
+      *edges = lightEdges;
+      return sizeof(lightEdges) / sizeof(int);
+    case waterFile:
+      *edges = waterEdges;
+      return sizeof(waterEdges) / sizeof(int);
+    case humidityFile:
+      *edges = humidityEdges;
+      return sizeof(humidityEdges) / sizeof(int);
+    case tempFile:
+      *edges = tempEdges;
+      return sizeof(tempEdges) / sizeof(int);
+  }
+  *edges = NULL;
+  return 0;
+}
+
+// Marker targets for P-square: min, P10/P50/P90, max
+static const float markerQuantiles[NUM_QUANTILE_MARKERS] = { 0, 0.1, 0.5, 0.9, 1 };
+
+// Initialization
+ChannelStats::ChannelStats()
+  : markers{}, positions{}, bins{} {
+  count = 0;
+}
+
+// Fold a new reading into the quantile markers and band histogram
+void ChannelStats::add(float reading, int channel) {
+  if (isnan(reading)) {
+    return;
+  }
+  const int* edges;
+  int numEdges = getBandEdges(channel, &edges);
+  int below = 0;  // Edges below the reading
+  while (below < numEdges && reading > edges[below]) {
+    below++;
+  }
+  int bin = 2 * below;
+  if (below < numEdges && reading == edges[below]) {
+    bin++;
+  }
+  if (bins[bin] == UINT8_MAX) {  // Halve all counts rather than overflow, percentages are unchanged
+    for (int i = 0; i <= 2 * numEdges; i++) {
+      bins[i] = bins[i] / 2;
+    }
+  }
+  bins[bin]++;
+
+  if (count < NUM_QUANTILE_MARKERS) {  // Collect the first readings as-is, then sort them into the initial markers
+    markers[count] = reading;
+    count++;
+    if (count == NUM_QUANTILE_MARKERS) {
+      for (int i = 1; i < NUM_QUANTILE_MARKERS; i++) {
+        for (int j = i; j > 0 && markers[j - 1] > markers[j]; j--) {
+          float tmp = markers[j];
+          markers[j] = markers[j - 1];
+          markers[j - 1] = tmp;
+        }
+      }
+      for (int i = 0; i < NUM_QUANTILE_MARKERS; i++) {
+        positions[i] = i + 1;
+      }
+    }
+    return;
+  }
+  // Find the cell the reading falls in, stretching the extremes if needed
+  int cell;
+  if (reading < markers[0]) {
+    markers[0] = reading;
+    cell = 0;
+  } else if (reading >= markers[NUM_QUANTILE_MARKERS - 1]) {
+    markers[NUM_QUANTILE_MARKERS - 1] = reading;
+    cell = NUM_QUANTILE_MARKERS - 2;
+  } else {
+    cell = 0;
+    while (reading >= markers[cell + 1]) {
+      cell++;
+    }
+  }
+  for (int i = cell + 1; i < NUM_QUANTILE_MARKERS; i++) {
+    positions[i]++;
+  }
+  count++;
+  // Nudge each interior marker toward its desired position, using a parabolic fit of its neighbours where it stays monotonic
+  for (int i = 1; i < NUM_QUANTILE_MARKERS - 1; i++) {
+    float desired = 1 + (count - 1) * markerQuantiles[i];
+    float offset = desired - positions[i];
+    long toNext = (long)positions[i + 1] - (long)positions[i];
+    long toPrev = (long)positions[i - 1] - (long)positions[i];
+    if ((offset >= 1 && toNext > 1) || (offset <= -1 && toPrev < -1)) {
+      int step = (offset > 0) ? 1 : -1;
+      float parabolic = markers[i] + (float)step / (float)(toNext - toPrev) * ((float)(-toPrev + step) * (markers[i + 1] - markers[i]) / (float)toNext + (float)(toNext - step) * (markers[i] - markers[i - 1]) / (float)(-toPrev));
+      if (markers[i - 1] < parabolic && parabolic < markers[i + 1]) {
+        markers[i] = parabolic;
+      } else {
+        long toStep = (step > 0) ? toNext : toPrev;
+        markers[i] = markers[i] + (float)step * (markers[i + step] - markers[i]) / (float)toStep;
+      }
+      positions[i] = positions[i] + step;
+    }
+  }
+}
+
+// Estimate the 10th, 50th or 90th percentile of all readings so far
+float ChannelStats::getQuantile(int percentile) {
+  if (count == 0) {
+    return 0;
+  }
+  if (count < NUM_QUANTILE_MARKERS) {  // Too few readings for the markers, use the exact order statistic
+    float sorted[NUM_QUANTILE_MARKERS];
+    memcpy(sorted, markers, sizeof(sorted));
+    for (int i = 1; i < (int)count; i++) {
+      for (int j = i; j > 0 && sorted[j - 1] > sorted[j]; j--) {
+        float tmp = sorted[j];
+        sorted[j] = sorted[j - 1];
+        sorted[j - 1] = tmp;
+      }
+    }
+    return sorted[(int)((count - 1) * percentile / 100.0 + 0.5)];
+  }
+  switch (percentile) {
+    case 10:
+      return markers[1];
+    case 50:
+      return markers[2];
+    case 90:
+      return markers[3];
+  }
+  return 0;
+}
+
+// Find the run of histogram bins [firstBin, endBin) covered by a band. Returns 0 if a threshold is not a band edge
+static bool getBandBins(int channel, int thresholds[2], int* firstBin, int* endBin) {
+  const int* edges;
+  int numEdges = getBandEdges(channel, &edges);
+  *firstBin = -1;
+  *endBin = -1;
+  for (int i = 0; i < numEdges; i++) {
+    if (edges[i] == thresholds[0]) {
+      *firstBin = 2 * i + 1;
+    }
+    if (edges[i] == thresholds[1]) {
+      *endBin = 2 * i + 2;
+    }
+  }
+  return *firstBin >= 0 && *endBin >= *firstBin;
+}
+
+// Percentage of readings falling within a band, -1 if nothing has been recorded or the band edges are unknown
+int ChannelStats::percentInRange(int channel, int thresholds[2]) {
+  int firstBin;
+  int endBin;
+  if (!getBandBins(channel, thresholds, &firstBin, &endBin)) {
+    return -1;
+  }
+  unsigned long total = 0;
+  unsigned long inRange = 0;
+  for (int i = 0; i < MAX_STAT_BINS; i++) {
+    total += bins[i];
+    if (i >= firstBin && i < endBin) {
+      inRange += bins[i];
+    }
+  }
+  if (total == 0) {
+    return -1;
+  }
+  return (int)((100 * inRange + total / 2) / total);
+}
+
+/*------------------------------------------------------ Requirement Block Class ------------------------------------------------------*/
+
+static const int rankedChannels[NUM_RANKED_CHANNELS] = { lightFile, waterFile, tempFile };  // Row order of the block arrays
+
+// Initialization
+RequirementBlock::RequirementBlock()
+  : firstBin{}, endBin{}, offsets{} {
+  size = 0;
+}
+
+// Map a plant's requirements onto bin ranges and append it to the block
+void RequirementBlock::add(int hardiness[2], int lightReq[2], int waterReq[2], unsigned long offset) {
+  for (int c = 0; c < NUM_RANKED_CHANNELS; c++) {
+    int thresholds[2] = { 0 };
+    bool known = 0;
+    switch (rankedChannels[c]) {
+      case lightFile:
+        known = getLightThresholds(lightReq, thresholds);
+        break;
+      case waterFile:
+        known = getWaterThresholds(waterReq, thresholds);
+        break;
+      case tempFile:
+        known = getTempThresholds(hardiness, thresholds);
+        break;
+    }
+    int first = 0;
+    int end = 0;
+    if (!known || !getBandBins(rankedChannels[c], thresholds, &first, &end)) {
+      first = 0;  // Unknown requirements contribute nothing to the score
+      end = 0;
+    }
+    firstBin[c][size] = first;
+    endBin[c][size] = end;
+  }
+  offsets[size] = offset;
+  size++;
+}
+
+// Score every plant in the block as the sum over channels of the fraction of readings inside its band (0 to NUM_RANKED_CHANNELS)
+void RequirementBlock::score(ChannelStats stats[], float scores[]) {
+  for (int i = 0; i < size; i++) {
+    scores[i] = 0;
+  }
+  for (int c = 0; c < NUM_RANKED_CHANNELS; c++) {
+    uint8_t* bins = stats[rankedChannels[c]].bins;
+    unsigned long total = 0;
+    for (int k = 0; k < MAX_STAT_BINS; k++) {
+      total += bins[k];
+    }
+    if (total == 0) {
+      continue;
+    }
+    float below[MAX_STAT_BINS + 1];  // Fraction of readings below each bin
+    below[0] = 0;
+    for (int k = 0; k < MAX_STAT_BINS; k++) {
+      below[k + 1] = below[k] + (float)bins[k] / (float)total;
+    }
+    const uint8_t* first = firstBin[c];
+    const uint8_t* end = endBin[c];
+    for (int i = 0; i < size; i++) {
+      scores[i] += below[end[i]] - below[first[i]];
+    }
+  }
+}
+
+/*--------------------------------------------------------- ChangeDetector Class ---------------------------------------------------------*/
+
+// Initialization
+ChangeDetector::ChangeDetector() {
+  baseline = 0;
+  upSum = 0;
+  downSum = 0;
+  shiftFrom = 0;
+  lastShift = 0;
+  settling = 0;
+  count = 0;
+}
+
+// Fold a new reading into the detector. Readings within drift of the baseline are treated as noise; larger deviations accumulate
+// until they exceed threshold. Returns 1 for an upward shift, -1 for a downward shift and 0 otherwise.
+// After a shift the baseline restarts at the new level and follows the readings until they turn back or stop moving the same
+// way for CUSUM_SETTLE_READINGS readings, so a step spread over several readings (water soaking in, a slow dawn) is reported once
+int ChangeDetector::add(float reading, float drift, float threshold) {
+  if (isnan(reading)) {
+    return 0;
+  }
+  if (count == 0) {
+    baseline = reading;
+    count = 1;
+    return 0;
+  }
+  float deviation = reading - baseline;
+  if (deviation * lastShift < -threshold) {  // Turned back, the step is over
+    settling = 0;
+  }
+  if (settling > 0) {  // Follow the step while it completes, without accumulating
+    if (deviation * lastShift > drift) {
+      baseline = reading;
+      settling = CUSUM_SETTLE_READINGS;
+    } else {
+      baseline = baseline + CUSUM_BASELINE_WEIGHT * deviation;
+      settling--;
+    }
+    count++;
+    return 0;
+  }
+  upSum = (upSum + deviation - drift > 0) ? upSum + deviation - drift : 0;
+  downSum = (downSum - deviation - drift > 0) ? downSum - deviation - drift : 0;
+  int shift = 0;
+  if (upSum > threshold) {
+    shift = 1;
+  } else if (downSum > threshold) {
+    shift = -1;
+  }
+  if (shift != 0) {
+    shiftFrom = baseline;
+    lastShift = shift;
+    settling = CUSUM_SETTLE_READINGS;
+    baseline = reading;
+    upSum = 0;
+    downSum = 0;
+    count = 1;
+    return shift;
+  }
+  baseline = baseline + CUSUM_BASELINE_WEIGHT * deviation;  // Let the baseline follow slow drift such as drying soil
+  count++;
+  return 0;
+}
+
+/*--------------------------------------------------------- DryingForecast Class ---------------------------------------------------------*/
+
+// Initialization
+DryingForecast::DryingForecast() {
+  weight = 0;
+  meanT = 0;
+  meanY = 0;
+  varT = 0;
+  covTY = 0;
+  rateWeight = 0;
+  meanLevel = 0;
+  meanRate = 0;
+  varLevel = 0;
+  covLR = 0;
+  startTime = 0;
+  lastTime = 0;
+  count = 0;
+}
+
+// Fold a soil reading into the local trend, discounting older readings by their age, then fold the trend into the rate fit.
+// The trend's slope is the rate at its weighted mean time, where its level is meanY. now is in seconds
+void DryingForecast::add(float reading, unsigned long now) {
+  if (isnan(reading)) {
+    return;
+  }
+  if (count == 0) {
+    startTime = now;
+    lastTime = now;
+  }
+  if (now < lastTime) {  // Clock set back, the fit would extrapolate from the wrong end
+    return;
+  }
+  float t = (now - startTime) / 3600.0;  // Hours keep the sums small enough for float precision
+  float decay = expf(-(float)(now - lastTime) / (FORECAST_MEMORY_H * 3600.0));
+  weight = weight * decay + 1;
+  float deltaT = t - meanT;
+  float deltaY = reading - meanY;
+  meanT += deltaT / weight;
+  meanY += deltaY / weight;
+  float carry = 1 - 1 / weight;  // Weighted Welford update of the co-moments
+  varT = varT * decay + carry * deltaT * deltaT;
+  covTY = covTY * decay + carry * deltaT * deltaY;
+  float hours = (now - lastTime) / 3600.0;
+  lastTime = now;
+  count++;
+  if (count < FORECAST_MIN_SAMPLES || varT <= 0 || hours <= 0) {
+    return;
+  }
+  float rate = covTY / varT;
+  rateWeight += hours;  // Weighted by time so the sampling period does not matter
+  float deltaLevel = meanY - meanLevel;
+  meanLevel += hours * deltaLevel / rateWeight;
+  float deltaRate = rate - meanRate;
+  meanRate += hours * deltaRate / rateWeight;
+  varLevel += hours * deltaLevel * (meanY - meanLevel);
+  covLR += hours * deltaLevel * (rate - meanRate);
+}
+
+// Hours from now until the soil reading reaches level, 0 if it already has. Extrapolates the exponential curve when the rate fit
+// shows drying slowing towards a dry level beyond level, and the local trend otherwise. NAN without a usable trend:
+// too few or too recent readings, a stale fit, soil that is not drying, or a crossing beyond FORECAST_MAX_H
+float DryingForecast::hoursUntil(float level, unsigned long now) {
+  if (count < FORECAST_MIN_SAMPLES || lastTime - startTime < FORECAST_MIN_SPAN_H * 3600UL || varT <= 0) {
+    return NAN;
+  }
+  if (now < lastTime || now - lastTime > FORECAST_MAX_AGE_H * 3600UL) {
+    return NAN;
+  }
+  float slope = covTY / varT;  // ADC counts per hour
+  float fitted = meanY + slope * ((lastTime - startTime) / 3600.0 - meanT);  // Trend value at the latest reading
+  if (fitted >= level) {
+    return 0;
+  }
+  if (slope <= 0) {
+    return NAN;
+  }
+  float hours = (level - fitted) / slope;
+  if (varLevel > 0 && covLR < 0) {
+    float decayRate = -covLR / varLevel;  // Per hour, rate = decayRate * (dryLevel - reading)
+    float dryLevel = meanLevel + meanRate / decayRate;
+    if (dryLevel > level) {
+      hours = logf((dryLevel - fitted) / (dryLevel - level)) / decayRate;
+    }
+  }
+  hours -= (now - lastTime) / 3600.0;
+  if (hours > FORECAST_MAX_H) {
+    return NAN;
+  }
+  return (hours > 0) ? hours : 0;
+}
+
+/*-------------------------------------------------------------- Ranking --------------------------------------------------------------*/
+
+// Insert a scored plant into the descending top list, ties keep database order
+void insertTopPlant(float score, unsigned long offset, float topScores[], unsigned long topOffsets[], int &numTop, int maxTop) {
+  if (numTop == maxTop && score <= topScores[numTop - 1]) {
+    return;
+  }
+  int i = (numTop < maxTop) ? numTop++ : numTop - 1;
+  for (; i > 0 && topScores[i - 1] < score; i--) {
+    topScores[i] = topScores[i - 1];
+    topOffsets[i] = topOffsets[i - 1];
+  }
+  topScores[i] = score;
+  topOffsets[i] = offset;
+}
+
+/*---------------------------------------------------------- Band Mapping ----------------------------------------------------------*/
+
+// Map light requirements to a band in lux. A single requirement (second value 0) maps to that band alone
+bool getLightThresholds(int lightReq[2], int thresholds[2]) {
+  int lightReqLowHigh[2] = { 0 };  // [0] = low value, [1] = high value
+  lightReqLowHigh[0] = lightReq[0];
+  lightReqLowHigh[1] = (lightReq[1] != 0) ? lightReq[1] : lightReq[0];
+  for (int i = 0; i < 2; i++) {
+    switch (lightReqLowHigh[i]) {
+      case fullShade:
+        thresholds[i] = 0 + 1075 * i;  // 0 to 1075 lux
+        break;
+      case partialSun:
+        thresholds[i] = 1075 + 9675 * i;  // 1075 to 10750 lux
+        break;
+      case fullSun:
+        thresholds[i] = 10750 + 999999 * i;  // 10750+ , top end is arbitrary
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// Map hardiness zones to a band in degrees F
+bool getTempThresholds(int hardiness[2], int thresholds[2]) {
+  int hardinessLowHigh[2];  // [0] = low value, [1] = high value
+  hardinessLowHigh[0] = hardiness[0];
+  hardinessLowHigh[1] = (hardiness[1] != 0) ? hardiness[1] : hardiness[0];
+  for (int i = 0; i < 2; i++) {
+    switch (hardinessLowHigh[i]) {
+      case 2:
+        thresholds[i] = 26 + 4 * i;
+        break;
+      case 3:
+        thresholds[i] = 32 + 4 * i;
+        break;
+      case 4:
+        thresholds[i] = 39 + 4 * i;
+        break;
+      case 5:
+        thresholds[i] = 45 + 3 * i;
+        break;
+      case 6:
+        thresholds[i] = 50 + 4 * i;
+        break;
+      case 7:
+        thresholds[i] = 54 + 3 * i;
+        break;
+      case 8:
+        thresholds[i] = 61 + 3 * i;
+        break;
+      case 9:
+        thresholds[i] = 64 + 4 * i;
+        break;
+      case 10:
+        thresholds[i] = 68 + 4 * i;
+        break;
+      case 11:
+        thresholds[i] = 75 + 4 * i;
+        break;
+      case 12:
+        thresholds[i] = 80 + 20 * i;
+        break;
+      case 13:
+        thresholds[i] = 80 + 20 * i;
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// Map water requirements to a band in soil sensor ADC counts
+bool getWaterThresholds(int waterReq[2], int thresholds[2]) {
+  int waterReqLowHigh[2];  // [0] = low value, [1] = high value
+  waterReqLowHigh[0] = waterReq[0];
+  waterReqLowHigh[1] = (waterReq[1] != 0) ? waterReq[1] : waterReq[0];
+  for (int i = 0; i < 2; i++) {
+    switch (waterReqLowHigh[i]) {
+      case water:
+        thresholds[i] = 0 + 1000 * i;  // 0 to 1000
+        break;
+      case wet:
+        thresholds[i] = 1000 + 650 * i;  // 1000 to 1650
+        break;
+      case moist:
+        thresholds[i] = 1650 + 650 * i;  // 1650 to 2300
+        break;
+      case dry:
+        thresholds[i] = 2300 + 1795 * i;  // 2300 to 4095 (max)
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// Humidity band is the same for every plant
+bool getHumidityThresholds(int thresholds[2]) {
+  thresholds[0] = 30;
+  thresholds[1] = 60;
+  return 1;
+}
+
+// Map light requirements to a band of Daily Light Integral in mol/m^2/day, following getLightThresholds()
+bool getDLIThresholds(int lightReq[2], float thresholds[2]) {
+  int lightReqLowHigh[2] = { 0 };  // [0] = low value, [1] = high value
+  lightReqLowHigh[0] = lightReq[0];
+  lightReqLowHigh[1] = (lightReq[1] != 0) ? lightReq[1] : lightReq[0];
+  for (int i = 0; i < 2; i++) {
+    switch (lightReqLowHigh[i]) {
+      case fullShade:
+        thresholds[i] = 0 + 6 * i;  // 0 to 6 mol/m^2/day
+        break;
+      case partialSun:
+        thresholds[i] = 6 + 6 * i;  // 6 to 12 mol/m^2/day
+        break;
+      case fullSun:
+        thresholds[i] = 12 + 53 * i;  // 12 to 65 mol/m^2/day, the most full summer sun delivers
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+// Comfortable band of vapor pressure deficit in kPa, for most plants
+bool getVPDThresholds(float thresholds[2]) {
+  thresholds[0] = 0.4;
+  thresholds[1] = 1.6;
+  return 1;
+}
+
+/*---------------------------------------------------------- Light Ranging ----------------------------------------------------------*/
+
+// LTR390 settings, indexed like ltr390_gain_t & ltr390_resolution_t
+static const float lightGains[] = { 1, 3, 6, 9, 18 };
+static const int lightBits[] = { 20, 19, 18, 17, 16, 13 };
+static const float lightIntegrations[] = { 4, 2, 1, 0.5, 0.25, 0.125 };  // Conversion time in units of 100 ms
+#define NUM_LIGHT_GAINS 5
+#define NUM_LIGHT_RESOLUTIONS 6
+#define LIGHT_WIDEST_GAIN 0        // Gain 1
+#define LIGHT_WIDEST_RESOLUTION 4  // 16-bit, the shortest conversion with the full range
+
+// Lux of one count at the given settings (datasheet: lux = 0.6 * counts / (gain * integration), W_FAC of 1 without a window)
+float getLuxPerCount(int gain, int resolution) {
+  return 0.6 / (lightGains[gain] * lightIntegrations[resolution]);
+}
+
+// Pick the LTR390 settings for an expected light level: the highest gain whose range covers headroom times the level,
+// at the shortest conversion whose steps are fine enough, about targetCounts of the level. Gain costs no time, so precision
+// is bought with it first. An unknown level (NAN) gets the widest range. The firmware passes LIGHT_HEADROOM & LIGHT_TARGET_COUNTS
+void chooseLightRange(float expectedLux, int &gain, int &resolution, float headroom, float targetCounts) {
+  gain = LIGHT_WIDEST_GAIN;
+  resolution = LIGHT_WIDEST_RESOLUTION;
+  if (isnan(expectedLux)) {
+    return;
+  }
+  float rangeLux = expectedLux * headroom;
+  float stepLux = (expectedLux / targetCounts > LIGHT_MIN_STEP_LUX) ? expectedLux / targetCounts : LIGHT_MIN_STEP_LUX;
+  for (int r = NUM_LIGHT_RESOLUTIONS - 1; r >= 0; r--) {  // Shortest conversion first
+    for (int g = NUM_LIGHT_GAINS - 1; g >= 0; g--) {
+      if (getLightFullScale(r) * getLuxPerCount(g, r) >= rangeLux) {
+        gain = g;
+        resolution = r;
+        if (getLuxPerCount(g, r) <= stepLux) {
+          return;
+        }
+        break;
+      }
+    }
+  }
+}
+
+// Largest count a conversion at the given resolution can return
+uint32_t getLightFullScale(int resolution) {
+  return (1UL << lightBits[resolution]) - 1;
+}
+
+// Convert a conversion result to lux using the settings it was taken with
+float getLux(uint32_t counts, int gain, int resolution) {
+  return counts * getLuxPerCount(gain, resolution);
+}
+
+// Whether a conversion result is too close to full scale to trust
+bool lightSaturated(uint32_t counts, int resolution) {
+  return counts >= LIGHT_SATURATION_FRACTION * getLightFullScale(resolution);
+}
+
+// Nominal time of one conversion in ms
+int getLightConversionMs(int resolution) {
+  return ceilf(lightIntegrations[resolution] * 100);
+}
+
+/*--------------------------------------------------------- Number Formatting ---------------------------------------------------------*/
+
+// Write a float as ArduinoJson 7 serializes one, so files keep the format serializeJson() gave them: six decimal places less
+// one per integral digit past the first, trailing zeros dropped, an exponent outside 1e-5 to 1e7, and null for NaN or infinity.
+// Ported from decomposeFloat() & normalize() of ArduinoJson 7.4.2, tools/json_float_golden checks it against that version
+int formatJsonFloat(float value, char buffer[]) {
+  static const double positivePowers[] = { 1e1, 1e2, 1e4, 1e8, 1e16, 1e32, 1e64, 1e128, 1e256 };
+  static const double negativePowers[] = { 1e-1, 1e-2, 1e-4, 1e-8, 1e-16, 1e-32, 1e-64, 1e-128, 1e-256 };
+  static const double negativePowersPlusOne[] = { 1e0, 1e-1, 1e-3, 1e-7, 1e-15, 1e-31, 1e-63, 1e-127, 1e-255 };
+  double number = value;  // ArduinoJson works in JsonFloat, a double
+  if (isnan(number) || isinf(number)) {
+    return snprintf(buffer, NUM_CHARS_JSON_NUMBER, "null");
+  }
+  int length = 0;
+  if (number < 0) {
+    buffer[length++] = '-';
+    number = -number;
+  }
+  int exponent = 0;
+  if (number >= 1e7) {
+    for (int i = 8; i >= 0; i--) {
+      if (number >= positivePowers[i]) {
+        number *= negativePowers[i];
+        exponent += 1 << i;
+      }
+    }
+  }
+  if (number > 0 && number <= 1e-5) {
+    for (int i = 8; i >= 0; i--) {
+      if (number < negativePowersPlusOne[i]) {
+        number *= positivePowers[i];
+        exponent -= 1 << i;
+      }
+    }
+  }
+  uint32_t integral = (uint32_t)number;
+  uint32_t maxDecimalPart = 1000000;
+  int decimalPlaces = 6;
+  for (uint32_t tmp = integral; tmp >= 10; tmp /= 10) {
+    maxDecimalPart /= 10;
+    decimalPlaces--;
+  }
+  double remainder = (number - integral) * maxDecimalPart;
+  uint32_t decimal = (uint32_t)remainder;
+  remainder -= decimal;
+  decimal += (uint32_t)(remainder * 2);  // Round half up
+  if (decimal >= maxDecimalPart) {
+    decimal = 0;
+    integral++;
+    if (exponent && integral >= 10) {
+      exponent++;
+      integral = 1;
+    }
+  }
+  while (decimal % 10 == 0 && decimalPlaces > 0) {
+    decimal /= 10;
+    decimalPlaces--;
+  }
+  length += snprintf(&buffer[length], NUM_CHARS_JSON_NUMBER - length, "%lu", (unsigned long)integral);
+  if (decimalPlaces > 0) {
+    length += snprintf(&buffer[length], NUM_CHARS_JSON_NUMBER - length, ".%0*lu", decimalPlaces, (unsigned long)decimal);
+  }
+  if (exponent) {
+    length += snprintf(&buffer[length], NUM_CHARS_JSON_NUMBER - length, "e%i", exponent);
+  }
+  return length;
+}
@@ -0,0 +1,150 @@
+#ifndef PlantSaverModels_h
+#define PlantSaverModels_h
+
+// Sensor statistics, change detection, the next-watering forecast, database ranking, requirement bands, light sensor ranging
+// & the number format of the sensor files. Plain C++ with no Arduino dependencies, so the host tools in tools/ build the same
+// code the firmware runs
+
+#include <stdint.h>
+
+/*------------------------------------------------------------ Macros ------------------------------------------------------------*/
+
+#define NUM_QUANTILE_MARKERS 5  // P-square markers: min, P10, P50, P90, max
+#define MAX_STAT_BINS 39        // Enough bins for the temperature band edges, one per edge & one per gap
+#define NUM_RANKED_CHANNELS 3   // Light, water & temperature, the channels with per-plant requirements
+#define RANK_BLOCK_SIZE 64      // Database plants parsed before each scoring pass
+#define NUM_CHARS_JSON_NUMBER 16      // Longest number in a sensor file, e.g. "-1.234567e-10", plus terminator
+#define LIGHT_HEADROOM 2              // LTR390 range kept above the previous light level, for it to brighten between readings
+#define LIGHT_TARGET_COUNTS 500       // Counts a light conversion should reach, steps of 0.2% of the reading
+#define LIGHT_MIN_STEP_LUX 0.15       // Steps finer than this are not needed, however dark it is
+#define LIGHT_SATURATION_FRACTION 0.9 // Conversions past this share of full scale are re-taken at the widest range
+#define CUSUM_BASELINE_WEIGHT 0.1     // Weight of each reading in the baseline the detectors measure shifts against
+#define WATER_CUSUM_DRIFT 25          // ADC counts of slack per reading for sensor noise and slow drying
+#define WATER_CUSUM_THRESHOLD 300     // ADC counts of accumulated drop that count as a watering
+#define LIGHT_CUSUM_DRIFT 0.25        // Decades of lux of slack per reading for passing clouds
+#define LIGHT_CUSUM_THRESHOLD 1.5     // Decades of lux of accumulated change that count as lights on/off
+#define CUSUM_SETTLE_READINGS 3       // Readings that must stop moving the way of a shift before the step counts as complete
+#define FORECAST_MEMORY_H 3           // Hours over which older soil readings fade out of the local drying trend
+#define FORECAST_MIN_SAMPLES 4        // Soil readings since the last watering needed before forecasting
+#define FORECAST_MIN_SPAN_H 1         // Hours those readings must cover
+#define FORECAST_MAX_AGE_H 12         // No forecast from a trend whose latest reading is older than this
+#define FORECAST_MAX_H 240            // Forecasts further out than this are not shown
+
+/*------------------------------------------------------- Class Definitions -------------------------------------------------------*/
+
+// Constant-memory running distribution of one sensor channel: P10/P50/P90 estimates (P-square algorithm)
+// plus a histogram of readings on and between the band edges used by the threshold checks
+class ChannelStats {
+public:
+  ChannelStats();
+  void add(float reading, int channel);
+  float getQuantile(int percentile);
+  int percentInRange(int channel, int thresholds[2]);
+  unsigned long count;
+  float markers[NUM_QUANTILE_MARKERS];            // Marker heights
+  unsigned long positions[NUM_QUANTILE_MARKERS];  // Marker positions
+  uint8_t bins[MAX_STAT_BINS];  // Counts are halved together when one fills, only their ratios matter
+};
+
+// Requirement bands of a block of database plants, stored as a structure of arrays so that scoring is one straight loop per channel.
+// Bands are held as histogram bin ranges, making the fit of a plant the share of recorded readings inside its bands
+class RequirementBlock {
+public:
+  RequirementBlock();
+  void add(int hardiness[2], int lightReq[2], int waterReq[2], unsigned long offset);
+  void score(ChannelStats stats[], float scores[]);
+  int size;
+  uint8_t firstBin[NUM_RANKED_CHANNELS][RANK_BLOCK_SIZE];  // First bin of the band
+  uint8_t endBin[NUM_RANKED_CHANNELS][RANK_BLOCK_SIZE];    // One past the last bin, equal to firstBin if the band is unknown
+  unsigned long offsets[RANK_BLOCK_SIZE];                  // Position of each plant in the database file
+};
+
+// Two-sided CUSUM change-point detector. Follows a slowly moving baseline and flags abrupt shifts away from it in constant memory
+class ChangeDetector {
+public:
+  ChangeDetector();
+  int add(float reading, float drift, float threshold);
+  float baseline;
+  float upSum;    // Accumulated rise above the baseline
+  float downSum;  // Accumulated drop below the baseline
+  float shiftFrom;  // Baseline before the most recent shift
+  int lastShift;    // Direction of the most recent shift, 0 if none yet
+  int settling;     // Readings left before the most recent shift counts as complete, 0 once it has
+  unsigned long count;  // Readings since the last shift
+};
+
+// Next-watering forecast. Soil dries as an exponential approach to a dry level, so the drying rate falls linearly with the reading.
+// A local trend (exponentially weighted least squares) gives the current level and rate, and regressing that rate on the level
+// since the last watering gives the decay rate and dry level to extrapolate with. Both fits are running means and co-moments,
+// constant work per sample
+class DryingForecast {
+public:
+  DryingForecast();
+  void add(float reading, unsigned long now);
+  float hoursUntil(float level, unsigned long now);
+  float weight;  // Sum of the sample weights
+  float meanT;   // Weighted mean sample time, hours since startTime
+  float meanY;   // Weighted mean reading
+  float varT;    // Weighted sums of squared time deviations and of time-reading cross deviations
+  float covTY;
+  float rateWeight;  // Hours of local trends folded into the rate fit
+  float meanLevel;   // Mean level and drying rate (ADC counts per hour) of the local trends
+  float meanRate;
+  float varLevel;
+  float covLR;
+  unsigned long startTime;  // First reading since the last watering, 0 if none
+  unsigned long lastTime;
+  unsigned long count;
+};
+
+/*------------------------------------------------------- Standalone Helpers -------------------------------------------------------*/
+
+// Standalone band mapping utilities, fill thresholds with the low/high bounds of a requirement range
+bool getLightThresholds(int lightReq[2], int thresholds[2]);
+bool getTempThresholds(int hardiness[2], int thresholds[2]);
+bool getWaterThresholds(int waterReq[2], int thresholds[2]);
+bool getHumidityThresholds(int thresholds[2]);
+bool getDLIThresholds(int lightReq[2], float thresholds[2]);
+bool getVPDThresholds(float thresholds[2]);
+
+// Standalone LTR390 ranging utilities. Settings are ltr390_gain_t & ltr390_resolution_t values
+void chooseLightRange(float expectedLux, int &gain, int &resolution, float headroom, float targetCounts);
+float getLuxPerCount(int gain, int resolution);
+uint32_t getLightFullScale(int resolution);
+float getLux(uint32_t counts, int gain, int resolution);
+bool lightSaturated(uint32_t counts, int resolution);
+int getLightConversionMs(int resolution);
+
+// Standalone number formatter, writes a float the way serializeJson() does and returns its length
+int formatJsonFloat(float value, char buffer[]);
+
+// Standalone ranking utility, keeps the best maxTop scores in descending order
+void insertTopPlant(float score, unsigned long offset, float topScores[], unsigned long topOffsets[], int &numTop, int maxTop);
+
+/*---------------------------------------------------------- enumerables -----------------------------------------------------------*/
+
+// For iterating through multiple files
+enum FileTypes {
+  lightFile,
+  waterFile,
+  humidityFile,
+  tempFile,
+  datesFile
+};
+
+// For checking light requirements
+enum LightValues {
+  fullShade = 1,
+  partialSun = 2,
+  fullSun = 3
+};
+
+// For checking water requirements
+enum waterValues {
+  water = 1,
+  wet = 2,
+  moist = 3,
+  dry = 4
+};
+
+#endif
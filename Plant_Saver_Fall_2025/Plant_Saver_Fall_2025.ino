@@ -20,9 +20,12 @@
 #define WAKE_PIN_BITMASK 201347072  // Pins 12, 14, 26 & 27
 #define DISPLAY_TIMEOUT_M 1         // delay before timing out the display in minutes
 #define MS_PER_MINUTE 60000         // Milliseconds per minute conversion factor
-#define INTEGRATION_TIME 0.25       // LTR390 integration time
-#define LTR390_GAIN 3               // Gain of the LTR390
 #define TRIG_PULSE_LEN_MS 2000      // Trigger mode pulse length in ms
+#define ERROR_RETRY_MIN_MS 500      // First re-initialization delay in error mode, doubled after every failed attempt
+#define ERROR_RETRY_MAX_MS 1800000  // Longest delay between re-initialization attempts
+#define ERROR_DEEP_SLEEP_MS 60000   // Delays at least this long are spent in deep sleep instead of light sleep
+#define PERIPHERAL_SETTLE_MS 50     // Time for peripherals to power up before they are probed
+#define WAKE_SLACK_S 2              // Channels due within this many seconds are read on the current wake
 
 // Pin Definitions
 #define V_GATE_PERIPHERAL 2  // Gate control pin of peripheral low-side power MOSFET
@@ -38,8 +41,21 @@
 /*------------------------------------------------------ Global Variables ------------------------------------------------------*/
 
 const uint64_t usPerMinute = 60000000;  // Conversion factor between minutes and microseconds
-const uint64_t samplingPeriodM = 1;     // Time between sensor measurements in minutes
 RTC_DATA_ATTR bool powerUpFlag = 0;     // used for initialization after a power-up (primarily timekeeping)
+RTC_DATA_ATTR bool scheduleValid = 0;                 // Set once the channel deadlines below have been filled in
+RTC_DATA_ATTR time_t channelDue[NUM_CHANNELS];        // Time each channel is next due for a reading, indexed by FileTypes
+RTC_DATA_ATTR uint32_t channelPeriodS[NUM_CHANNELS];  // Sampling period of each channel in seconds, cached from the header
+RTC_DATA_ATTR uint32_t logCacheID = 0;                // Sensor log the two positions below belong to, 0 if none is cached
+RTC_DATA_ATTR uint32_t logCacheSector;                // First sector of the cached log
+RTC_DATA_ATTR uint32_t logCacheNextSeq;               // Sequence number of its next record
+RTC_DATA_ATTR unsigned long errorBackoffMs = ERROR_RETRY_MIN_MS;  // Delay before the next re-initialization attempt
+RTC_DATA_ATTR bool errorSleep = 0;                                // Set while deep-sleeping until the next re-initialization attempt
+RTC_DATA_ATTR float lastLux = NAN;                                // Previous light reading, ranges the next LTR390 conversion
+RTC_DATA_ATTR uint32_t uplinkBackoffS = 0;                        // Delay after the last failed uplink, 0 once one succeeds
+RTC_DATA_ATTR time_t uplinkRetryAt = 0;                           // No uplink is attempted before this time
+int lightGain;               // Settings of the LTR390 conversion in progress, as ltr390_gain_t & ltr390_resolution_t values
+int lightResolution;
+unsigned long lightStartMs;  // Time the conversion in progress was started
 
 /*---------------------------------------------------- Object Instantiation ----------------------------------------------------*/
 
@@ -67,11 +83,12 @@ void setup() {
 
 /*
   Main loop functions as a state machine where each state handler function determines the next state.
-  Error occurrence holds the active state to return if the error can be cleared.
+  Error occurrence holds the active state to return if the error can be cleared. Errors that only degrade operation
+  (missing display or light/temperature sensor) do not stop the state machine.
 */
 void loop() {
   static Container container;
-  if (container.error.highestPriority) {
+  if (container.error.getCriticalError()) {
     errorModeHandler(container);
   } else {
     switch (container.activeMode) {
@@ -87,6 +104,9 @@ void loop() {
       case triggerMode:
         triggerModeHandler(container);
         break;
+      case uplinkMode:
+        uplinkModeHandler(container);
+        break;
       case shutdownMode:
         shutdownModeHandler(container);
         break;
@@ -102,45 +122,65 @@ void loop() {
 /*---------------------------------------------------- Function Definitions ------------------------------------------------------*/
 
 /*
-  Initialize all peripherals, then pull header data. If not already set, date is pulled from timestamp in header
+  Initialize peripherals, then pull header data. If not already set, date is pulled from timestamp in header
   If a user plant had been selected previously, that data is also pulled in. 
+  On a timer wake only the sensors of channels that are due are started, the display is left off, and if nothing is due
+  the device goes straight back to sleep without powering peripherals or mounting the SD.
+  Only a failed SD card holds the device in start-up; without the display or environment sensors it carries on degraded.
 */
 void startupModeHandler(Container &container) {
   bool initFailed = 0;  // Flag to track an initialization failure
+  esp_sleep_wakeup_cause_t wakeSource = esp_sleep_get_wakeup_cause();  // Determine what woke the ESP32
+  bool timerWake = (wakeSource == ESP_SLEEP_WAKEUP_TIMER);
+  int dueChannels = getDueChannels();
+  container.sensorReading.channelMask = dueChannels;
+
+  if (timerWake && dueChannels == 0 && !errorSleep) {  // Woke early, nothing to read
+    container.activeMode = shutdownMode;
+    return;
+  }
 
   digitalWrite(V_GATE_PERIPHERAL, HIGH);  // Power-up peripherals
   digitalWrite(ERROR_IND_PIN, LOW);       // Reset error indicator
 
   // SSD1306 Initialization
-  if (!container.interface.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {  // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
-    container.error.addError(displayInit);
-    initFailed = 1;
-  } else {
-    container.error.clearError(displayInit);
+  if (!timerWake) {
+    if (!container.interface.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {  // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
+      container.error.addError(displayInit);
+    } else {
+      container.error.clearError(displayInit);
+    }
   }
 
   // LTR390 Initialization
-  if (!ltr390.begin()) {
-    container.error.addError(lightSensorInit);
-    delay(500);
-    initFailed = 1;
-  } else {
-    ltr390.setMode(LTR390_MODE_ALS);                // Ambient lighting mode
-    ltr390.setGain(LTR390_GAIN_3);                  // Gain of 3
-    ltr390.setResolution(LTR390_RESOLUTION_16BIT);  // 16-bit resolution
-    ltr390.configInterrupt(0, LTR390_MODE_UVS, 0);  // Disable interrrupts from the device
-    container.error.clearError(lightSensorInit);
+  if (!timerWake || (dueChannels & (1 << lightFile))) {
+    if (!ltr390.begin()) {
+      container.error.addError(lightSensorInit);
+    } else {
+      ltr390.setMode(LTR390_MODE_ALS);                // Ambient lighting mode
+      ltr390.configInterrupt(0, LTR390_MODE_UVS, 0);  // Disable interrrupts from the device
+      container.error.clearError(lightSensorInit);
+      if (dueChannels & (1 << lightFile)) {  // Convert while the rest of start-up runs, ranged for the previous reading
+        int gain, resolution;
+        chooseLightRange(lastLux, gain, resolution, LIGHT_HEADROOM, LIGHT_TARGET_COUNTS);
+        startLightConversion(gain, resolution);
+      }
+    }
   }
 
   // AHT20 initialization
-  if (!aht20.begin()) {
-    container.error.addError(tempSensorInit);
-    initFailed = 1;
-  } else {
-    container.error.clearError(tempSensorInit);
+  if (!timerWake || (dueChannels & ((1 << humidityFile) | (1 << tempFile)))) {
+    if (!aht20.begin()) {
+      container.error.addError(tempSensorInit);
+    } else {
+      container.error.clearError(tempSensorInit);
+    }
   }
 
   // Micro-SD card initialization & initial data reading
+  if (!timerWake) {
+    blockCache.begin(READ_CACHE_BUDGET_BYTES);  // Display sessions read the same files repeatedly
+  }
   if (!SD.begin(SPI_CS)) {
     initFailed = 1;
     container.error.addError(SDInit);
@@ -148,10 +188,26 @@ void startupModeHandler(Container &container) {
     container.error.clearError(SDInit);
     if (!container.headerPulled) {
       container.pullHeader();
+      for (int i = 0; i < NUM_CHANNELS; i++) {
+        channelPeriodS[i] = container.header.samplePeriodM[i] * 60;
+      }
     }
     if (!container.plantPulled && container.headerPulled && container.header.activePlantID != 0) {
       container.pullPlant();  // Grab the active user plant only if it exists
     }
+    if (!container.environmentPulled && container.plantPulled) {
+      container.pullEnvironment();
+    }
+    if (!container.sensorLog.ready && container.environmentPulled && container.header.logID != 0) {
+      if (logCacheID == container.header.logID) {  // Position kept through deep sleep, no need to scan the log
+        container.sensorLog.resume(logCacheID, logCacheSector, logCacheNextSeq);
+      } else {
+        container.sensorLog.open(container.header.logID);
+      }
+    }
+    if (!timerWake) {
+      container.checkpointLog();  // Fold in logged readings before they are shown
+    }
   }
 
   // Power-up initialization
@@ -164,19 +220,24 @@ void startupModeHandler(Container &container) {
     } else {
       setTimeFromTimeStr(fallBackTimeStr);
     }
+    time_t now;
+    time(&now);
+    if (container.sensorLog.ready && container.sensorLog.lastTime > now) {  // Deferred wakes leave header.date behind the log
+      struct timeval tv = { (time_t)container.sensorLog.lastTime, 0 };
+      settimeofday(&tv, NULL);
+    }
     powerUpFlag = 1;
   }
 
-  if (initFailed == 1) {  // One or more peripherals failed to initialize
+  if (initFailed == 1) {  // SD card failed to initialize
     container.activeMode = startupMode;
-  } else {                                                               // All peripherals initialized
-    esp_sleep_wakeup_cause_t wakeSource = esp_sleep_get_wakeup_cause();  // Determine what woke the ESP32
-    switch (wakeSource) {                                                // User mode (displayMode) if button wakeup, otherwise move to sensing steps
+  } else {  // Peripherals needed for sensing initialized
+    switch (wakeSource) {  // User mode (displayMode) if button wakeup, otherwise move to sensing steps
       case ESP_SLEEP_WAKEUP_EXT0:
         container.activeMode = displayMode;
         break;
       case ESP_SLEEP_WAKEUP_TIMER:
-        container.activeMode = sensingMode;
+        container.activeMode = (dueChannels != 0) ? sensingMode : shutdownMode;  // A retry wake may come between readings
         break;
       default:
         container.activeMode = displayMode;
@@ -184,8 +245,30 @@ void startupModeHandler(Container &container) {
   }
 
   if (container.headerPulled && container.header.activePlantID == 0) {  // Automatically switch to display mode if no plant selected yet
-    container.activeMode = displayMode;
+    container.activeMode = timerWake ? shutdownMode : displayMode;
   }
+
+  if (container.activeMode == displayMode && container.error.getError(displayInit)) {  // Nothing to show, read any due channels
+    container.activeMode = (container.header.activePlantID != 0 && dueChannels != 0) ? sensingMode : shutdownMode;
+  }
+}
+
+/*
+  Bitmask (bits ordered by FileTypes) of the channels due for a reading. Everything is due until a schedule exists
+*/
+int getDueChannels() {
+  if (!scheduleValid) {
+    return (1 << NUM_CHANNELS) - 1;
+  }
+  time_t now;
+  time(&now);
+  int dueChannels = 0;
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    if (now + WAKE_SLACK_S >= channelDue[i]) {
+      dueChannels |= 1 << i;
+    }
+  }
+  return dueChannels;
 }
 
 /*
@@ -207,11 +290,12 @@ void displayModeHandler(Container &container) {
     container.activePlant.checkThresholds();
     container.interface.displayMainMenu(container.activePlant);
   }
+  container.error.indicateError();  // Degraded operation (missing display or sensor) is flashed while awake
   // Change screen button
   if (!digitalRead(CHG_SCREEN_BTN) && chgOns == 0) {
     chgOns = 1;
     startTime = millis();
-    container.interface.nextScreen(container.activePlant, container.plants[container.interface.selectedPlantIndex].commonName);
+    container.interface.nextScreen(container.activePlant, container.plants[container.interface.selectedPlantIndex]);
   } else if (digitalRead(CHG_SCREEN_BTN) && chgOns == 1) {
     chgOns = 0;
   }
@@ -221,7 +305,10 @@ void displayModeHandler(Container &container) {
     startTime = millis();
     if (container.interface.activeMenu == selectMenu) {
       container.interface.selectedPlantIndex = (container.interface.selectedPlantIndex > 0) ? container.interface.selectedPlantIndex - 1 : (NUM_DISPLAY_PLANTS - 1);
-      container.interface.displaySelectMenu(container.plants[container.interface.selectedPlantIndex].commonName);
+      container.interface.displaySelectMenu(container.plants[container.interface.selectedPlantIndex]);
+    } else if (container.interface.activeMenu == mainMenu) {  // Toggle between averages and quantiles
+      container.interface.quantileView = !container.interface.quantileView;
+      container.interface.displayMainMenu(container.activePlant);
     }
   } else if (digitalRead(UP_BTN) && upOns == 1) {
     upOns = 0;
@@ -232,7 +319,10 @@ void displayModeHandler(Container &container) {
     startTime = millis();
     if (container.interface.activeMenu == selectMenu) {
       container.interface.selectedPlantIndex = (container.interface.selectedPlantIndex < (NUM_DISPLAY_PLANTS - 1)) ? container.interface.selectedPlantIndex + 1 : 0;
-      container.interface.displaySelectMenu(container.plants[container.interface.selectedPlantIndex].commonName);
+      container.interface.displaySelectMenu(container.plants[container.interface.selectedPlantIndex]);
+    } else if (container.interface.activeMenu == mainMenu) {  // Toggle between averages and quantiles
+      container.interface.quantileView = !container.interface.quantileView;
+      container.interface.displayMainMenu(container.activePlant);
     }
   } else if (digitalRead(DOWN_BTN) && downOns == 1) {
     downOns = 0;
@@ -248,6 +338,10 @@ void displayModeHandler(Container &container) {
   } else if (digitalRead(SELECT_BTN) && selOns == 1) {
     selOns = 0;
   }
+  // Serial commands
+  if (serialCommandHandler(container)) {
+    startTime = millis();
+  }
   // Inactivity watchdog timer
   if (currentTime - startTime > (DISPLAY_TIMEOUT_M * MS_PER_MINUTE)) {  // go into deep sleep after a period of inactivity
     Serial.println(F("shutting down..."));
@@ -256,8 +350,88 @@ void displayModeHandler(Container &container) {
 }
 
 /*
- Take readings from each sensor to construct a sensorReadings object, then update active user plant averages
- as well as each sensor readings file
+ Read one command from the serial monitor and print the response. Returns 1 if a command was received.
+ Supported commands:
+   Q,<start timestamp>,<end timestamp>  | count,min,max,mean of each channel between the two timestamps
+   M                                    | derived metrics: dli,dliToday,vpd,avgVPD,gdd
+   C                                    | read cache counters: hits,misses,blocks
+*/
+bool serialCommandHandler(Container &container) {
+  if (!Serial.available()) {
+    return 0;
+  }
+  char command[MAX_CHARS_COMMAND] = { 0 };
+  int length = Serial.readBytesUntil('\n', command, MAX_CHARS_COMMAND - 1);
+  if (length > 0 && command[length - 1] == '\r') {
+    command[--length] = '\0';
+  }
+  if (command[0] == 'Q' && command[1] == ',' && length == 2 + 2 * TIMESTAMP_LEN + 1 && command[2 + TIMESTAMP_LEN] == ',') {
+    char startTime[NUM_CHARS_TIMESTAMP] = { 0 };
+    char endTime[NUM_CHARS_TIMESTAMP] = { 0 };
+    memcpy(startTime, command + 2, TIMESTAMP_LEN);
+    memcpy(endTime, command + 3 + TIMESTAMP_LEN, TIMESTAMP_LEN);
+    if (!container.headerPulled || container.header.activePlantID == 0) {
+      Serial.println(F("ERR,no plant"));
+      return 1;
+    }
+    RangeStats stats[NUM_CHANNELS];
+    int queryError = container.queryRange(startTime, endTime, stats);
+    if (queryError) {
+      Serial.printf("ERR,%i\n", queryError);
+      return 1;
+    }
+    const char* channelNames[NUM_CHANNELS] = { "light", "water", "humidity", "temp" };  // Ordered by FileTypes
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      Serial.printf("%s,%i,%.2f,%.2f,%.2f\n", channelNames[i], stats[i].count, stats[i].min, stats[i].max, stats[i].mean);
+    }
+  } else if (command[0] == 'M' && length == 1) {
+    DerivedMetrics &derived = container.activePlant.derived;
+    Serial.printf("%.2f,%.2f,%.3f,%.3f,%.1f\n", derived.dli, derived.dliToday, derived.vpd, derived.avgVPD, derived.gdd);
+  } else if (command[0] == 'C' && length == 1) {
+    Serial.printf("%lu,%lu,%i\n", blockCache.hits, blockCache.misses, blockCache.numBlocks);
+  } else {
+    Serial.println(F("ERR,unknown command"));
+  }
+  return 1;
+}
+
+/*
+ Start an LTR390 conversion at the given settings. The sensor converts continuously once enabled, so the data-ready flag
+ left over from the previous settings is cleared before it restarts
+*/
+void startLightConversion(int gain, int resolution) {
+  ltr390.enable(false);
+  ltr390.setGain((ltr390_gain_t)gain);
+  ltr390.setResolution((ltr390_resolution_t)resolution);
+  ltr390.newDataAvailable();  // Reading the status clears the flag
+  ltr390.enable(true);
+  lightGain = gain;
+  lightResolution = resolution;
+  lightStartMs = millis();
+}
+
+/*
+ Wait for the conversion started by startLightConversion() and convert it to lux with the settings it was taken at.
+ A saturated conversion is taken again once at the widest range
+*/
+float readLight() {
+  unsigned long timeoutMs = getLightConversionMs(lightResolution) + LIGHT_CONVERSION_SLACK_MS;
+  while (!ltr390.newDataAvailable() && millis() - lightStartMs < timeoutMs) {
+    delay(1);
+  }
+  uint32_t counts = ltr390.readALS();
+  int widestGain, widestResolution;
+  chooseLightRange(NAN, widestGain, widestResolution, LIGHT_HEADROOM, LIGHT_TARGET_COUNTS);
+  if (lightSaturated(counts, lightResolution) && (lightGain != widestGain || lightResolution != widestResolution)) {
+    startLightConversion(widestGain, widestResolution);
+    return readLight();
+  }
+  return getLux(counts, lightGain, lightResolution);
+}
+
+/*
+ Take readings from each sensor to construct a sensorReadings object, then record it. Readings go to the sensor log
+ and are folded into the user plant averages and sensor readings files in batches
 */
 void sensingModeHandler(Container &container) {
   static bool lightRead = 0;
@@ -265,30 +439,55 @@ void sensingModeHandler(Container &container) {
   static bool tempRead = 0;
   static bool waterRead = 0;
 
-  // Get data from each device
+  // Get data from each device that is due, sensors that failed to initialize are recorded as missing (NAN)
+  int dueChannels = container.sensorReading.channelMask;
   if (lightRead == 0) {
-    container.sensorReading.lightReading = (0.6 * ltr390.readALS()) / (LTR390_GAIN * INTEGRATION_TIME);  // Lux = 0.6*ALS_DATA/(Gain*integration time(ms))
+    if (!(dueChannels & (1 << lightFile))) {
+      container.sensorReading.lightReading = NAN;
+    } else if (container.error.getError(lightSensorInit)) {
+      container.sensorReading.lightReading = NAN;
+    } else {
+      container.sensorReading.lightReading = readLight();
+      lastLux = container.sensorReading.lightReading;
+    }
     lightRead = 1;
   }
 
   if (humidityRead == 0 || tempRead == 0) {
-    sensors_event_t humidity, temp;  // AHT20
-    aht20.getEvent(&humidity, &temp);
-    container.sensorReading.humidityReading = humidity.relative_humidity;
-    container.sensorReading.tempReading = temp.temperature * 1.8 + 32;
+    if (!(dueChannels & ((1 << humidityFile) | (1 << tempFile))) || container.error.getError(tempSensorInit)) {
+      container.sensorReading.humidityReading = NAN;
+      container.sensorReading.tempReading = NAN;
+    } else {
+      sensors_event_t humidity, temp;  // AHT20
+      aht20.getEvent(&humidity, &temp);
+      container.sensorReading.humidityReading = (dueChannels & (1 << humidityFile)) ? humidity.relative_humidity : NAN;
+      container.sensorReading.tempReading = (dueChannels & (1 << tempFile)) ? temp.temperature * 1.8 + 32 : NAN;
+    }
     humidityRead = 1;
     tempRead = 1;
   }
 
   if (waterRead == 0) {
-    container.sensorReading.waterReading = analogRead(CAP_SOIL_AOUT);  // Capacitive soil sensor
+    container.sensorReading.waterReading = (dueChannels & (1 << waterFile)) ? analogRead(CAP_SOIL_AOUT) : NAN;  // Capacitive soil sensor
     waterRead = 1;
   }
 
-  getTimeStr(container.sensorReading.timeStamp);
+  time_t now;
+  time(&now);
+  container.sensorReading.time = now;
+  formatTimeStr(container.sensorReading.timeStamp, now);
 
   if (lightRead == 1 && humidityRead == 1 && tempRead == 1 && waterRead == 1) {
-    container.updatePlantData();
+    container.recordReading(esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);  // Only unattended wakes are deferred
+    for (int i = 0; i < NUM_CHANNELS; i++) {  // Push back the deadlines of the channels just read
+      if (!scheduleValid) {
+        channelDue[i] = now;
+      }
+      if (dueChannels & (1 << i)) {
+        channelDue[i] = now + channelPeriodS[i];
+      }
+    }
+    scheduleValid = 1;
     container.activeMode = triggerMode;
   }
 }
@@ -302,53 +501,130 @@ void triggerModeHandler(Container &container) {
     delay(TRIG_PULSE_LEN_MS);
     digitalWrite(TRIG_OUTPUT_PIN, LOW);
   }
+  time_t now;
+  time(&now);
+  if (container.uplink.due() && now >= uplinkRetryAt) {
+    container.activeMode = uplinkMode;  // Enough readings queued for a batch & not backing off
+  } else {
+    container.activeMode = shutdownMode;
+  }
+}
+
+/*
+ Bring up the radio once to publish the queued readings, then report how long it was on.
+ A failed uplink leaves the readings queued and backs off exponentially, so an unreachable network does not cost a
+ connection timeout on every wake
+*/
+void uplinkModeHandler(Container &container) {
+  time_t now;
+  time(&now);
+  if (!container.uplink.sendBatch(container.header.activePlantID)) {
+    uplinkBackoffS = (uplinkBackoffS == 0) ? UPLINK_RETRY_MIN_S : uplinkBackoffS * 2;
+    uplinkBackoffS = (uplinkBackoffS < UPLINK_RETRY_MAX_S) ? uplinkBackoffS : UPLINK_RETRY_MAX_S;
+    uplinkRetryAt = now + uplinkBackoffS;
+    Serial.printf("uplink failed, readings kept in queue, next attempt in %lu s\n", (unsigned long)uplinkBackoffS);
+  } else {
+    uplinkBackoffS = 0;
+    uplinkRetryAt = 0;
+  }
+  container.deferredWake = 0;  // The send cursor moved, so the header is saved even on a wake that only logged
+  Serial.printf("radio on for %lu ms\n", container.uplink.radioOnTimeMs);
   container.activeMode = shutdownMode;
 }
 
+/*
+ Store header, plant and environment data if they were loaded and changed this wake, then deep sleep until the next
+ channel is due. Wakes that only appended to the sensor log leave every file untouched. Reaching here means the wake ran
+ without a critical error, so error mode starts over from the shortest retry delay
+*/
 void shutdownModeHandler(Container &container) {
-  container.pushHeader();
-  container.pushPlant();
-  // Set ESP32 into deep sleep mode
+  if (container.headerPulled && !container.deferredWake) {
+    container.pushHeader();
+  }
+  if (container.plantChanged && container.header.activePlantID != 0) {
+    container.pushPlant();
+  }
+  if (container.environmentPulled && !container.deferredWake) {
+    container.pushEnvironment();
+  }
+  if (container.headerPulled) {  // Wakes that never mounted the card leave the cache as it was
+    logCacheID = container.sensorLog.ready ? container.sensorLog.logID : 0;
+    logCacheSector = container.sensorLog.baseSector;
+    logCacheNextSeq = container.sensorLog.nextSeq;
+  }
+  errorBackoffMs = ERROR_RETRY_MIN_MS;
+  errorSleep = 0;
   container.interface.displayOff();
-  digitalWrite(V_GATE_PERIPHERAL, LOW);  // Shut down peripherals
-  rtc_gpio_pullup_en(GPIO_NUM_12);
-  rtc_gpio_pulldown_dis(GPIO_NUM_12);
-  esp_sleep_enable_ext0_wakeup(GPIO_NUM_12, 0);
-  uint64_t sleep_time = (samplingPeriodM * usPerMinute);
-  esp_sleep_enable_timer_wakeup(sleep_time);
-  esp_deep_sleep_start();
+  uint64_t sleep_time = (DEFAULT_SAMPLING_PERIOD_M * usPerMinute);
+  if (scheduleValid) {
+    time_t now;
+    time(&now);
+    time_t nextDue = channelDue[0];
+    for (int i = 1; i < NUM_CHANNELS; i++) {
+      nextDue = (channelDue[i] < nextDue) ? channelDue[i] : nextDue;
+    }
+    sleep_time = (nextDue > now) ? (uint64_t)(nextDue - now) * 1000000 : 1000000;
+  }
+  deepSleep(container, sleep_time);
 }
 
 /*
  Indicate current error via the LED output. Number of LED pulses in one sequence matches the error code.
- Re-check initialization errors periodically to clear automatically
+ The pattern runs on LEDC hardware while the CPU light-sleeps with peripherals powered down, waking only to start/stop a
+ sequence or to retry initialization. Retries back off exponentially; once the delay reaches ERROR_DEEP_SLEEP_MS the device
+ deep-sleeps until the next attempt, which then starts over from a fresh start-up. If that start-up fails too it counts as
+ the attempt, so the device backs off and deep-sleeps again straight away. The delay keeps growing when an attempt starts up
+ but fails later in the wake, and only returns to the shortest once a wake reaches shutdown
 */
 void errorModeHandler(Container &container) {
-  static unsigned long startTime = millis();
-  unsigned long currentTime = millis();
-  if (currentTime - startTime > 500) {  // Re-check existing errors
-    switch (container.error.highestPriority) {
-      case displayInit:
-        if (container.interface.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
-          container.error.clearError(displayInit);
-        }
-      case lightSensorInit:
-        if (ltr390.begin()) {
-          container.error.clearError(lightSensorInit);
-        }
-        break;
-      case tempSensorInit:
-        if (aht20.begin()) {
-          container.error.clearError(tempSensorInit);
-        }
-        break;
-      case SDInit:
-        if (SD.begin(SPI_CS)) {
-          container.error.clearError(SDInit);
-        }
-        break;
+  static unsigned long retryStart = millis();
+  bool retried = errorSleep && esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER;  // This wake's start-up was the attempt
+  errorSleep = 0;
+  if (!retried && millis() - retryStart >= errorBackoffMs) {  // Re-probe every peripheral
+    digitalWrite(V_GATE_PERIPHERAL, HIGH);
+    delay(PERIPHERAL_SETTLE_MS);
+    container.error.clearError(displayInit);
+    container.error.clearError(lightSensorInit);
+    container.error.clearError(tempSensorInit);
+    container.error.clearError(jsonError);  // File errors of the failed attempt, the retry reads everything again
+    container.error.clearError(fileOperation);
+    container.error.clearError(SDInit);
+    startupModeHandler(container);
+    retryStart = millis();
+    retried = 1;
+  }
+  if (retried) {  // Every attempt counts until a wake runs through to shutdown, however far it got
+    errorBackoffMs = (errorBackoffMs < ERROR_RETRY_MAX_MS / 2) ? errorBackoffMs * 2 : ERROR_RETRY_MAX_MS;
+    if (!container.error.getCriticalError()) {
+      container.error.indicateError();
+      return;
+    }
+    if (errorBackoffMs >= ERROR_DEEP_SLEEP_MS) {
+      errorSleep = 1;
+      deepSleep(container, (uint64_t)errorBackoffMs * 1000);
     }
-    startTime = currentTime;
   }
-  container.error.indicateError();
-}
\ No newline at end of file
+  unsigned long indicatorWait = container.error.indicateError();
+  unsigned long elapsed = millis() - retryStart;
+  unsigned long retryWait = (elapsed < errorBackoffMs) ? errorBackoffMs - elapsed : 0;
+  unsigned long sleepTime = (indicatorWait > 0 && indicatorWait < retryWait) ? indicatorWait : retryWait;
+  if (sleepTime > 0) {
+    digitalWrite(V_GATE_PERIPHERAL, LOW);  // Peripherals stay off between attempts
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepTime * 1000);
+    esp_light_sleep_start();
+  }
+}
+
+/*
+ Deep sleep with peripherals powered down until the select button is pressed or sleepTimeUs has passed
+*/
+void deepSleep(Container &container, uint64_t sleepTimeUs) {
+  container.error.highestPriority = noError;
+  container.error.indicateError();       // LEDC does not run in deep sleep
+  digitalWrite(V_GATE_PERIPHERAL, LOW);  // Shut down peripherals
+  rtc_gpio_pullup_en(GPIO_NUM_12);
+  rtc_gpio_pulldown_dis(GPIO_NUM_12);
+  esp_sleep_enable_ext0_wakeup(GPIO_NUM_12, 0);
+  esp_sleep_enable_timer_wakeup(sleepTimeUs);
+  esp_deep_sleep_start();
+}
@@ -0,0 +1,142 @@
+#include "Arduino.h"
+#include "Uplink.h"
+#include <SD.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+
+/*------------------------------------------------------ Object Instantiation -----------------------------------------------------*/
+
+WiFiClient wifiClient;                // TCP transport for the uplink
+PubSubClient mqttClient(wifiClient);  // MQTT client for the uplink
+
+/*-------------------------------------------------------------- Uplink Class --------------------------------------------------------------*/
+
+static char uplinkExpected[NUM_CHARS_TOPIC] = { 0 };  // Header line of the batch awaiting its echo, nonce included
+static bool uplinkAcked = 0;
+
+// MQTT receive callback. The device subscribes to its own topic, so the broker echoing a batch back confirms it was accepted.
+// The header line carries a nonce fresh for every publish, so a late echo of an earlier attempt never acknowledges this one
+static void uplinkCallback(char*, uint8_t* payload, unsigned int length) {
+  int expectedLength = strlen(uplinkExpected);
+  if ((int)length >= expectedLength && memcmp(payload, uplinkExpected, expectedLength) == 0) {
+    uplinkAcked = 1;
+  }
+}
+
+// Initialization
+Uplink::Uplink()
+  : wifiSSID{}, wifiPassword{}, mqttHost{} {
+  mqttPort = 1883;
+  batch = 0;
+  cursor = 0;
+  pending = 0;
+  dropped = 0;
+  radioOnTimeMs = 0;
+}
+
+// Append a reading to the uplink queue file as one compact CSV line. Once the queue is full, readings are counted as dropped
+// rather than queued, so an unreachable broker cannot fill the card; they are still kept in the sensor files
+bool Uplink::queueReading(const char timeStamp[], float light, float water, float humidity, float temp) {
+  if (pending >= UPLINK_MAX_PENDING) {
+    dropped++;
+    return 1;
+  }
+  File queueFile = SD.open("/uplink.txt", FILE_APPEND);
+  if (!queueFile) {
+    return 0;
+  }
+  queueFile.printf("%s,%.1f,%.0f,%.1f,%.1f\n", timeStamp, light, water, humidity, temp);
+  queueFile.close();
+  pending++;
+  return 1;
+}
+
+// Whether enough readings are queued for a batch
+bool Uplink::due() {
+  return batch > 0 && pending >= batch;
+}
+
+// Publish a payload and wait for the broker to echo it back
+bool Uplink::publishAcked(char topic[], char payload[], int length) {
+  uplinkAcked = 0;
+  if (!mqttClient.publish(topic, (const uint8_t*)payload, length)) {
+    return 0;
+  }
+  unsigned long startTime = millis();
+  while (!uplinkAcked && millis() - startTime < UPLINK_ACK_TIMEOUT_MS) {
+    mqttClient.loop();
+    delay(5);
+  }
+  return uplinkAcked;
+}
+
+// Bring up Wi-Fi once, publish every queued reading in as few batches as the MQTT buffer allows, then turn the radio off.
+// Delivery is at-least-once: the send cursor only moves past a batch after the broker has echoed it back, so a batch
+// interrupted by a reset or timeout is sent again on the next uplink
+bool Uplink::sendBatch(int plantID) {
+  unsigned long startTime = millis();
+  bool success = 0;
+  WiFi.mode(WIFI_STA);
+  WiFi.begin(wifiSSID, wifiPassword);
+  while (WiFi.status() != WL_CONNECTED && millis() - startTime < UPLINK_CONNECT_TIMEOUT_MS) {
+    delay(10);
+  }
+  uint8_t mac[6] = { 0 };
+  WiFi.macAddress(mac);
+  char deviceID[13] = { 0 };
+  snprintf(deviceID, sizeof(deviceID), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  char topic[NUM_CHARS_TOPIC] = { 0 };
+  snprintf(topic, NUM_CHARS_TOPIC, "plantsaver/%s/readings", deviceID);
+  mqttClient.setServer(mqttHost, mqttPort);
+  mqttClient.setBufferSize(UPLINK_BUFFER_SIZE);
+  mqttClient.setCallback(uplinkCallback);
+  if (WiFi.status() == WL_CONNECTED && mqttClient.connect(deviceID) && mqttClient.subscribe(topic)) {
+    File queueFile = SD.open("/uplink.txt", FILE_READ);
+    if (queueFile) {
+      success = 1;
+      queueFile.seek(cursor);
+      static char payload[UPLINK_BUFFER_SIZE - NUM_CHARS_TOPIC - 8];  // Leave room for the MQTT fixed header and topic
+      while (success && queueFile.available()) {
+        // Batch header line identifies the device, plant, the queue offset of the first reading and this attempt
+        int length = snprintf(payload, sizeof(payload), "%s,%i,%lu,%08lx\n", deviceID, plantID, cursor, (unsigned long)esp_random());
+        int expectedLength = (length < NUM_CHARS_TOPIC - 1) ? length : NUM_CHARS_TOPIC - 1;
+        memcpy(uplinkExpected, payload, expectedLength);
+        uplinkExpected[expectedLength] = '\0';
+        unsigned long batchEnd = cursor;
+        int batchReadings = 0;
+        char line[64] = { 0 };
+        while (queueFile.available()) {
+          int lineLength = queueFile.readBytesUntil('\n', line, sizeof(line) - 1);
+          if (length + lineLength + 1 >= (int)sizeof(payload)) {
+            break;  // Leave this line for the next batch
+          }
+          memcpy(payload + length, line, lineLength);
+          length += lineLength;
+          payload[length++] = '\n';
+          batchEnd = queueFile.position();
+          batchReadings++;
+        }
+        queueFile.seek(batchEnd);
+        if (batchReadings == 0 || !publishAcked(topic, payload, length)) {
+          success = 0;
+        } else {
+          cursor = batchEnd;
+          pending = (pending > batchReadings) ? pending - batchReadings : 0;
+        }
+      }
+      bool drained = cursor >= queueFile.size();
+      queueFile.close();
+      if (drained) {  // Everything acknowledged, start the queue over
+        queueFile = SD.open("/uplink.txt", FILE_WRITE);
+        queueFile.close();
+        cursor = 0;
+        pending = 0;
+      }
+    }
+    mqttClient.disconnect();
+  }
+  WiFi.disconnect(true);
+  WiFi.mode(WIFI_OFF);
+  radioOnTimeMs = millis() - startTime;
+  return success;
+}
@@ -0,0 +1,42 @@
+#ifndef Uplink_h
+#define Uplink_h
+
+#include <Arduino.h>
+
+/*------------------------------------------------------------ Macros ------------------------------------------------------------*/
+
+#define NUM_CHARS_SSID 33
+#define NUM_CHARS_PASSWORD 65
+#define NUM_CHARS_HOST 64
+#define NUM_CHARS_TOPIC 48
+#define UPLINK_BUFFER_SIZE 1536          // MQTT packet buffer, bounds the size of one published batch
+#define UPLINK_CONNECT_TIMEOUT_MS 10000  // Give up on Wi-Fi/broker after this long
+#define UPLINK_ACK_TIMEOUT_MS 3000       // Wait this long for the broker to echo a batch back
+#define UPLINK_MAX_PENDING 2880          // Readings the queue holds (2 days at 1/min), later ones are dropped until it drains
+#define UPLINK_RETRY_MIN_S 300           // Wait after a failed uplink, doubled after every further failure
+#define UPLINK_RETRY_MAX_S 21600         // Longest wait between uplink attempts
+
+/*------------------------------------------------------- Class Definitions -------------------------------------------------------*/
+
+// Class to queue readings on the SD and publish them in batches over MQTT. Only needs the Arduino, SD, WiFi & PubSubClient
+// APIs, so the host harness in tools/ can run it against a local broker. Settings & queue state are kept in the header file
+class Uplink {
+public:
+  Uplink();
+  bool queueReading(const char timeStamp[], float light, float water, float humidity, float temp);
+  bool sendBatch(int plantID);
+  bool due();
+  char wifiSSID[NUM_CHARS_SSID];
+  char wifiPassword[NUM_CHARS_PASSWORD];
+  char mqttHost[NUM_CHARS_HOST];
+  int mqttPort;
+  int batch;                    // Readings per uplink, 0 disables the uplink
+  unsigned long cursor;         // Byte offset of the first unsent reading in the uplink queue file
+  int pending;                  // Number of queued readings not yet acknowledged by the broker
+  unsigned long dropped;        // Readings left out because the queue was full
+  unsigned long radioOnTimeMs;  // Radio on-time of the most recent uplink
+private:
+  bool publishAcked(char topic[], char payload[], int length);
+};
+
+#endif
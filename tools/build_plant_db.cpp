@@ -0,0 +1,637 @@
+/*
+  Plant-Saver plant database builder
+
+  Converts a Permapeople JSON export into the plantDB.txt read by Container::getDBPlants(). Each entry is validated and
+  normalized by key rather than position: hardiness zones, light and water requirements are found by name, text values
+  ("3a-9b", "Full sun, Partial sun/shade", "Moist") are mapped to the numeric codes used on the device, and names and
+  facts are cut to fit NUM_CHARS_NAME/NUM_CHARS_FACT. The output keeps the layout the firmware decodes by position:
+  data[0] hardiness, data[1] light, data[2] water.
+
+  Build: g++ -std=c++17 -O2 -pthread build_plant_db.cpp -o build_plant_db
+
+  Usage: build_plant_db <export.json> <plantDB.txt> [--threads <n>]
+  Set numDBPlants in header.txt to the number of plants written.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define NUM_CHARS_NAME 50
+#define NUM_CHARS_FACT 100
+
+enum LightValues {
+  fullShade = 1,
+  partialSun = 2,
+  fullSun = 3
+};
+
+enum waterValues {
+  water = 1,
+  wet = 2,
+  moist = 3,
+  dry = 4
+};
+
+// Data keys that may stand in for a cultivation fact when the export has none, in order of preference
+static const char *factKeys[] = { "Soil pH", "Soil type", "Growth", "Layer", "Edible parts" };
+
+/*------------------------------------------------------------ Class Definitions ----------------------------------------------------------*/
+
+// Minimal JSON value, enough to walk one exported plant
+class JsonValue {
+public:
+  enum Type {
+    nullType,
+    boolType,
+    numberType,
+    stringType,
+    arrayType,
+    objectType
+  };
+  JsonValue();
+  const JsonValue *get(const std::string &key) const;
+  Type type;
+  double number;
+  std::string text;
+  std::vector<JsonValue> items;                            // Array elements
+  std::vector<std::pair<std::string, JsonValue>> members;  // Object members in file order
+};
+
+// Recursive descent parser over one span of the export
+class JsonParser {
+public:
+  JsonParser(const char *begin, const char *end);
+  bool parse(JsonValue &value);
+private:
+  bool parseValue(JsonValue &value);
+  bool parseString(std::string &text);
+  void skipSpace();
+  const char *_cursor;
+  const char *_end;
+};
+
+// A plant ready to be written, or the reason it was dropped
+class DBEntry {
+public:
+  DBEntry();
+  long id;
+  std::string name;
+  std::string scientificName;
+  std::string fact;
+  int hardiness[2];
+  int lightReq[2];
+  int waterReq[2];
+  std::string rejection;  // Empty if the entry is valid
+};
+
+/*---------------------------------------------------------- Function Definitions ---------------------------------------------------------*/
+
+JsonValue::JsonValue() {
+  type = nullType;
+  number = 0;
+}
+
+// Member of an object by key, or nullptr
+const JsonValue *JsonValue::get(const std::string &key) const {
+  for (const auto &member : members) {
+    if (member.first == key) {
+      return &member.second;
+    }
+  }
+  return nullptr;
+}
+
+JsonParser::JsonParser(const char *begin, const char *end) {
+  _cursor = begin;
+  _end = end;
+}
+
+bool JsonParser::parse(JsonValue &value) {
+  return parseValue(value);
+}
+
+void JsonParser::skipSpace() {
+  while (_cursor < _end && isspace((unsigned char)*_cursor)) {
+    _cursor++;
+  }
+}
+
+// Parse a quoted string, decoding escapes to UTF-8
+bool JsonParser::parseString(std::string &text) {
+  if (_cursor >= _end || *_cursor != '"') {
+    return false;
+  }
+  _cursor++;
+  while (_cursor < _end && *_cursor != '"') {
+    char c = *_cursor++;
+    if (c != '\\') {
+      text += c;
+      continue;
+    }
+    if (_cursor >= _end) {
+      return false;
+    }
+    char escape = *_cursor++;
+    switch (escape) {
+      case 'n':
+        text += '\n';
+        break;
+      case 't':
+        text += '\t';
+        break;
+      case 'r':
+        text += '\r';
+        break;
+      case 'b':
+        text += '\b';
+        break;
+      case 'f':
+        text += '\f';
+        break;
+      case 'u': {
+        if (_end - _cursor < 4) {
+          return false;
+        }
+        unsigned long codePoint = strtoul(std::string(_cursor, 4).c_str(), nullptr, 16);
+        _cursor += 4;
+        if (codePoint >= 0xD800 && codePoint < 0xDC00 && _end - _cursor >= 6 && _cursor[0] == '\\' && _cursor[1] == 'u') {
+          unsigned long low = strtoul(std::string(_cursor + 2, 4).c_str(), nullptr, 16);
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+          _cursor += 6;
+        }
+        if (codePoint < 0x80) {
+          text += (char)codePoint;
+        } else if (codePoint < 0x800) {
+          text += (char)(0xC0 | (codePoint >> 6));
+          text += (char)(0x80 | (codePoint & 0x3F));
+        } else if (codePoint < 0x10000) {
+          text += (char)(0xE0 | (codePoint >> 12));
+          text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+          text += (char)(0x80 | (codePoint & 0x3F));
+        } else {
+          text += (char)(0xF0 | (codePoint >> 18));
+          text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+          text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+          text += (char)(0x80 | (codePoint & 0x3F));
+        }
+        break;
+      }
+      default:
+        text += escape;  // \" \\ \/
+    }
+  }
+  if (_cursor >= _end) {
+    return false;
+  }
+  _cursor++;
+  return true;
+}
+
+bool JsonParser::parseValue(JsonValue &value) {
+  skipSpace();
+  if (_cursor >= _end) {
+    return false;
+  }
+  char c = *_cursor;
+  if (c == '{') {
+    value.type = JsonValue::objectType;
+    _cursor++;
+    skipSpace();
+    if (_cursor < _end && *_cursor == '}') {
+      _cursor++;
+      return true;
+    }
+    while (true) {
+      skipSpace();
+      std::string key;
+      if (!parseString(key)) {
+        return false;
+      }
+      skipSpace();
+      if (_cursor >= _end || *_cursor++ != ':') {
+        return false;
+      }
+      value.members.emplace_back(key, JsonValue());
+      if (!parseValue(value.members.back().second)) {
+        return false;
+      }
+      skipSpace();
+      if (_cursor < _end && *_cursor == ',') {
+        _cursor++;
+      } else if (_cursor < _end && *_cursor == '}') {
+        _cursor++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+  }
+  if (c == '[') {
+    value.type = JsonValue::arrayType;
+    _cursor++;
+    skipSpace();
+    if (_cursor < _end && *_cursor == ']') {
+      _cursor++;
+      return true;
+    }
+    while (true) {
+      value.items.emplace_back();
+      if (!parseValue(value.items.back())) {
+        return false;
+      }
+      skipSpace();
+      if (_cursor < _end && *_cursor == ',') {
+        _cursor++;
+      } else if (_cursor < _end && *_cursor == ']') {
+        _cursor++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+  }
+  if (c == '"') {
+    value.type = JsonValue::stringType;
+    return parseString(value.text);
+  }
+  if (_end - _cursor >= 4 && strncmp(_cursor, "null", 4) == 0) {
+    value.type = JsonValue::nullType;
+    _cursor += 4;
+    return true;
+  }
+  if (_end - _cursor >= 4 && strncmp(_cursor, "true", 4) == 0) {
+    value.type = JsonValue::boolType;
+    value.number = 1;
+    _cursor += 4;
+    return true;
+  }
+  if (_end - _cursor >= 5 && strncmp(_cursor, "false", 5) == 0) {
+    value.type = JsonValue::boolType;
+    _cursor += 5;
+    return true;
+  }
+  char *numberEnd;
+  value.type = JsonValue::numberType;
+  value.number = strtod(_cursor, &numberEnd);
+  if (numberEnd == _cursor) {
+    return false;
+  }
+  _cursor = numberEnd;
+  return true;
+}
+
+DBEntry::DBEntry()
+  : hardiness{}, lightReq{}, waterReq{} {
+  id = 0;
+}
+
+// Locate each element of the top-level "plants" array without parsing it, so elements can be parsed in parallel
+static bool splitPlants(const std::string &json, std::vector<std::pair<size_t, size_t>> &spans) {
+  size_t position = json.find("\"plants\"");
+  position = (position == std::string::npos) ? std::string::npos : json.find('[', position);
+  if (position == std::string::npos) {
+    return false;
+  }
+  int depth = 0;
+  bool inString = false;
+  size_t start = 0;
+  for (size_t i = position + 1; i < json.size(); i++) {
+    char c = json[i];
+    if (inString) {
+      if (c == '\\') {
+        i++;
+      } else if (c == '"') {
+        inString = false;
+      }
+      continue;
+    }
+    if (c == '"') {
+      inString = true;
+    } else if (c == '{' || c == '[') {
+      if (depth++ == 0) {
+        start = i;
+      }
+    } else if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return true;  // End of the plants array
+      }
+      if (--depth == 0) {
+        spans.emplace_back(start, i + 1);
+      }
+    }
+  }
+  return false;
+}
+
+// Case-insensitive substring test
+static bool containsWord(const std::string &text, const char *word) {
+  std::string lowerText = text;
+  std::string lowerWord = word;
+  std::transform(lowerText.begin(), lowerText.end(), lowerText.begin(), ::tolower);
+  std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower);
+  return lowerText.find(lowerWord) != std::string::npos;
+}
+
+// Collect the codes of a requirement value into a sorted list. Numbers are taken as-is, text is split on commas
+// and each part mapped with the given function (0 = unrecognized)
+static std::vector<int> requirementCodes(const JsonValue &value, int (*mapText)(const std::string &)) {
+  std::vector<int> codes;
+  std::vector<const JsonValue *> parts;
+  if (value.type == JsonValue::arrayType) {
+    for (const JsonValue &item : value.items) {
+      parts.push_back(&item);
+    }
+  } else {
+    parts.push_back(&value);
+  }
+  for (const JsonValue *part : parts) {
+    if (part->type == JsonValue::numberType) {
+      codes.push_back((int)part->number);
+    } else if (part->type == JsonValue::stringType) {
+      std::stringstream stream(part->text);
+      std::string piece;
+      while (std::getline(stream, piece, ',')) {
+        int code = mapText(piece);
+        if (code > 0) {
+          codes.push_back(code);
+        }
+      }
+    }
+  }
+  std::sort(codes.begin(), codes.end());
+  codes.erase(std::unique(codes.begin(), codes.end()), codes.end());
+  return codes;
+}
+
+// "Full sun", "Partial sun/shade", "Full shade"
+static int mapLight(const std::string &text) {
+  if (containsWord(text, "partial") || containsWord(text, "part ")) {
+    return partialSun;
+  }
+  if (containsWord(text, "shade")) {
+    return fullShade;
+  }
+  if (containsWord(text, "sun")) {
+    return fullSun;
+  }
+  return 0;
+}
+
+// "Water"/"Aquatic", "Wet", "Moist", "Dry"
+static int mapWater(const std::string &text) {
+  if (containsWord(text, "dry")) {
+    return dry;
+  }
+  if (containsWord(text, "moist")) {
+    return moist;
+  }
+  if (containsWord(text, "wet")) {
+    return wet;
+  }
+  if (containsWord(text, "water") || containsWord(text, "aquatic")) {
+    return water;
+  }
+  return 0;
+}
+
+// Hardiness text such as "3-9" or "3a-9b" holds the zones as numbers; letters and separators are dropped
+static std::vector<int> hardinessCodes(const JsonValue &value) {
+  std::vector<int> zones;
+  std::vector<const JsonValue *> parts;
+  if (value.type == JsonValue::arrayType) {
+    for (const JsonValue &item : value.items) {
+      parts.push_back(&item);
+    }
+  } else {
+    parts.push_back(&value);
+  }
+  for (const JsonValue *part : parts) {
+    if (part->type == JsonValue::numberType) {
+      zones.push_back((int)part->number);
+      continue;
+    }
+    const char *cursor = part->text.c_str();
+    while (*cursor) {
+      if (isdigit((unsigned char)*cursor)) {
+        char *end;
+        zones.push_back((int)strtol(cursor, &end, 10));
+        cursor = end;
+      } else {
+        cursor++;
+      }
+    }
+  }
+  std::sort(zones.begin(), zones.end());
+  return zones;
+}
+
+// Store a sorted code list as the device's [low, high] pair, high = 0 for a single code
+static void setRange(const std::vector<int> &codes, int range[2]) {
+  range[0] = codes.front();
+  range[1] = (codes.size() > 1) ? codes.back() : 0;
+}
+
+// Cut a UTF-8 string to fit a firmware buffer of the given size without splitting a character
+static std::string truncateUTF8(const std::string &text, size_t bufferSize) {
+  if (text.size() < bufferSize) {
+    return text;
+  }
+  size_t length = bufferSize - 1;
+  while (length > 0 && (text[length] & 0xC0) == 0x80) {
+    length--;
+  }
+  return text.substr(0, length);
+}
+
+// Find a data entry by key. Keys are matched case-insensitively on their leading words, so "Light requirement" and
+// "Light requirements" both match
+static const JsonValue *findData(const JsonValue &plant, const char *key) {
+  const JsonValue *data = plant.get("data");
+  if (!data || data->type != JsonValue::arrayType) {
+    return nullptr;
+  }
+  for (const JsonValue &item : data->items) {
+    const JsonValue *itemKey = item.get("key");
+    if (itemKey && itemKey->type == JsonValue::stringType && containsWord(itemKey->text, key)) {
+      return item.get("value");
+    }
+  }
+  return nullptr;
+}
+
+// Validate and normalize one exported plant
+static DBEntry normalizePlant(const char *begin, const char *end) {
+  DBEntry entry;
+  JsonValue plant;
+  JsonParser parser(begin, end);
+  if (!parser.parse(plant) || plant.type != JsonValue::objectType) {
+    entry.rejection = "malformed JSON";
+    return entry;
+  }
+  const JsonValue *id = plant.get("id");
+  const JsonValue *name = plant.get("name");
+  if (!id || id->type != JsonValue::numberType) {
+    entry.rejection = "missing id";
+    return entry;
+  }
+  entry.id = (long)id->number;
+  if (!name || name->type != JsonValue::stringType || name->text.empty()) {
+    entry.rejection = "missing name";
+    return entry;
+  }
+  entry.name = truncateUTF8(name->text, NUM_CHARS_NAME);
+  const JsonValue *scientificName = plant.get("scientific_name");
+  if (scientificName && scientificName->type == JsonValue::stringType) {
+    entry.scientificName = truncateUTF8(scientificName->text, NUM_CHARS_NAME);
+  }
+  const JsonValue *hardinessValue = findData(plant, "hardiness");
+  const JsonValue *lightValue = findData(plant, "light requirement");
+  const JsonValue *waterValue = findData(plant, "water requirement");
+  std::vector<int> hardiness = hardinessValue ? hardinessCodes(*hardinessValue) : std::vector<int>();
+  std::vector<int> lightReq = lightValue ? requirementCodes(*lightValue, mapLight) : std::vector<int>();
+  std::vector<int> waterReq = waterValue ? requirementCodes(*waterValue, mapWater) : std::vector<int>();
+  if (hardiness.empty() || hardiness.front() < 1 || hardiness.back() > 13) {
+    entry.rejection = "missing or invalid hardiness";
+    return entry;
+  }
+  if (lightReq.empty() || lightReq.front() < fullShade || lightReq.back() > fullSun) {
+    entry.rejection = "missing or invalid light requirement";
+    return entry;
+  }
+  if (waterReq.empty() || waterReq.front() < water || waterReq.back() > dry) {
+    entry.rejection = "missing or invalid water requirement";
+    return entry;
+  }
+  setRange(hardiness, entry.hardiness);
+  setRange(lightReq, entry.lightReq);
+  setRange(waterReq, entry.waterReq);
+  const JsonValue *fact = plant.get("cultivation_fact");
+  if (fact && fact->type == JsonValue::stringType && !fact->text.empty()) {
+    entry.fact = truncateUTF8(fact->text, NUM_CHARS_FACT);
+  } else {
+    for (const char *factKey : factKeys) {
+      const JsonValue *factValue = findData(plant, factKey);
+      if (factValue && factValue->type == JsonValue::stringType && !factValue->text.empty()) {
+        entry.fact = truncateUTF8(std::string(factKey) + ": " + factValue->text, NUM_CHARS_FACT);
+        break;
+      }
+    }
+  }
+  return entry;
+}
+
+// Quote a string for the output file
+static std::string quote(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if ((unsigned char)c < 0x20) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      quoted += escape;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// One plant in the device layout
+static std::string formatRange(const int range[2]) {
+  return (range[1] != 0) ? "[" + std::to_string(range[0]) + "," + std::to_string(range[1]) + "]" : "[" + std::to_string(range[0]) + "]";
+}
+
+static std::string formatEntry(const DBEntry &entry) {
+  return "{\"id\":" + std::to_string(entry.id) + ",\"name\":" + quote(entry.name) +
+         ",\"data\":[{\"key\":\"USDA Hardiness zone\",\"value\":" + formatRange(entry.hardiness) +
+         "},{\"key\":\"Light requirement\",\"value\":" + formatRange(entry.lightReq) +
+         "},{\"key\":\"Water requirement\",\"value\":" + formatRange(entry.waterReq) +
+         "}],\"scientific_name\":" + quote(entry.scientificName) + ",\"cultivation_fact\":" + quote(entry.fact) + "}";
+}
+
+/*--------------------------------------------------------------- Main ---------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  if (argc != 3 && !(argc == 5 && strcmp(argv[3], "--threads") == 0)) {
+    std::cerr << "usage: build_plant_db <export.json> <plantDB.txt> [--threads <n>]\n";
+    return 1;
+  }
+  int numThreads = (argc == 5) ? std::max(1, atoi(argv[4])) : std::max(1u, std::thread::hardware_concurrency());
+  auto startTime = std::chrono::steady_clock::now();
+  std::ifstream input(argv[1], std::ios::binary);
+  if (!input) {
+    std::cerr << "cannot open " << argv[1] << "\n";
+    return 1;
+  }
+  std::stringstream buffer;
+  buffer << input.rdbuf();
+  std::string json = buffer.str();
+  std::vector<std::pair<size_t, size_t>> spans;
+  if (!splitPlants(json, spans)) {
+    std::cerr << "no \"plants\" array found\n";
+    return 1;
+  }
+
+  // Each worker normalizes a contiguous slice of the plants, keeping export order
+  std::vector<DBEntry> entries(spans.size());
+  std::vector<std::thread> workers;
+  size_t sliceSize = (spans.size() + numThreads - 1) / numThreads;
+  for (int t = 0; t < numThreads; t++) {
+    workers.emplace_back([&, t]() {
+      size_t sliceEnd = std::min(spans.size(), (t + 1) * sliceSize);
+      for (size_t i = t * sliceSize; i < sliceEnd; i++) {
+        entries[i] = normalizePlant(json.data() + spans[i].first, json.data() + spans[i].second);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  // Duplicate IDs keep the first occurrence
+  std::set<long> seenIDs;
+  std::map<std::string, int> rejections;
+  std::ofstream output(argv[2], std::ios::binary | std::ios::trunc);
+  if (!output) {
+    std::cerr << "cannot open " << argv[2] << "\n";
+    return 1;
+  }
+  output << "{\"plants\":[";
+  int numWritten = 0;
+  for (DBEntry &entry : entries) {
+    if (entry.rejection.empty() && !seenIDs.insert(entry.id).second) {
+      entry.rejection = "duplicate id";
+    }
+    if (!entry.rejection.empty()) {
+      rejections[entry.rejection]++;
+      continue;
+    }
+    output << (numWritten++ ? ",\n" : "\n") << formatEntry(entry);
+  }
+  output << "\n]}";
+  output.close();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  fprintf(stderr, "%d of %zu plants written in %.3f s (%d threads), set numDBPlants to %d\n", numWritten, entries.size(),
+          seconds, numThreads, numWritten);
+  for (const auto &rejection : rejections) {
+    fprintf(stderr, "  dropped %d: %s\n", rejection.second, rejection.first.c_str());
+  }
+  return 0;
+}
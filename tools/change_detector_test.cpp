@@ -0,0 +1,329 @@
+/*
+  Plant-Saver event detector test
+
+  Feeds synthetic soil moisture and light traces through the ChangeDetector of PlantSaverModels.cpp, one reading per sampling
+  period, with the drift & threshold settings and the handling of Container::detectEvents(). Soil traces dry back towards a
+  dry level along an exponential curve with sensor noise added and are watered at random times by random amounts, soaking in
+  over a few minutes. Light traces are runs of days with a daylight curve, passing clouds that dim it, and indoor lamps
+  switched on and off after dark on some evenings. Each detected event is matched against the true waterings, lamp switches,
+  sunrises and sunsets, and the missed and false events are reported along with the median detection delay. Sunrises and
+  sunsets are counted apart from the steps, since a slow dawn in a dim spot read every minute is too gentle to detect.
+  Exits with status 1 if a step is missed, an event is falsely detected or too few sunrises & sunsets are found, so it can be
+  used as a check.
+
+  Build: g++ -std=c++17 -O2 change_detector_test.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o change_detector_test
+
+  Usage: change_detector_test [options]
+    --days <n>             Days per trace (default 90)
+    --soil-period-m <list> Comma separated minutes between soil readings (default 1,5,30,60)
+    --tau-h <list>         Comma separated drying time constants, hours (default 24,96)
+    --noise <list>         Comma separated soil sensor noise standard deviations, ADC counts (default 0,30). Noise well
+                           above WATER_CUSUM_DRIFT is expected to raise false waterings
+    --min-drop <n>         Smallest watering, ADC counts (default 500)
+    --soak-m <n>           Minutes a watering takes to soak in (default 10)
+    --light-period-m <list> Comma separated minutes between light readings (default 1,5,15)
+    --peak-lux <list>      Comma separated daylight peaks, one trace each (default 200,5000,50000)
+    --lamp-lux <n>         Level under the indoor lamps (default 300)
+    --cloud-dim <n>        Clouds dim the daylight by up to this factor (default 3)
+    --window-m <n>         Detections this close to a true event match it (default 90)
+    --min-daylight <pct>   Share of sunrises & sunsets that must be found (default 95)
+    --seed <n>             Seed for waterings, clouds, lamps and noise (default 1)
+*/
+
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*--------------------------------------------------------------- Options ---------------------------------------------------------------*/
+
+struct Options {
+  double days = 60;
+  std::vector<double> soilPeriodM = { 1, 5, 30, 60 };
+  std::vector<double> tauH = { 24, 96 };
+  std::vector<double> noise = { 0, 30 };
+  double minDrop = 500;
+  double soakM = 10;
+  std::vector<double> lightPeriodM = { 1, 5, 15 };
+  std::vector<double> peakLux = { 200, 5000, 50000 };
+  double lampLux = 300;
+  double cloudDim = 3;
+  double windowM = 90;
+  double minDaylight = 95;
+  unsigned seed = 1;
+};
+
+static std::vector<double> parseList(const char* text) {
+  std::vector<double> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--days")) {
+      options.days = atof(value);
+    } else if (!strcmp(name, "--soil-period-m")) {
+      options.soilPeriodM = parseList(value);
+    } else if (!strcmp(name, "--tau-h")) {
+      options.tauH = parseList(value);
+    } else if (!strcmp(name, "--noise")) {
+      options.noise = parseList(value);
+    } else if (!strcmp(name, "--min-drop")) {
+      options.minDrop = atof(value);
+    } else if (!strcmp(name, "--soak-m")) {
+      options.soakM = atof(value);
+    } else if (!strcmp(name, "--light-period-m")) {
+      options.lightPeriodM = parseList(value);
+    } else if (!strcmp(name, "--peak-lux")) {
+      options.peakLux = parseList(value);
+    } else if (!strcmp(name, "--lamp-lux")) {
+      options.lampLux = atof(value);
+    } else if (!strcmp(name, "--cloud-dim")) {
+      options.cloudDim = atof(value);
+    } else if (!strcmp(name, "--window-m")) {
+      options.windowM = atof(value);
+    } else if (!strcmp(name, "--min-daylight")) {
+      options.minDaylight = atof(value);
+    } else if (!strcmp(name, "--seed")) {
+      options.seed = atoi(value);
+    } else {
+      return false;
+    }
+  }
+  for (double periodM : options.soilPeriodM) {
+    if (periodM <= 0) {
+      return false;
+    }
+  }
+  for (double periodM : options.lightPeriodM) {
+    if (periodM <= 0) {
+      return false;
+    }
+  }
+  return options.days > 0 && options.minDrop > 0 && options.soakM >= 0 && options.windowM > 0 && options.cloudDim >= 1 && !options.soilPeriodM.empty() &&
+         !options.tauH.empty() && !options.noise.empty() && !options.lightPeriodM.empty() && !options.peakLux.empty();
+}
+
+/*--------------------------------------------------------------- Scoring ---------------------------------------------------------------*/
+
+// A true or detected event: time in minutes and direction, +1 up (lights on) or -1 down (watering, lights off).
+// Gradual events (sunrise & sunset) are scored apart, a slow dawn in a dim spot may be too gentle to count as a step
+struct Event {
+  double timeM;
+  int direction;
+  bool gradual;
+};
+
+struct Score {
+  int events = 0;
+  int missed = 0;
+  int gradualEvents = 0;
+  int gradualMissed = 0;
+  int falseEvents = 0;
+  std::vector<double> delaysM;
+};
+
+// Match each detection to the earliest unmatched true event of the same direction within the window
+static Score scoreEvents(const std::vector<Event>& truth, const std::vector<Event>& detected, double windowM) {
+  Score score;
+  score.events = truth.size();
+  std::vector<bool> matched(truth.size(), false);
+  for (const Event& detection : detected) {
+    bool found = false;
+    for (size_t i = 0; i < truth.size() && !found; i++) {
+      if (!matched[i] && truth[i].direction == detection.direction && fabs(detection.timeM - truth[i].timeM) <= windowM) {
+        matched[i] = true;
+        found = true;
+        score.delaysM.push_back(detection.timeM - truth[i].timeM);
+      }
+    }
+    score.falseEvents += !found;
+  }
+  for (size_t i = 0; i < truth.size(); i++) {
+    if (truth[i].gradual) {
+      score.gradualEvents++;
+      score.gradualMissed += !matched[i];
+    } else {
+      score.missed += !matched[i];
+    }
+  }
+  score.events -= score.gradualEvents;
+  return score;
+}
+
+static double median(std::vector<double> values) {
+  if (values.empty()) {
+    return NAN;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+  return values[values.size() / 2];
+}
+
+static void printScore(const char* label, const Score& score) {
+  char gradual[32] = "-";
+  if (score.gradualEvents > 0) {
+    snprintf(gradual, sizeof(gradual), "%i/%i", score.gradualEvents - score.gradualMissed, score.gradualEvents);
+  }
+  printf("  %-34s %6i %7i %9s %6i %11.0f\n", label, score.events, score.missed, gradual, score.falseEvents, median(score.delaysM));
+}
+
+// Whether a trace passes: every step found, nothing false, and enough of the sunrises & sunsets
+static bool passes(const Score& score, double minGradual) {
+  return score.missed == 0 && score.falseEvents == 0 &&
+         (score.gradualEvents == 0 || 100.0 * (score.gradualEvents - score.gradualMissed) / score.gradualEvents >= minGradual);
+}
+
+/*------------------------------------------------------------- Soil Traces -------------------------------------------------------------*/
+
+#define SOIL_WET 1200  // Reading of soaked soil, ADC counts
+#define SOIL_DRY 3300  // Level the soil dries towards
+
+// Soil that dries back after each watering and is watered again once it has passed 2300 counts, the top of the moist band,
+// or earlier at random but at least 12 hours after the last. Each watering lowers the reading by at least minDrop, down to the
+// wet level at most
+static Score runSoilTrace(const Options& options, double periodM, double tauH, double noise, std::mt19937& random) {
+  std::normal_distribution<double> sensorNoise(0, 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  ChangeDetector detector;
+  std::vector<Event> truth;
+  std::vector<Event> detected;
+  double level = SOIL_DRY - 200;
+  double soakFrom = 0;  // Reading before the watering soaking in & its depth
+  double soakDepth = 0;
+  double soakStartM = -1e9;
+  double nextWateringM = 60 * tauH * uniform(random);
+  for (double timeM = 0; timeM < options.days * 1440 + options.windowM; timeM += periodM) {  // Run on to see the last watering
+    if (timeM >= nextWateringM && timeM < options.days * 1440) {
+      double depth = options.minDrop + uniform(random) * std::max(0.0, level - SOIL_WET - options.minDrop);
+      soakFrom = level;
+      soakDepth = std::min(depth, level - SOIL_WET);
+      soakStartM = timeM;
+      truth.push_back({ timeM, -1, false });
+      double crossingH = tauH * log((SOIL_DRY - (level - soakDepth)) / (SOIL_DRY - 2300.0));
+      nextWateringM = timeM + 60 * std::max(12.0, crossingH * (0.5 + uniform(random)));
+    }
+    double soaked = (options.soakM > 0) ? std::min(1.0, (timeM - soakStartM) / options.soakM) : 1;
+    if (soaked < 1) {
+      level = soakFrom - soakDepth * soaked;
+    } else if (soakDepth > 0) {
+      level = soakFrom - soakDepth;
+      soakDepth = 0;
+    }
+    level = SOIL_DRY - (SOIL_DRY - level) * exp(-periodM / 60 / tauH);
+    float reading = level + noise * sensorNoise(random);
+    if (detector.add(reading, WATER_CUSUM_DRIFT, WATER_CUSUM_THRESHOLD) < 0) {  // Only drops are waterings
+      detected.push_back({ timeM, -1, false });
+    }
+  }
+  return scoreEvents(truth, detected, options.windowM);
+}
+
+/*------------------------------------------------------------- Light Traces ------------------------------------------------------------*/
+
+#define SUNRISE_H 6
+#define SUNSET_H 20
+
+// Days of daylight from SUNRISE_H to SUNSET_H, dimmed by passing clouds, and on half of the evenings a lamp switched on 1-3 hours
+// after sunset and off before midnight. True events are sunrise & sunset and the lamp switching on & off. Clouds are not events
+static Score runLightTrace(const Options& options, double periodM, double peakLux, std::mt19937& random) {
+  std::normal_distribution<double> sensorNoise(0, 1);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  ChangeDetector detector;
+  std::vector<Event> truth;
+  std::vector<Event> detected;
+  std::vector<std::pair<double, double>> clouds;  // Start & end minute of each cloud
+  std::vector<double> cloudFactor;
+  std::vector<std::pair<double, double>> lamps;  // On & off minute of each lamp
+  for (int day = 0; day < options.days; day++) {
+    truth.push_back({ day * 1440 + 60.0 * SUNRISE_H, 1, true });
+    truth.push_back({ day * 1440 + 60.0 * SUNSET_H, -1, true });
+    for (int i = 0; i < 6; i++) {
+      double startM = day * 1440 + 60 * (SUNRISE_H + uniform(random) * (SUNSET_H - SUNRISE_H));
+      clouds.push_back({ startM, startM + 5 + 40 * uniform(random) });
+      cloudFactor.push_back(1 - (1 - 1 / options.cloudDim) * uniform(random));
+    }
+    if (uniform(random) < 0.5) {
+      lamps.push_back({ day * 1440 + 60 * (SUNSET_H + 1 + 2 * uniform(random)), day * 1440 + 60 * 23.5 });
+      truth.push_back({ lamps.back().first, 1, false });
+      truth.push_back({ lamps.back().second, -1, false });
+    }
+  }
+  int lastShift = 0;
+  for (double timeM = 0; timeM < options.days * 1440 + options.windowM; timeM += periodM) {
+    double hour = fmod(timeM / 60, 24);
+    double lux = (hour > SUNRISE_H && hour < SUNSET_H) ? peakLux * sin((hour - SUNRISE_H) / (SUNSET_H - SUNRISE_H) * M_PI) : 0;
+    double dimming = 1;  // Overlapping clouds dim as much as the densest of them
+    for (size_t i = 0; i < clouds.size(); i++) {
+      if (timeM >= clouds[i].first && timeM < clouds[i].second) {
+        dimming = std::min(dimming, cloudFactor[i]);
+      }
+    }
+    lux *= dimming;
+    for (const auto& lamp : lamps) {
+      if (timeM >= lamp.first && timeM < lamp.second) {
+        lux += options.lampLux;
+      }
+    }
+    float reading = std::max(0.0, lux * (1 + 0.02 * sensorNoise(random)) + 0.5 * sensorNoise(random));
+    int shift = detector.add(log10f(reading + 1), LIGHT_CUSUM_DRIFT, LIGHT_CUSUM_THRESHOLD);  // As in Container::detectEvents()
+    if (shift != 0 && shift != lastShift) {
+      detected.push_back({ timeM, shift, false });
+    }
+    lastShift = (shift != 0) ? shift : lastShift;
+  }
+  return scoreEvents(truth, detected, options.windowM);
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: change_detector_test [--days n] [--soil-period-m list] [--tau-h list] [--noise list] [--min-drop n]\n"
+                    "                            [--soak-m n] [--light-period-m list] [--peak-lux list] [--lamp-lux n]\n"
+                    "                            [--cloud-dim n] [--window-m n] [--min-daylight pct] [--seed n]\n");
+    return 2;
+  }
+  bool failed = false;
+  printf("  %-34s %6s %7s %9s %6s %11s\n", "trace", "steps", "missed", "sun found", "false", "delay min");
+  for (double periodM : options.soilPeriodM) {
+    for (double tauH : options.tauH) {
+      for (double noise : options.noise) {
+        std::mt19937 random(options.seed);
+        Score score = runSoilTrace(options, periodM, tauH, noise, random);
+        char label[64];
+        snprintf(label, sizeof(label), "soil %gm, tau %gh, noise %g", periodM, tauH, noise);
+        printScore(label, score);
+        failed = failed || !passes(score, options.minDaylight);
+      }
+    }
+  }
+  for (double periodM : options.lightPeriodM) {
+    for (double peakLux : options.peakLux) {
+      std::mt19937 random(options.seed);
+      Score score = runLightTrace(options, periodM, peakLux, random);
+      char label[64];
+      snprintf(label, sizeof(label), "light %gm, peak %g lux", periodM, peakLux);
+      printScore(label, score);
+      failed = failed || !passes(score, options.minDaylight);
+    }
+  }
+  printf("%s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}
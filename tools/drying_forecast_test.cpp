@@ -0,0 +1,238 @@
+/*
+  Plant-Saver next-watering forecast test
+
+  Generates synthetic soil drying traces and feeds them through the watering detector and the DryingForecast of
+  PlantSaverModels.cpp, one reading per sampling period. Each trace is watered down to a wet level, dries back towards its
+  dry level along an exponential curve with sensor noise added, and is watered again some time after crossing the plant's dry
+  bound. Every forecast made is compared with the true (noise free) crossing time and the errors are reported by how far
+  ahead the forecast was, for the firmware's exponential extrapolation and for a straight line along the local trend.
+  Exits with status 1 if a watering is missed or the error limit is exceeded, so it can be used as a check.
+
+  Build: g++ -std=c++17 -O2 drying_forecast_test.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o drying_forecast_test
+
+  Usage: drying_forecast_test [options]
+    --tau-h <list>        Comma separated drying time constants, hours (default 24,48,96)
+    --noise <list>        Comma separated sensor noise standard deviations, ADC counts (default 0,30)
+    --period-m <n>        Minutes between soil readings (default 30)
+    --wet <n>             Reading just after watering, ADC counts (default 1200)
+    --dry <n>             Level the soil dries towards, ADC counts (default 3300)
+    --threshold <n>       Plant's dry bound, ADC counts (default 2300, the top of the moist band)
+    --cycles <n>          Waterings per trace (default 5)
+    --seed <n>            Noise seed (default 1)
+    --max-error <pct>     Fail if the median error of the firmware's forecasts 6-48 h ahead exceeds this share of the time left
+                          (default 30)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+
+/*----------------------------------------------------------- Linear Baseline -----------------------------------------------------------*/
+
+// Straight line along the firmware's local trend, to show what the exponential extrapolation gains. Only made when the
+// firmware makes a forecast, so both are compared on the same readings
+static float linearHoursUntil(DryingForecast& forecast, float level, unsigned long now) {
+  float firmwareH = forecast.hoursUntil(level, now);
+  if (std::isnan(firmwareH) || firmwareH == 0) {
+    return firmwareH;
+  }
+  float slope = forecast.covTY / forecast.varT;
+  float fitted = forecast.meanY + slope * ((forecast.lastTime - forecast.startTime) / 3600.0 - forecast.meanT);
+  float hours = (level - fitted) / slope - (now - forecast.lastTime) / 3600.0;
+  if (hours > FORECAST_MAX_H) {
+    return NAN;
+  }
+  return (hours > 0) ? hours : 0;
+}
+
+/*--------------------------------------------------------------- Options ---------------------------------------------------------------*/
+
+struct Options {
+  std::vector<double> tauH = { 24, 48, 96 };
+  std::vector<double> noise = { 0, 30 };
+  double periodM = 30;
+  double wet = 1200;
+  double dry = 3300;
+  double threshold = 2300;
+  int cycles = 5;
+  unsigned seed = 1;
+  double maxError = 30;
+};
+
+static std::vector<double> parseList(const char* text) {
+  std::vector<double> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--tau-h")) {
+      options.tauH = parseList(value);
+    } else if (!strcmp(name, "--noise")) {
+      options.noise = parseList(value);
+    } else if (!strcmp(name, "--period-m")) {
+      options.periodM = atof(value);
+    } else if (!strcmp(name, "--wet")) {
+      options.wet = atof(value);
+    } else if (!strcmp(name, "--dry")) {
+      options.dry = atof(value);
+    } else if (!strcmp(name, "--threshold")) {
+      options.threshold = atof(value);
+    } else if (!strcmp(name, "--cycles")) {
+      options.cycles = atoi(value);
+    } else if (!strcmp(name, "--seed")) {
+      options.seed = atoi(value);
+    } else if (!strcmp(name, "--max-error")) {
+      options.maxError = atof(value);
+    } else {
+      return false;
+    }
+  }
+  return options.periodM > 0 && options.cycles > 0 && options.threshold > options.wet && options.threshold < options.dry &&
+         !options.tauH.empty() && !options.noise.empty();
+}
+
+/*-------------------------------------------------------------- Simulation -------------------------------------------------------------*/
+
+// Forecasts grouped by how far ahead of the true crossing they were made
+#define NUM_LEADS 5
+static const double leadEdgesH[NUM_LEADS + 1] = { 0, 6, 12, 24, 48, 1e9 };
+static const char* leadLabels[NUM_LEADS] = { "<6h", "6-12h", "12-24h", "24-48h", ">48h" };
+
+struct Results {
+  std::vector<double> absError[NUM_LEADS];  // Hours
+  std::vector<double> relError[NUM_LEADS];  // Share of the lead time
+  double signedSum[NUM_LEADS] = { 0 };
+  long possible = 0;  // Readings taken before a crossing, each could have produced a forecast
+  long made = 0;
+  int missedWaterings = 0;
+};
+
+// Run one trace. The soil starts dry, is watered at t = 0 and again once it has been past the dry bound for a day
+static void runTrace(const Options& options, double tauH, double noise, bool linear, std::mt19937& rng, Results& results) {
+  std::normal_distribution<double> sensorNoise(0, noise > 0 ? noise : 1);
+  ChangeDetector detector;
+  DryingForecast forecast;
+  const unsigned long periodS = options.periodM * 60;
+  const double crossingH = tauH * log((options.dry - options.wet) / (options.dry - options.threshold));  // After each watering
+  unsigned long now = 1700000000;  // Any epoch time, the forecast only uses differences
+  for (int i = 0; i < 4; i++) {  // Dry soil before the first watering
+    detector.add(options.dry, WATER_CUSUM_DRIFT, WATER_CUSUM_THRESHOLD);
+    forecast.add(options.dry, now);
+    now += periodS;
+  }
+  for (int cycle = 0; cycle < options.cycles; cycle++) {
+    unsigned long wateredAt = now;
+    bool detected = false;
+    for (double h = 0; h < crossingH + 24; h = (now - wateredAt) / 3600.0) {
+      double truth = options.dry - (options.dry - options.wet) * exp(-h / tauH);
+      float reading = truth + (noise > 0 ? sensorNoise(rng) : 0);
+      if (detector.add(reading, WATER_CUSUM_DRIFT, WATER_CUSUM_THRESHOLD) < 0) {  // As in Container::detectEvents()
+        forecast = DryingForecast();
+        detected = true;
+      }
+      forecast.add(reading, now);
+      double remainingH = crossingH - h;
+      if (remainingH > 0) {
+        results.possible++;
+        float predictedH = linear ? linearHoursUntil(forecast, options.threshold, now) : forecast.hoursUntil(options.threshold, now);
+        if (!std::isnan(predictedH)) {
+          results.made++;
+          int lead = 0;
+          while (remainingH >= leadEdgesH[lead + 1]) {
+            lead++;
+          }
+          double error = predictedH - remainingH;
+          results.absError[lead].push_back(fabs(error));
+          results.relError[lead].push_back(fabs(error) / remainingH);
+          results.signedSum[lead] += error;
+        }
+      }
+      now += periodS;
+    }
+    if (!detected) {
+      results.missedWaterings++;
+    }
+  }
+}
+
+static double median(std::vector<double> values) {
+  if (values.empty()) {
+    return NAN;
+  }
+  std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+  return values[values.size() / 2];
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: drying_forecast_test [--tau-h list] [--noise list] [--period-m n] [--wet n] [--dry n] [--threshold n]\n"
+                    "                            [--cycles n] [--seed n] [--max-error pct]\n");
+    return 2;
+  }
+  bool failed = false;
+  printf("%-6s %-6s %-12s %-9s", "tau h", "noise", "model", "coverage");
+  for (int lead = 0; lead < NUM_LEADS; lead++) {
+    printf(" %18s", leadLabels[lead]);
+  }
+  printf("\n");
+  for (double tauH : options.tauH) {
+    for (double noise : options.noise) {
+      for (int linear = 0; linear < 2; linear++) {
+        std::mt19937 rng(options.seed);  // Both models see the same trace
+        Results results;
+        runTrace(options, tauH, noise, linear, rng, results);
+        printf("%-6.0f %-6.0f %-12s %8.0f%%", tauH, noise, linear ? "linear" : "exponential", 100.0 * results.made / results.possible);
+        for (int lead = 0; lead < NUM_LEADS; lead++) {
+          if (results.absError[lead].empty()) {
+            printf(" %18s", "-");
+            continue;
+          }
+          char cell[32];
+          snprintf(cell, sizeof(cell), "%.1fh %+.1f %.0f%%", median(results.absError[lead]),
+                   results.signedSum[lead] / results.absError[lead].size(), 100 * median(results.relError[lead]));
+          printf(" %18s", cell);
+        }
+        printf("\n");
+        if (linear) {
+          continue;  // Only the firmware's model is checked
+        }
+        std::vector<double> checked;
+        for (int lead = 1; lead <= 3; lead++) {  // 6-48 h ahead, the range the menu is read for
+          checked.insert(checked.end(), results.relError[lead].begin(), results.relError[lead].end());
+        }
+        if (results.missedWaterings > 0) {
+          printf("  %i watering(s) not detected\n", results.missedWaterings);
+          failed = true;
+        }
+        if (!checked.empty() && 100 * median(checked) > options.maxError) {
+          printf("  median error %.0f%% of time left exceeds %.0f%%\n", 100 * median(checked), options.maxError);
+          failed = true;
+        }
+      }
+    }
+  }
+  printf("Cells: median absolute error, mean signed error (+ = late) and median error as a share of the time left\n");
+  printf("%s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}
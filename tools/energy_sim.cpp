@@ -0,0 +1,632 @@
+/*
+  Plant-Saver energy simulator
+
+  Replays a recorded or synthetic sensor trace through the wake schedule of Plant_Saver_Fall_2025.ino and charges the
+  on-time of every peripheral against a current model, for many sampling/batching/display configurations at once.
+  Timer wakes append each reading to the sensor log and leave the storage files alone; every LOG_CHECKPOINT_RECORDS
+  readings, and on every button wake, the logged readings are patched into the sensor files in place and added to the
+  dates file, as the firmware does. Reports the average current, projected battery life and SD write volume of each
+  configuration as CSV. The detectors are the firmware's own (PlantSaverModels.cpp).
+
+  Build: g++ -std=c++17 -O2 -pthread energy_sim.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o energy_sim
+
+  Usage: energy_sim [options]
+    --trace <file>            Replay readings from a "timestamp,light,water,humidity,temp" CSV (the uplink.txt format)
+    --synthetic <days>        Generate a synthetic trace instead (default 14 days)
+    --model <file>            key=value overrides of the current/timing model (see CurrentModel for the keys)
+    --light-period <list>     Comma separated sampling periods to sweep, in minutes (likewise --water-period,
+                              --humidity-period, --temp-period)
+    --uplink-batch <list>     Readings per uplink to sweep, 0 disables the uplink
+    --display-timeout <list>  Display timeouts to sweep, in minutes
+    --display-wakes <n>       Button wakes per day (default 4)
+    --thresholds <l,w,h,t>    Trigger thresholds from header.txt, a reading above any of them fires the trigger pulse
+    --threads <n>             Worker threads (default: all cores)
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h and Plant_Saver_Fall_2025.ino
+#define NUM_CHANNELS 4
+#define MAX_SENSOR_READINGS 200
+#define DATE_LINE_LEN 23
+#define MAX_EVENTS 50
+#define WAKE_SLACK_S 2
+#define TRIG_PULSE_LEN_MS 2000
+#define UPLINK_PAYLOAD_BYTES 1480  // UPLINK_BUFFER_SIZE less the topic and MQTT header
+#define LOG_RECORD_SIZE 32
+#define LOG_RECORDS 1024
+#define LOG_CHECKPOINT_RECORDS 16
+
+#define SECTOR_BYTES 512
+#define LOG_RECORDS_PER_SECTOR (SECTOR_BYTES / LOG_RECORD_SIZE)
+#define SENSOR_FILE_PREFIX_BYTES 40  // {"startIndex":..,"numReadings":..,"readings":[ before the first value
+#define SECONDS_PER_DAY 86400
+
+/*------------------------------------------------------------ Class Definitions ----------------------------------------------------------*/
+
+// Current draw (mA) and timing (ms) of each peripheral and firmware step. Defaults are datasheet typicals for the
+// ESP32-WROOM, SSD1306, LTR390, AHT20 and a generic micro-SD card, and can be overridden with --model
+class CurrentModel {
+public:
+  CurrentModel();
+  bool set(const std::string &key, double value);
+  double cpuActiveMa;        // ESP32 running, radio off
+  double deepSleepMa;        // Whole board in deep sleep, peripherals gated off
+  double peripheralIdleMa;   // Sensors/display powered through V_GATE but idle
+  double displayMa;          // SSD1306 showing a menu
+  double ltr390Ma;           // LTR390 converting
+  double aht20Ma;            // AHT20 measuring
+  double sdIdleMa;           // SD card mounted, not writing
+  double sdWriteMa;          // SD card writing
+  double wifiMa;             // Radio on
+  double triggerLoadMa;      // External load on the trigger pin
+  double bootMs;             // Reset to loop(), including the 2 s serial delay in setup()
+  double ltr390ConvMs;       // One ALS conversion at the configured resolution
+  double aht20MeasureMs;
+  double sdInitMs;
+  double sdFileOpMs;         // Open/close/directory update per file touched
+  double sdReadKBps;
+  double sdWriteKBps;
+  double dbRankMs;           // getDBPlants() on the first display wake of a session
+  double wifiConnectMs;      // Wi-Fi association and MQTT connect
+  double publishMs;          // One batch published and echoed back
+  double batteryMah;
+  double batteryDerating;    // Usable fraction of the rated capacity
+  double bytesPerValue;      // Serialized size of one reading in a sensor file, separator included
+  double plantFileBytes;     // env.txt with stats and detectors
+  double headerFileBytes;
+  double uplinkLineBytes;    // One reading in the uplink queue
+  double eventBytes;         // One entry in events.txt
+};
+
+// Sampling, batching and display settings of one simulated deployment
+class SimConfig {
+public:
+  int periodM[NUM_CHANNELS];
+  int uplinkBatch;
+  int displayTimeoutM;
+};
+
+// Totals of one simulation run
+class SimResult {
+public:
+  SimResult();
+  double chargeMas;  // Charge drawn, in mA*s
+  double seconds;    // Simulated time
+  double sdBytes;    // Bytes written to the SD, rounded up to whole sectors per file write
+  long timerWakes;
+  long displayWakes;
+  long uplinks;
+  long checkpoints;
+  long events;
+};
+
+// One row of the replayed trace. NAN marks a missing reading
+class TraceRecord {
+public:
+  long time;  // Seconds since the epoch
+  float values[NUM_CHANNELS];
+};
+
+// What the card holds between wakes, as far as the cost of the next write depends on it
+class CardState {
+public:
+  CardState();
+  long fileReadings[NUM_CHANNELS];  // numReadings of each sensor file
+  long fileStart[NUM_CHANNELS];     // startIndex of each sensor file, the slot the next reading goes in
+  long dateLines;
+  long numEvents;
+  int uplinkPending;
+  unsigned long logNextSeq;         // Sequence number of the next log record
+  unsigned long logApplied;         // Last record folded into the storage files
+  std::vector<int> pendingMasks;    // Channels read by each logged reading not yet folded in
+  int pendingEvents;                // Events detected in those readings
+};
+
+/*---------------------------------------------------------- Function Definitions ---------------------------------------------------------*/
+
+CurrentModel::CurrentModel() {
+  cpuActiveMa = 45;
+  deepSleepMa = 0.15;
+  peripheralIdleMa = 0.5;
+  displayMa = 20;
+  ltr390Ma = 0.11;
+  aht20Ma = 0.98;
+  sdIdleMa = 1.5;
+  sdWriteMa = 60;
+  wifiMa = 120;
+  triggerLoadMa = 10;
+  bootMs = 2300;
+  ltr390ConvMs = 100;
+  aht20MeasureMs = 80;
+  sdInitMs = 30;
+  sdFileOpMs = 8;
+  sdReadKBps = 800;
+  sdWriteKBps = 300;
+  dbRankMs = 1500;
+  wifiConnectMs = 2500;
+  publishMs = 150;
+  batteryMah = 2000;
+  batteryDerating = 0.8;
+  bytesPerValue = 7;
+  plantFileBytes = 1900;
+  headerFileBytes = 450;
+  uplinkLineBytes = 45;
+  eventBytes = 75;
+}
+
+// Override one model parameter by name. Returns false for an unknown key
+bool CurrentModel::set(const std::string &key, double value) {
+  std::map<std::string, double *> fields = {
+    { "cpuActiveMa", &cpuActiveMa }, { "deepSleepMa", &deepSleepMa }, { "peripheralIdleMa", &peripheralIdleMa },
+    { "displayMa", &displayMa }, { "ltr390Ma", &ltr390Ma }, { "aht20Ma", &aht20Ma }, { "sdIdleMa", &sdIdleMa },
+    { "sdWriteMa", &sdWriteMa }, { "wifiMa", &wifiMa }, { "triggerLoadMa", &triggerLoadMa }, { "bootMs", &bootMs },
+    { "ltr390ConvMs", &ltr390ConvMs }, { "aht20MeasureMs", &aht20MeasureMs }, { "sdInitMs", &sdInitMs },
+    { "sdFileOpMs", &sdFileOpMs }, { "sdReadKBps", &sdReadKBps }, { "sdWriteKBps", &sdWriteKBps },
+    { "dbRankMs", &dbRankMs }, { "wifiConnectMs", &wifiConnectMs }, { "publishMs", &publishMs },
+    { "batteryMah", &batteryMah }, { "batteryDerating", &batteryDerating }, { "bytesPerValue", &bytesPerValue },
+    { "plantFileBytes", &plantFileBytes }, { "headerFileBytes", &headerFileBytes },
+    { "uplinkLineBytes", &uplinkLineBytes }, { "eventBytes", &eventBytes }
+  };
+  auto field = fields.find(key);
+  if (field == fields.end()) {
+    return false;
+  }
+  *field->second = value;
+  return true;
+}
+
+SimResult::SimResult() {
+  chargeMas = 0;
+  seconds = 0;
+  sdBytes = 0;
+  timerWakes = 0;
+  displayWakes = 0;
+  uplinks = 0;
+  checkpoints = 0;
+  events = 0;
+}
+
+CardState::CardState()
+  : fileReadings{}, fileStart{} {
+  dateLines = 0;
+  numEvents = 0;
+  uplinkPending = 0;
+  logNextSeq = 1;
+  logApplied = 0;
+  pendingEvents = 0;
+}
+
+// Days since 1970-01-01 of a civil date (proleptic Gregorian)
+static long daysFromCivil(long year, long month, long day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  long yearOfEra = year - era * 400;
+  long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+// Parse a firmware timestamp ("YYYY-MM-DD HH:MM:SS") into seconds since the epoch. Returns -1 if malformed
+static long parseTimeStamp(const char *timeStamp) {
+  int year, month, day, hour, minute, second;
+  if (sscanf(timeStamp, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) {
+    return -1;
+  }
+  return daysFromCivil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+}
+
+// Load a trace in the uplink queue format. Returns the records in time order
+static std::vector<TraceRecord> loadTrace(const char *fileName) {
+  std::vector<TraceRecord> trace;
+  std::ifstream file(fileName);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.size() < 20) {
+      continue;
+    }
+    TraceRecord record;
+    record.time = parseTimeStamp(line.c_str());
+    if (record.time < 0) {
+      continue;  // Header or batch line
+    }
+    std::stringstream fields(line.substr(20));
+    std::string field;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      record.values[i] = (std::getline(fields, field, ',') && field != "nan") ? strtof(field.c_str(), nullptr) : NAN;
+    }
+    trace.push_back(record);
+  }
+  std::sort(trace.begin(), trace.end(), [](const TraceRecord &a, const TraceRecord &b) {
+    return a.time < b.time;
+  });
+  return trace;
+}
+
+// Generate one reading per minute: diurnal light with passing clouds, soil drying over three days between waterings,
+// and humidity/temperature swinging with the day
+static std::vector<TraceRecord> syntheticTrace(int days) {
+  std::vector<TraceRecord> trace;
+  unsigned int seed = 1;
+  float water = 1200;
+  for (long minute = 0; minute < (long)days * 1440; minute++) {
+    seed = seed * 1103515245 + 12345;
+    float noise = ((seed >> 16) % 1000) / 1000.0f;
+    long minuteOfDay = minute % 1440;
+    double phase = 2 * M_PI * (minuteOfDay - 360) / 1440.0;
+    TraceRecord record;
+    record.time = daysFromCivil(2025, 11, 1) * SECONDS_PER_DAY + minute * 60;
+    record.values[lightFile] = (minuteOfDay >= 420 && minuteOfDay < 1140) ? 15000 * (0.5 + 0.5 * noise) * sin(phase) + 50 : 0;
+    water = (minute % (3 * 1440) == 0) ? 1200 : water + 1300.0f / (3 * 1440);
+    record.values[waterFile] = water + 40 * (noise - 0.5f);
+    record.values[humidityFile] = 50 - 10 * sin(phase) + 2 * noise;
+    record.values[tempFile] = 70 + 6 * sin(phase) + noise;
+    trace.push_back(record);
+  }
+  return trace;
+}
+
+// Charge for a file write and add its sector-rounded size to the write volume
+static void chargeFileWrite(const CurrentModel &model, SimResult &result, double bytes) {
+  double sectors = ceil(bytes / SECTOR_BYTES);
+  result.sdBytes += sectors * SECTOR_BYTES;
+  double writeS = model.sdFileOpMs / 1000 + sectors * SECTOR_BYTES / 1024 / model.sdWriteKBps;
+  result.chargeMas += writeS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdWriteMa);
+}
+
+// Charge for reading a whole file
+static void chargeFileRead(const CurrentModel &model, SimResult &result, double bytes) {
+  double readS = model.sdFileOpMs / 1000 + bytes / 1024 / model.sdReadKBps;
+  result.chargeMas += readS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdIdleMa);
+}
+
+// Charge for raw sector writes to the sensor log, which bypass the file system
+static void chargeSectorWrites(const CurrentModel &model, SimResult &result, int sectors) {
+  result.sdBytes += sectors * SECTOR_BYTES;
+  double writeS = sectors * SECTOR_BYTES / 1024.0 / model.sdWriteKBps;
+  result.chargeMas += writeS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdWriteMa);
+}
+
+// Charge for raw sector reads
+static void chargeSectorReads(const CurrentModel &model, SimResult &result, int sectors) {
+  double readS = sectors * SECTOR_BYTES / 1024.0 / model.sdReadKBps;
+  result.chargeMas += readS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdIdleMa);
+}
+
+// SensorFile::load() & save(): the file is read whole, then its header fields and the slots of the new readings are
+// patched in place. Every sector a patch falls in is read and written back by the file system. A growing file ends in
+// the new slots, so its rewritten tail is those slots as well
+static void chargeSensorUpdate(const CurrentModel &model, SimResult &result, CardState &card, int channel, int numNew) {
+  chargeFileRead(model, result, SENSOR_FILE_PREFIX_BYTES + card.fileReadings[channel] * model.bytesPerValue);
+  std::set<long> sectors = { 0 };  // startIndex & numReadings lead the file
+  for (int j = 0; j < numNew; j++) {
+    long slot = (card.fileStart[channel] + j) % MAX_SENSOR_READINGS;
+    sectors.insert((long)((SENSOR_FILE_PREFIX_BYTES + slot * model.bytesPerValue) / SECTOR_BYTES));
+  }
+  chargeSectorReads(model, result, sectors.size());
+  chargeFileWrite(model, result, sectors.size() * SECTOR_BYTES);
+  card.fileStart[channel] = (card.fileStart[channel] + numNew) % MAX_SENSOR_READINGS;
+  card.fileReadings[channel] = std::min<long>(card.fileReadings[channel] + numNew, MAX_SENSOR_READINGS);
+}
+
+// checkpointLog(): fold the logged readings into the storage files. bufferedSector is the log sector still in memory
+// from this wake's append, -1 if none
+static void chargeCheckpoint(const CurrentModel &model, SimResult &result, CardState &card, bool uplinkEnabled,
+                             long bufferedSector) {
+  int numBatch = card.pendingMasks.size();
+  if (numBatch == 0) {
+    return;
+  }
+  result.checkpoints++;
+  long loadedSector = bufferedSector;
+  for (unsigned long seq = card.logApplied + 1; seq < card.logNextSeq; seq++) {
+    long sector = (long)((seq - 1) % LOG_RECORDS / LOG_RECORDS_PER_SECTOR);
+    if (sector != loadedSector) {
+      chargeSectorReads(model, result, 1);
+      loadedSector = sector;
+    }
+  }
+  // updatePlantData(): each sensor file read in the batch is updated once
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    int numNew = 0;
+    for (int mask : card.pendingMasks) {
+      numNew += (mask >> i) & 1;
+    }
+    if (numNew > 0) {
+      chargeSensorUpdate(model, result, card, i, numNew);
+    }
+  }
+  // addTimeStamp(): dates file copied to a temporary file and back, once for the batch
+  card.dateLines = std::min<long>(card.dateLines + numBatch, MAX_SENSOR_READINGS);
+  double datesBytes = 20 + card.dateLines * DATE_LINE_LEN;
+  chargeFileRead(model, result, datesBytes);
+  chargeFileWrite(model, result, datesBytes);
+  chargeFileRead(model, result, datesBytes);
+  chargeFileWrite(model, result, datesBytes);
+  // detectEvents(): the event log is read and rewritten per event
+  for (int i = 0; i < card.pendingEvents; i++) {
+    card.numEvents = std::min<long>(card.numEvents + 1, MAX_EVENTS);
+    chargeFileRead(model, result, card.numEvents * model.eventBytes);
+    chargeFileWrite(model, result, card.numEvents * model.eventBytes);
+  }
+  if (uplinkEnabled) {
+    for (int i = 0; i < numBatch; i++) {
+      chargeFileWrite(model, result, model.uplinkLineBytes);
+    }
+    card.uplinkPending += numBatch;
+  }
+  card.logApplied = card.logNextSeq - 1;
+  card.pendingMasks.clear();
+  card.pendingEvents = 0;
+}
+
+// Replay the trace through the firmware's wake schedule with one configuration
+static SimResult simulate(const std::vector<TraceRecord> &trace, const SimConfig &config, const CurrentModel &model,
+                          int displayWakesPerDay, const float thresholds[NUM_CHANNELS]) {
+  SimResult result;
+  if (trace.size() < 2) {
+    return result;
+  }
+  long startTime = trace.front().time;
+  long endTime = trace.back().time;
+  long channelDue[NUM_CHANNELS];
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    channelDue[i] = startTime;
+  }
+  CardState card;
+  ChangeDetector waterDetector;
+  ChangeDetector lightDetector;
+  long displayInterval = (displayWakesPerDay > 0) ? SECONDS_PER_DAY / displayWakesPerDay : 0;
+  long nextDisplay = (displayInterval > 0) ? startTime + displayInterval / 2 : endTime + 1;
+  size_t traceIndex = 0;
+  double awakeS = 0;
+  long now = startTime;
+  while (now <= endTime) {
+    long nextDue = *std::min_element(channelDue, channelDue + NUM_CHANNELS);
+    if (nextDisplay < nextDue) {  // Button wake: boot, mount the SD, fold in the log, rank the database and hold the display on
+      now = nextDisplay;
+      nextDisplay += displayInterval;
+      if (now > endTime) {
+        break;
+      }
+      result.displayWakes++;
+      double sessionS = (model.bootMs + model.sdInitMs + model.dbRankMs) / 1000 + config.displayTimeoutM * 60.0;
+      result.chargeMas += sessionS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdIdleMa) + config.displayTimeoutM * 60.0 * model.displayMa;
+      chargeFileRead(model, result, model.headerFileBytes);
+      chargeFileRead(model, result, model.plantFileBytes);
+      chargeCheckpoint(model, result, card, config.uplinkBatch > 0, -1);
+      chargeFileWrite(model, result, model.headerFileBytes);
+      chargeFileWrite(model, result, model.plantFileBytes);
+      awakeS += sessionS;
+      continue;
+    }
+    now = nextDue;
+    if (now > endTime) {
+      break;
+    }
+    result.timerWakes++;
+    int dueChannels = 0;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      if (now + WAKE_SLACK_S >= channelDue[i]) {
+        dueChannels |= 1 << i;
+        channelDue[i] = now + config.periodM[i] * 60L;
+      }
+    }
+    double wakeS = model.bootMs / 1000;
+    result.chargeMas += wakeS * model.cpuActiveMa;
+    while (traceIndex + 1 < trace.size() && trace[traceIndex + 1].time <= now) {
+      traceIndex++;
+    }
+    const TraceRecord &record = trace[traceIndex];
+    // Sensors and SD mount, with peripherals powered for the rest of the wake
+    double sensorS = model.sdInitMs / 1000;
+    if (dueChannels & (1 << lightFile)) {
+      sensorS += model.ltr390ConvMs / 1000;
+      result.chargeMas += model.ltr390ConvMs / 1000 * model.ltr390Ma;
+    }
+    if (dueChannels & ((1 << humidityFile) | (1 << tempFile))) {
+      sensorS += model.aht20MeasureMs / 1000;
+      result.chargeMas += model.aht20MeasureMs / 1000 * model.aht20Ma;
+    }
+    result.chargeMas += sensorS * (model.cpuActiveMa + model.peripheralIdleMa + model.sdIdleMa);
+    wakeS += sensorS;
+    chargeFileRead(model, result, model.headerFileBytes);
+    chargeFileRead(model, result, model.plantFileBytes);
+    // recordReading(): the reading goes into the next log slot, its sector read first unless the record starts it
+    long logSlot = (long)((card.logNextSeq - 1) % LOG_RECORDS);
+    if (logSlot % LOG_RECORDS_PER_SECTOR != 0) {
+      chargeSectorReads(model, result, 1);
+    }
+    chargeSectorWrites(model, result, 1);
+    card.logNextSeq++;
+    card.pendingMasks.push_back(dueChannels);
+    // detectEvents(), run here as the detectors see the same readings in the same order at the checkpoint
+    int shifts = 0;
+    if (dueChannels & (1 << waterFile)) {
+      shifts += waterDetector.add(record.values[waterFile], WATER_CUSUM_DRIFT, WATER_CUSUM_THRESHOLD) < 0;
+    }
+    if ((dueChannels & (1 << lightFile)) && !std::isnan(record.values[lightFile])) {
+      int lastShift = lightDetector.lastShift;
+      int shift = lightDetector.add(log10f(record.values[lightFile] + 1), LIGHT_CUSUM_DRIFT, LIGHT_CUSUM_THRESHOLD);
+      shifts += (shift != 0 && shift != lastShift);
+    }
+    card.pendingEvents += shifts;
+    result.events += shifts;
+    bool deferred = card.pendingMasks.size() < LOG_CHECKPOINT_RECORDS;
+    if (!deferred) {
+      chargeCheckpoint(model, result, card, config.uplinkBatch > 0, logSlot / LOG_RECORDS_PER_SECTOR);
+    }
+    // triggerModeHandler()
+    bool triggered = false;
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      triggered = triggered || ((dueChannels & (1 << i)) && record.values[i] > thresholds[i]);
+    }
+    if (triggered) {
+      result.chargeMas += TRIG_PULSE_LEN_MS / 1000.0 * (model.cpuActiveMa + model.peripheralIdleMa + model.triggerLoadMa);
+      wakeS += TRIG_PULSE_LEN_MS / 1000.0;
+    }
+    // uplinkModeHandler()
+    if (config.uplinkBatch > 0 && card.uplinkPending >= config.uplinkBatch) {
+      int batches = (int)ceil(card.uplinkPending * model.uplinkLineBytes / UPLINK_PAYLOAD_BYTES);
+      double radioS = (model.wifiConnectMs + batches * model.publishMs) / 1000;
+      result.chargeMas += radioS * (model.cpuActiveMa + model.wifiMa);
+      chargeFileRead(model, result, card.uplinkPending * model.uplinkLineBytes);
+      chargeFileWrite(model, result, 0);  // Queue truncated once drained
+      wakeS += radioS;
+      card.uplinkPending = 0;
+      result.uplinks++;
+      deferred = false;  // The send cursor is saved in the header
+    }
+    // shutdownModeHandler(), a deferred wake leaves the header & plant files as they were
+    if (!deferred) {
+      chargeFileWrite(model, result, model.headerFileBytes);
+      chargeFileWrite(model, result, model.plantFileBytes);
+    }
+    awakeS += wakeS;
+  }
+  result.seconds = endTime - startTime;
+  result.chargeMas += std::max(0.0, result.seconds - awakeS) * model.deepSleepMa;
+  return result;
+}
+
+// Split a comma separated list of integers
+static std::vector<int> parseList(const char *list) {
+  std::vector<int> values;
+  std::stringstream stream(list);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    values.push_back(atoi(value.c_str()));
+  }
+  return values;
+}
+
+/*--------------------------------------------------------------- Main ---------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  const char *traceFile = nullptr;
+  int syntheticDays = 14;
+  CurrentModel model;
+  std::vector<int> periods[NUM_CHANNELS] = { { 1 }, { 1 }, { 1 }, { 1 } };
+  std::vector<int> uplinkBatches = { 0 };
+  std::vector<int> displayTimeouts = { 1 };
+  int displayWakesPerDay = 4;
+  float thresholds[NUM_CHANNELS] = { INFINITY, INFINITY, INFINITY, INFINITY };
+  int numThreads = std::max(1u, std::thread::hardware_concurrency());
+  const char *periodFlags[NUM_CHANNELS] = { "--light-period", "--water-period", "--humidity-period", "--temp-period" };
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    const char *value = argv[i + 1];
+    bool handled = true;
+    if (flag == "--trace") {
+      traceFile = value;
+    } else if (flag == "--synthetic") {
+      syntheticDays = atoi(value);
+    } else if (flag == "--model") {
+      std::ifstream modelFile(value);
+      std::string line;
+      while (std::getline(modelFile, line)) {
+        size_t equals = line.find('=');
+        if (line.empty() || line[0] == '#' || equals == std::string::npos) {
+          continue;
+        }
+        if (!model.set(line.substr(0, equals), atof(line.c_str() + equals + 1))) {
+          std::cerr << "unknown model key: " << line.substr(0, equals) << "\n";
+          return 1;
+        }
+      }
+    } else if (flag == "--uplink-batch") {
+      uplinkBatches = parseList(value);
+    } else if (flag == "--display-timeout") {
+      displayTimeouts = parseList(value);
+    } else if (flag == "--display-wakes") {
+      displayWakesPerDay = atoi(value);
+    } else if (flag == "--thresholds") {
+      sscanf(value, "%f,%f,%f,%f", &thresholds[0], &thresholds[1], &thresholds[2], &thresholds[3]);
+    } else if (flag == "--threads") {
+      numThreads = std::max(1, atoi(value));
+    } else {
+      handled = false;
+      for (int channel = 0; channel < NUM_CHANNELS; channel++) {
+        if (flag == periodFlags[channel]) {
+          periods[channel] = parseList(value);
+          handled = true;
+        }
+      }
+    }
+    if (!handled) {
+      std::cerr << "unknown option: " << flag << "\n";
+      return 1;
+    }
+  }
+
+  std::vector<TraceRecord> trace = traceFile ? loadTrace(traceFile) : syntheticTrace(syntheticDays);
+  if (trace.size() < 2) {
+    std::cerr << "trace needs at least two readings\n";
+    return 1;
+  }
+
+  // Cartesian product of every swept setting
+  std::vector<SimConfig> configs;
+  for (int light : periods[lightFile])
+    for (int water : periods[waterFile])
+      for (int humidity : periods[humidityFile])
+        for (int temp : periods[tempFile])
+          for (int batch : uplinkBatches)
+            for (int timeout : displayTimeouts) {
+              SimConfig config;
+              config.periodM[lightFile] = std::max(1, light);
+              config.periodM[waterFile] = std::max(1, water);
+              config.periodM[humidityFile] = std::max(1, humidity);
+              config.periodM[tempFile] = std::max(1, temp);
+              config.uplinkBatch = batch;
+              config.displayTimeoutM = timeout;
+              configs.push_back(config);
+            }
+
+  // Workers pull configurations off a shared counter; each run only reads the shared trace and model
+  std::vector<SimResult> results(configs.size());
+  std::atomic<size_t> nextConfig(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads; t++) {
+    workers.emplace_back([&]() {
+      for (size_t i = nextConfig++; i < configs.size(); i = nextConfig++) {
+        results[i] = simulate(trace, configs[i], model, displayWakesPerDay, thresholds);
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  printf("lightPeriodM,waterPeriodM,humidityPeriodM,tempPeriodM,uplinkBatch,displayTimeoutM,"
+         "avgCurrentMa,batteryLifeDays,sdKBPerDay,timerWakesPerDay,checkpointsPerDay,uplinksPerDay,eventsPerDay\n");
+  for (size_t i = 0; i < configs.size(); i++) {
+    const SimConfig &config = configs[i];
+    const SimResult &result = results[i];
+    double days = result.seconds / SECONDS_PER_DAY;
+    double avgCurrentMa = result.chargeMas / result.seconds;
+    double lifeDays = model.batteryMah * model.batteryDerating / avgCurrentMa / 24;
+    printf("%d,%d,%d,%d,%d,%d,%.3f,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f\n", config.periodM[lightFile], config.periodM[waterFile],
+           config.periodM[humidityFile], config.periodM[tempFile], config.uplinkBatch, config.displayTimeoutM, avgCurrentMa,
+           lifeDays, result.sdBytes / 1024 / days, result.timerWakes / days, result.checkpoints / days, result.uplinks / days,
+           result.events / days);
+  }
+  return 0;
+}
@@ -0,0 +1,442 @@
+/*
+  Plant-Saver fleet ingestion tool
+
+  Reads the SD card contents of many devices in parallel and merges their sensor history into one columnar file.
+  Each card is a directory holding a copy of the card (header.txt, env/, plant1/, plant2/, ...); the directory name is
+  used as the device ID. The env/ history is attributed to the plant active in header.txt, and plant folders still
+  holding history from before env/ existed are ingested as well. Readings are put back in time order from the circular
+  sensor files and the newest-first dates file, followed by the readings still waiting in the sensor log (env/log.bin)
+  for their checkpoint.
+
+  Build: g++ -std=c++17 -O2 -pthread fleet_ingest.cpp -o fleet_ingest
+
+  Usage: fleet_ingest <cards directory> <output file> [--threads <n>]
+         fleet_ingest --dump <output file>       Print a columnar file as CSV
+
+  Output layout (little-endian). One row group is written per history folder, so memory use is bounded by the number of
+  workers rather than the size of the fleet:
+    "PSCOL1\n"
+    row group: uint32 numRows, uint16 deviceLength, device bytes, int32 plantID, int32 baseID,
+               int64 time[numRows] (seconds since the epoch, oldest first),
+               float light[numRows], float water[numRows], float humidity[numRows], float temp[numRows] (NAN = not read)
+    footer:    uint64 groupOffset[numGroups], uint32 numGroups, "PSEND\n"
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define NUM_CHANNELS 4
+#define MAX_SENSOR_READINGS 200
+#define TIMESTAMP_LEN 19
+#define ALL_CHANNELS_MASK 0xF
+#define LOG_RECORD_SIZE 32
+
+#define FILE_MAGIC "PSCOL1\n"
+#define FOOTER_MAGIC "PSEND\n"
+#define SECONDS_PER_DAY 86400
+
+static const char *channelFiles[NUM_CHANNELS] = { "light.txt", "water.txt", "humidity.txt", "temp.txt" };  // Ordered by FileTypes
+
+/*------------------------------------------------------------ Class Definitions ----------------------------------------------------------*/
+
+// One history folder to ingest
+class IngestTask {
+public:
+  fs::path folder;
+  fs::path profileFolder;  // Plant folder holding plant.txt
+  std::string deviceID;
+  int plantID;
+  uint32_t logID;       // Sensor log of the folder from header.txt, 0 if it has none
+  uint32_t logApplied;  // Last log record already in the sensor files
+};
+
+// One reading as stored in the sensor log, mirrored from PlantSaverClasses.h
+struct LogRecord {
+  uint32_t logID;
+  uint32_t seq;
+  uint32_t time;
+  uint8_t channelMask;
+  uint8_t reserved[3];
+  float readings[NUM_CHANNELS];
+};
+static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "LogRecord must match the firmware's layout");
+
+// History of one plant folder in time order, ready to be written as a row group
+class RowGroup {
+public:
+  RowGroup();
+  std::string deviceID;
+  int32_t plantID;
+  int32_t baseID;
+  std::vector<int64_t> times;
+  std::vector<float> values[NUM_CHANNELS];
+};
+
+// Readings of one sensor file in slot order, as stored on the card
+class SensorFile {
+public:
+  SensorFile();
+  bool load(const fs::path &fileName, uint64_t &bytesRead);
+  float getByAge(int age);  // 0 = newest
+  int startIndex;
+  int numReadings;
+  std::vector<float> slots;
+};
+
+/*---------------------------------------------------------- Function Definitions ---------------------------------------------------------*/
+
+RowGroup::RowGroup() {
+  plantID = 0;
+  baseID = 0;
+}
+
+SensorFile::SensorFile() {
+  startIndex = 0;
+  numReadings = 0;
+}
+
+// Read a whole file into a string
+static bool readFile(const fs::path &fileName, std::string &contents, uint64_t &bytesRead) {
+  std::ifstream file(fileName, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  contents = buffer.str();
+  bytesRead += contents.size();
+  return true;
+}
+
+// Integer value of a top-level key in a flat JSON object, or fallback if missing
+static long findInt(const std::string &json, const char *key, long fallback) {
+  std::string pattern = std::string("\"") + key + "\":";
+  size_t position = json.find(pattern);
+  if (position == std::string::npos) {
+    return fallback;
+  }
+  return strtol(json.c_str() + position + pattern.size(), nullptr, 10);
+}
+
+// Parse {"startIndex":..,"numReadings":..,"readings":[...]} without building a document. null entries become NAN
+bool SensorFile::load(const fs::path &fileName, uint64_t &bytesRead) {
+  std::string json;
+  if (!readFile(fileName, json, bytesRead)) {
+    return false;
+  }
+  startIndex = (int)findInt(json, "startIndex", 0);
+  numReadings = (int)findInt(json, "numReadings", 0);
+  size_t position = json.find("\"readings\":[");
+  if (position == std::string::npos) {
+    return false;
+  }
+  const char *cursor = json.c_str() + position + strlen("\"readings\":[");
+  while (*cursor && *cursor != ']') {
+    while (*cursor == ' ' || *cursor == ',') {
+      cursor++;
+    }
+    if (strncmp(cursor, "null", 4) == 0) {
+      slots.push_back(NAN);
+      cursor += 4;
+    } else {
+      char *end;
+      float value = strtof(cursor, &end);
+      if (end == cursor) {
+        break;
+      }
+      slots.push_back(value);
+      cursor = end;
+    }
+  }
+  numReadings = std::min<int>(numReadings, (int)slots.size());
+  return true;
+}
+
+// The reading of age k sits in slot (startIndex - 1 - k) of the circular buffer
+float SensorFile::getByAge(int age) {
+  if (age >= numReadings) {
+    return NAN;
+  }
+  int slot = ((startIndex - 1 - age) % MAX_SENSOR_READINGS + MAX_SENSOR_READINGS) % MAX_SENSOR_READINGS;
+  return (slot < (int)slots.size()) ? slots[slot] : NAN;
+}
+
+// Days since 1970-01-01 of a civil date (proleptic Gregorian)
+static long daysFromCivil(long year, long month, long day) {
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  long yearOfEra = year - era * 400;
+  long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+// Parse a firmware timestamp ("YYYY-MM-DD HH:MM:SS") into seconds since the epoch. Returns -1 if malformed
+static int64_t parseTimeStamp(const char *timeStamp) {
+  int year, month, day, hour, minute, second;
+  if (sscanf(timeStamp, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &minute, &second) != 6) {
+    return -1;
+  }
+  return (int64_t)daysFromCivil(year, month, day) * SECONDS_PER_DAY + hour * 3600 + minute * 60 + second;
+}
+
+// Rebuild the time-ordered history of one plant folder. Dates are stored newest first, each line optionally tagged with
+// the mask of channels read at that time, so a channel's k-th tagged line holds its reading of age k
+static bool ingestFolder(const IngestTask &task, RowGroup &group, uint64_t &bytesRead) {
+  group.deviceID = task.deviceID;
+  group.plantID = task.plantID;
+  std::string plantJson;
+  if (readFile(task.profileFolder / "plant.txt", plantJson, bytesRead)) {
+    group.baseID = (int32_t)findInt(plantJson, "baseID", 0);
+  }
+  std::string dates;
+  if (!readFile(task.folder / "dates.txt", dates, bytesRead)) {
+    return false;
+  }
+  SensorFile sensorFiles[NUM_CHANNELS];
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    sensorFiles[i].load(task.folder / channelFiles[i], bytesRead);  // A missing file leaves the channel empty
+  }
+  size_t lineStart = dates.find('\n');  // Skip the {"numReadings":N} line
+  int ages[NUM_CHANNELS] = { 0 };
+  while (lineStart != std::string::npos && lineStart + 1 + TIMESTAMP_LEN <= dates.size()) {
+    const char *line = dates.c_str() + lineStart + 1;
+    int64_t time = parseTimeStamp(line);
+    lineStart = dates.find('\n', lineStart + 1);
+    if (time < 0) {
+      continue;
+    }
+    int mask = ALL_CHANNELS_MASK;
+    if (line[TIMESTAMP_LEN] == ',') {
+      mask = (int)strtol(line + TIMESTAMP_LEN + 1, nullptr, 16);
+    }
+    group.times.push_back(time);
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      group.values[i].push_back((mask & (1 << i)) ? sensorFiles[i].getByAge(ages[i]++) : NAN);
+    }
+  }
+  std::reverse(group.times.begin(), group.times.end());  // Oldest first
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    std::reverse(group.values[i].begin(), group.values[i].end());
+  }
+  std::string log;
+  if (task.logID == 0 || !readFile(task.folder / "log.bin", log, bytesRead)) {
+    return true;
+  }
+  std::vector<LogRecord> pending;  // Logged after the last checkpoint, so newer than every line of the dates file
+  for (size_t position = 0; position + LOG_RECORD_SIZE <= log.size(); position += LOG_RECORD_SIZE) {
+    LogRecord record;
+    memcpy(&record, log.data() + position, LOG_RECORD_SIZE);
+    if (record.logID == task.logID && record.seq > task.logApplied) {
+      pending.push_back(record);
+    }
+  }
+  std::sort(pending.begin(), pending.end(), [](const LogRecord &a, const LogRecord &b) {
+    return a.seq < b.seq;
+  });
+  for (const LogRecord &record : pending) {
+    group.times.push_back(record.time);
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      group.values[i].push_back((record.channelMask & (1 << i)) ? record.readings[i] : NAN);
+    }
+  }
+  return true;
+}
+
+// Append one row group to the output. Returns its offset
+static uint64_t writeGroup(std::ofstream &output, const RowGroup &group) {
+  uint64_t offset = output.tellp();
+  uint32_t numRows = group.times.size();
+  uint16_t deviceLength = group.deviceID.size();
+  output.write((const char *)&numRows, sizeof(numRows));
+  output.write((const char *)&deviceLength, sizeof(deviceLength));
+  output.write(group.deviceID.data(), deviceLength);
+  output.write((const char *)&group.plantID, sizeof(group.plantID));
+  output.write((const char *)&group.baseID, sizeof(group.baseID));
+  output.write((const char *)group.times.data(), numRows * sizeof(int64_t));
+  for (int i = 0; i < NUM_CHANNELS; i++) {
+    output.write((const char *)group.values[i].data(), numRows * sizeof(float));
+  }
+  return offset;
+}
+
+// Find the history folders of every card
+static std::vector<IngestTask> findTasks(const fs::path &cardsDir) {
+  std::vector<IngestTask> tasks;
+  uint64_t bytesRead = 0;
+  for (const fs::directory_entry &card : fs::directory_iterator(cardsDir)) {
+    if (!card.is_directory()) {
+      continue;
+    }
+    std::string header;
+    int activePlantID = readFile(card.path() / "header.txt", header, bytesRead) ? (int)findInt(header, "activePlantID", 0) : 0;
+    uint32_t logID = (uint32_t)findInt(header, "logID", 0);
+    uint32_t logApplied = (uint32_t)findInt(header, "logApplied", 0);
+    fs::path envFolder;
+    fs::path activeFolder;
+    for (const fs::directory_entry &folder : fs::directory_iterator(card.path())) {
+      std::string name = folder.path().filename().string();
+      std::transform(name.begin(), name.end(), name.begin(), ::tolower);  // FAT is case-insensitive, EmptyFS uses "Plant1"
+      if (!folder.is_directory()) {
+        continue;
+      }
+      if (name == "env") {
+        envFolder = folder.path();
+      } else if (name.rfind("plant", 0) == 0 && name.size() > 5 && isdigit((unsigned char)name[5])) {
+        int plantID = atoi(name.c_str() + 5);
+        if (plantID == activePlantID) {
+          activeFolder = folder.path();
+        }
+        if (fs::exists(folder.path() / "dates.txt")) {  // Not yet migrated to env/
+          IngestTask task;
+          task.folder = folder.path();
+          task.profileFolder = folder.path();
+          task.deviceID = card.path().filename().string();
+          task.plantID = plantID;
+          task.logID = 0;
+          task.logApplied = 0;
+          tasks.push_back(task);
+        }
+      }
+    }
+    if (!envFolder.empty()) {
+      IngestTask task;
+      task.folder = envFolder;
+      task.profileFolder = activeFolder;
+      task.deviceID = card.path().filename().string();
+      task.plantID = activePlantID;
+      task.logID = logID;
+      task.logApplied = logApplied;
+      tasks.push_back(task);
+    }
+  }
+  std::sort(tasks.begin(), tasks.end(), [](const IngestTask &a, const IngestTask &b) {
+    return a.folder < b.folder;
+  });
+  return tasks;
+}
+
+// Print a columnar file as CSV, one group at a time
+static int dumpFile(const char *fileName) {
+  std::ifstream input(fileName, std::ios::binary);
+  char magic[sizeof(FILE_MAGIC) - 1];
+  if (!input.read(magic, sizeof(magic)) || memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0) {
+    std::cerr << "not a Plant-Saver columnar file\n";
+    return 1;
+  }
+  input.seekg(-(std::streamoff)(sizeof(FOOTER_MAGIC) - 1 + sizeof(uint32_t)), std::ios::end);
+  uint32_t numGroups = 0;
+  input.read((char *)&numGroups, sizeof(numGroups));
+  input.seekg(-(std::streamoff)(sizeof(FOOTER_MAGIC) - 1 + sizeof(uint32_t) + numGroups * sizeof(uint64_t)), std::ios::end);
+  std::vector<uint64_t> offsets(numGroups);
+  input.read((char *)offsets.data(), numGroups * sizeof(uint64_t));
+  printf("device,plant,baseID,time,light,water,humidity,temp\n");
+  for (uint64_t offset : offsets) {
+    RowGroup group;
+    uint32_t numRows = 0;
+    uint16_t deviceLength = 0;
+    input.seekg(offset);
+    input.read((char *)&numRows, sizeof(numRows));
+    input.read((char *)&deviceLength, sizeof(deviceLength));
+    group.deviceID.resize(deviceLength);
+    input.read(&group.deviceID[0], deviceLength);
+    input.read((char *)&group.plantID, sizeof(group.plantID));
+    input.read((char *)&group.baseID, sizeof(group.baseID));
+    group.times.resize(numRows);
+    input.read((char *)group.times.data(), numRows * sizeof(int64_t));
+    for (int i = 0; i < NUM_CHANNELS; i++) {
+      group.values[i].resize(numRows);
+      input.read((char *)group.values[i].data(), numRows * sizeof(float));
+    }
+    for (uint32_t row = 0; row < numRows; row++) {
+      time_t time = group.times[row];
+      char timeStamp[TIMESTAMP_LEN + 1];
+      strftime(timeStamp, sizeof(timeStamp), "%Y-%m-%d %H:%M:%S", gmtime(&time));
+      printf("%s,%d,%d,%s,%g,%g,%g,%g\n", group.deviceID.c_str(), group.plantID, group.baseID, timeStamp, group.values[0][row],
+             group.values[1][row], group.values[2][row], group.values[3][row]);
+    }
+  }
+  return 0;
+}
+
+/*--------------------------------------------------------------- Main ---------------------------------------------------------------*/
+
+int main(int argc, char *argv[]) {
+  if (argc == 3 && strcmp(argv[1], "--dump") == 0) {
+    return dumpFile(argv[2]);
+  }
+  if (argc != 3 && !(argc == 5 && strcmp(argv[3], "--threads") == 0)) {
+    std::cerr << "usage: fleet_ingest <cards directory> <output file> [--threads <n>]\n"
+                 "       fleet_ingest --dump <output file>\n";
+    return 1;
+  }
+  int numThreads = (argc == 5) ? std::max(1, atoi(argv[4])) : std::max(1u, std::thread::hardware_concurrency());
+  auto startTime = std::chrono::steady_clock::now();
+  std::vector<IngestTask> tasks = findTasks(argv[1]);
+  std::ofstream output(argv[2], std::ios::binary | std::ios::trunc);
+  if (!output) {
+    std::cerr << "cannot open " << argv[2] << "\n";
+    return 1;
+  }
+  output.write(FILE_MAGIC, sizeof(FILE_MAGIC) - 1);
+
+  // Each worker ingests one folder at a time and hands the finished group straight to the writer
+  std::vector<uint64_t> groupOffsets;
+  std::mutex outputLock;
+  std::atomic<size_t> nextTask(0);
+  std::atomic<uint64_t> totalBytes(0);
+  std::atomic<uint64_t> totalRows(0);
+  std::atomic<int> failedFolders(0);
+  std::vector<std::thread> workers;
+  for (int t = 0; t < numThreads; t++) {
+    workers.emplace_back([&]() {
+      for (size_t i = nextTask++; i < tasks.size(); i = nextTask++) {
+        RowGroup group;
+        uint64_t bytesRead = 0;
+        bool ingested = ingestFolder(tasks[i], group, bytesRead);
+        totalBytes += bytesRead;
+        if (!ingested) {
+          failedFolders++;
+          continue;
+        }
+        totalRows += group.times.size();
+        std::lock_guard<std::mutex> guard(outputLock);
+        groupOffsets.push_back(writeGroup(output, group));
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+
+  uint32_t numGroups = groupOffsets.size();
+  output.write((const char *)groupOffsets.data(), numGroups * sizeof(uint64_t));
+  output.write((const char *)&numGroups, sizeof(numGroups));
+  output.write(FOOTER_MAGIC, sizeof(FOOTER_MAGIC) - 1);
+  output.close();
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+  fprintf(stderr, "%zu folders (%d unreadable), %llu rows, %.1f MB read in %.3f s: %.1f MB/s, %.0f rows/s, %d threads\n",
+          tasks.size(), failedFolders.load(), (unsigned long long)totalRows.load(), totalBytes / 1e6, seconds,
+          totalBytes / 1e6 / seconds, totalRows / seconds, numThreads);
+  return 0;
+}
@@ -0,0 +1,37 @@
+/*
+  Plant-Saver host HAL: Arduino core
+
+  Stand-ins for the parts of the Arduino core that the firmware sources built on the host use, so they compile unchanged
+  on Linux. Time is real: millis() counts from the first call and delay() sleeps. esp_random() draws from the OS.
+*/
+
+#ifndef HOST_HAL_ARDUINO_H
+#define HOST_HAL_ARDUINO_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <thread>
+
+inline unsigned long millis() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline void delay(unsigned long ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline uint32_t esp_random() {
+  static std::random_device device;
+  return device();
+}
+
+#define F(text) text
+
+#endif
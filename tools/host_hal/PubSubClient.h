@@ -0,0 +1,167 @@
+/*
+  Plant-Saver host HAL: PubSubClient
+
+  A minimal MQTT 3.1.1 client with the PubSubClient interface the firmware uses, talking to a real broker over WiFiClient:
+  clean-session connect, QoS 0 subscribe & publish, and incoming publishes handed to the callback from loop(). Like
+  PubSubClient, publish() refuses packets that do not fit the buffer set with setBufferSize().
+  Faults can be injected for the harness, counted in publishes since connect().
+*/
+
+#ifndef HOST_HAL_PUBSUBCLIENT_H
+#define HOST_HAL_PUBSUBCLIENT_H
+
+#include "Arduino.h"
+#include "WiFi.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define MQTT_MAX_HEADER_SIZE 5
+#define MQTT_KEEPALIVE_S 60
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+class PubSubClient {
+public:
+  PubSubClient(WiFiClient& client)
+    : _client(client) {}
+  PubSubClient& setServer(const char* host, uint16_t port) {
+    _host = host;
+    _port = port;
+    return *this;
+  }
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE) {
+    _callback = callback;
+    return *this;
+  }
+  bool setBufferSize(uint16_t size) {
+    _bufferSize = size;
+    return true;
+  }
+  bool connect(const char* id) {
+    _publishCount = 0;
+    if (!_client.connect(_host.c_str(), _port)) {
+      return 0;
+    }
+    std::vector<uint8_t> body = { 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, MQTT_KEEPALIVE_S };  // Clean session
+    appendString(body, id);
+    if (!sendPacket(0x10, body)) {
+      return 0;
+    }
+    uint8_t type;
+    std::vector<uint8_t> reply;
+    if (!readPacket(type, reply) || (type & 0xF0) != 0x20 || reply.size() < 2 || reply[1] != 0) {
+      _client.stop();
+      return 0;
+    }
+    return 1;
+  }
+  bool connected() {
+    return _client.connected();
+  }
+  void disconnect() {
+    sendPacket(0xE0, {});
+    _client.stop();
+  }
+  bool subscribe(const char* topic) {
+    std::vector<uint8_t> body = { (uint8_t)(_nextPacketID >> 8), (uint8_t)_nextPacketID };
+    _nextPacketID = (_nextPacketID == 0xFFFF) ? 1 : _nextPacketID + 1;
+    appendString(body, topic);
+    body.push_back(0);  // QoS 0
+    return sendPacket(0x82, body);
+  }
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length) {
+    if (_bufferSize < MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length) {
+      return 0;
+    }
+    _publishCount++;
+    if (_publishCount == failPublish) {  // Connection lost before the publish went out
+      _client.stop();
+      return 0;
+    }
+    std::vector<uint8_t> body;
+    appendString(body, topic);
+    body.insert(body.end(), payload, payload + length);
+    return sendPacket(0x30, body);
+  }
+  bool publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload));
+  }
+  // Hand every publish that has arrived to the callback
+  bool loop() {
+    while (_client.connected() && _client.available() > 0) {
+      uint8_t type;
+      std::vector<uint8_t> body;
+      if (!readPacket(type, body)) {
+        return 0;
+      }
+      if ((type & 0xF0) != 0x30 || body.size() < 2) {
+        continue;  // SUBACK, PINGRESP
+      }
+      size_t topicLength = (body[0] << 8) | body[1];
+      size_t payloadStart = 2 + topicLength + (((type >> 1) & 3) ? 2 : 0);  // Packet ID present above QoS 0
+      if (payloadStart > body.size()) {
+        continue;
+      }
+      if (loseEcho != 0 && _publishCount >= loseEcho) {  // Echo lost after the publish reached the broker
+        continue;
+      }
+      size_t headerEnd = std::find(body.begin() + payloadStart, body.end(), (uint8_t)'\n') - body.begin();
+      if (staleEcho != 0 && _publishCount == staleEcho && headerEnd > payloadStart && headerEnd < body.size()) {
+        body[headerEnd - 1] ^= 1;  // An earlier attempt at the same offset, its header differs only in the nonce
+      }
+      std::string topic((char*)&body[2], topicLength);
+      if (_callback) {
+        _callback(&topic[0], body.data() + payloadStart, body.size() - payloadStart);
+      }
+    }
+    return _client.connected();
+  }
+  int failPublish = 0;  // Host only: this publish fails & drops the connection, 0 never
+  int loseEcho = 0;     // Host only: echoes arriving from this publish on are dropped, 0 never
+  int staleEcho = 0;    // Host only: this publish's echo is replaced by a stale echo of an earlier attempt, 0 never
+private:
+  static void appendString(std::vector<uint8_t>& body, const char* text) {
+    size_t length = strlen(text);
+    body.push_back(length >> 8);
+    body.push_back(length & 0xFF);
+    body.insert(body.end(), text, text + length);
+  }
+  bool sendPacket(uint8_t type, const std::vector<uint8_t>& body) {
+    std::vector<uint8_t> packet = { type };
+    size_t remaining = body.size();
+    do {
+      uint8_t digit = remaining % 128;
+      remaining /= 128;
+      packet.push_back(remaining > 0 ? digit | 0x80 : digit);
+    } while (remaining > 0);
+    packet.insert(packet.end(), body.begin(), body.end());
+    return _client.write(packet.data(), packet.size()) == packet.size();
+  }
+  bool readPacket(uint8_t& type, std::vector<uint8_t>& body) {
+    if (_client.read(&type, 1) != 1) {
+      return 0;
+    }
+    size_t remaining = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+      uint8_t digit;
+      if (_client.read(&digit, 1) != 1) {
+        return 0;
+      }
+      remaining |= (size_t)(digit & 0x7F) << shift;
+      if (!(digit & 0x80)) {
+        break;
+      }
+    }
+    body.resize(remaining);
+    return remaining == 0 || _client.read(body.data(), remaining) == (int)remaining;
+  }
+  WiFiClient& _client;
+  std::string _host;
+  uint16_t _port = 1883;
+  uint16_t _bufferSize = 256;
+  uint16_t _nextPacketID = 1;
+  int _publishCount = 0;
+  void (*_callback)(char*, uint8_t*, unsigned int) = nullptr;
+};
+
+#endif
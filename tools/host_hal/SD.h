@@ -0,0 +1,102 @@
+/*
+  Plant-Saver host HAL: SD library
+
+  Files on the card are files under a host folder given to SD.begin(). File keeps the Arduino semantics the firmware
+  relies on: FILE_WRITE truncates (as on the ESP32), FILE_APPEND appends, and readBytesUntil() consumes the terminator
+  without storing it.
+*/
+
+#ifndef HOST_HAL_SD_H
+#define HOST_HAL_SD_H
+
+#include "Arduino.h"
+#include <string>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File {
+public:
+  File(FILE* file = nullptr)
+    : _file(file) {}
+  explicit operator bool() const {
+    return _file != nullptr;
+  }
+  size_t size() {
+    long position = ftell(_file);
+    fseek(_file, 0, SEEK_END);
+    long end = ftell(_file);
+    fseek(_file, position, SEEK_SET);
+    return end;
+  }
+  size_t position() {
+    return ftell(_file);
+  }
+  bool seek(uint32_t position) {
+    return fseek(_file, position, SEEK_SET) == 0;
+  }
+  int available() {
+    return size() - position();
+  }
+  int read() {
+    return fgetc(_file);
+  }
+  size_t readBytesUntil(char terminator, char* buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+      int c = fgetc(_file);
+      if (c == EOF || c == terminator) {
+        break;
+      }
+      buffer[count++] = c;
+    }
+    return count;
+  }
+  size_t write(const uint8_t* buffer, size_t length) {
+    return fwrite(buffer, 1, length, _file);
+  }
+  int printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int length = vfprintf(_file, format, args);
+    va_end(args);
+    return length;
+  }
+  void close() {
+    if (_file) {
+      fclose(_file);
+      _file = nullptr;
+    }
+  }
+private:
+  FILE* _file;
+};
+
+class SDClass {
+public:
+  // Host only: the folder standing in for the card
+  bool begin(const char* folder) {
+    _root = folder;
+    return true;
+  }
+  File open(const char* path, const char* mode = FILE_READ) {
+    return File(fopen((_root + path).c_str(), mode));
+  }
+  bool exists(const char* path) {
+    FILE* file = fopen((_root + path).c_str(), "r");
+    if (file) {
+      fclose(file);
+    }
+    return file != nullptr;
+  }
+  bool remove(const char* path) {
+    return ::remove((_root + path).c_str()) == 0;
+  }
+private:
+  std::string _root;
+};
+
+inline SDClass SD;
+
+#endif
@@ -0,0 +1,133 @@
+/*
+  Plant-Saver host HAL: ESP32 WiFi library
+
+  Joining the network always succeeds unless the harness clears WiFi.reachable, in which case status() never reports a
+  connection, as with a missing access point. WiFiClient is a plain blocking TCP socket.
+*/
+
+#ifndef HOST_HAL_WIFI_H
+#define HOST_HAL_WIFI_H
+
+#include "Arduino.h"
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+typedef enum { WIFI_OFF, WIFI_STA } wifi_mode_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode) {
+    _mode = mode;
+    _joined = _joined && mode != WIFI_OFF;
+    return true;
+  }
+  int begin(const char*, const char*) {
+    _joined = reachable && _mode == WIFI_STA;
+    return status();
+  }
+  int status() {
+    return _joined ? WL_CONNECTED : WL_DISCONNECTED;
+  }
+  bool disconnect(bool = false) {
+    _joined = false;
+    return true;
+  }
+  uint8_t* macAddress(uint8_t* mac) {
+    memcpy(mac, address, sizeof(address));
+    return mac;
+  }
+  bool reachable = true;                                       // Host only: whether the network can be joined
+  uint8_t address[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };  // Host only: MAC address reported to the firmware
+private:
+  wifi_mode_t _mode = WIFI_OFF;
+  bool _joined = false;
+};
+
+inline WiFiClass WiFi;
+
+class WiFiClient {
+public:
+  ~WiFiClient() {
+    stop();
+  }
+  int connect(const char* host, uint16_t port) {
+    stop();
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &addresses) != 0) {
+      return 0;
+    }
+    for (addrinfo* address = addresses; address && _socket < 0; address = address->ai_next) {
+      _socket = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+      if (_socket >= 0 && ::connect(_socket, address->ai_addr, address->ai_addrlen) != 0) {
+        ::close(_socket);
+        _socket = -1;
+      }
+    }
+    freeaddrinfo(addresses);
+    if (_socket < 0) {
+      return 0;
+    }
+    int one = 1;
+    setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    timeval timeout = { 5, 0 };
+    setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return 1;
+  }
+  size_t write(const uint8_t* buffer, size_t length) {
+    size_t written = 0;
+    while (_socket >= 0 && written < length) {
+      ssize_t sent = send(_socket, buffer + written, length - written, MSG_NOSIGNAL);
+      if (sent <= 0) {
+        stop();
+        break;
+      }
+      written += sent;
+    }
+    return written;
+  }
+  int available() {
+    int count = 0;
+    if (_socket < 0 || ioctl(_socket, FIONREAD, &count) != 0) {
+      return 0;
+    }
+    return count;
+  }
+  // Blocks until length bytes arrive, the socket closes or the receive timeout passes
+  int read(uint8_t* buffer, size_t length) {
+    size_t count = 0;
+    while (_socket >= 0 && count < length) {
+      ssize_t received = recv(_socket, buffer + count, length - count, 0);
+      if (received <= 0) {
+        stop();
+        break;
+      }
+      count += received;
+    }
+    return count;
+  }
+  bool connected() {
+    return _socket >= 0;
+  }
+  void stop() {
+    if (_socket >= 0) {
+      ::close(_socket);
+      _socket = -1;
+    }
+  }
+private:
+  int _socket = -1;
+};
+
+#endif
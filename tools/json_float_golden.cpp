@@ -0,0 +1,195 @@
+/*
+  Plant-Saver JSON number golden test
+
+  Checks formatJsonFloat() (PlantSaverModels.cpp), which writes the numbers of the sensor files, against a golden file of
+  floats and the text ArduinoJson's serializeJson() gave for each. The cases cover NaN and infinity (null), both signs, zero,
+  values on either side of the exponent thresholds (1e7 and 1e-5), the largest, smallest and subnormal floats, rounding that
+  carries into the integral part or the exponent (e.g. 9.9999995, 0.99999995, 9999999.5), the value ranges of every sensor
+  channel, and random bit patterns.
+
+  The golden file is written by this program built against ArduinoJson 7.4.2, the version formatJsonFloat() was ported from,
+  and checked by it built with or without the library. Regenerate it whenever the firmware moves to another ArduinoJson.
+
+  Build: g++ -std=c++17 -O2 json_float_golden.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o json_float_golden
+         Add -I <ArduinoJson>/src to enable --write, where <ArduinoJson> is the ArduinoJson 7.4.2 library folder,
+         e.g. ~/Arduino/libraries/ArduinoJson
+
+  Usage: json_float_golden --check <file>     Format every float of the golden file and compare, exits with status 1 on a mismatch
+         json_float_golden --write <file>     Write the golden file from serializeJson()
+    --random <n>        Random bit patterns added to the fixed cases when writing (default 20000)
+    --seed <n>          Seed for the random cases (default 1)
+*/
+
+#if defined(__has_include)
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#if ARDUINOJSON_VERSION_MAJOR != 7 || ARDUINOJSON_VERSION_MINOR != 4 || ARDUINOJSON_VERSION_REVISION != 2
+#error "Write the golden file with ArduinoJson 7.4.2, the version formatJsonFloat() was ported from"
+#endif
+#endif
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+
+struct Options {
+  std::string mode;
+  std::string file;
+  int random = 20000;
+  unsigned seed = 1;
+};
+
+static float fromBits(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+/*------------------------------------------------------------- Test Cases --------------------------------------------------------------*/
+
+#ifdef ARDUINOJSON_VERSION
+static uint32_t toBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Every case is written with both signs, so only magnitudes are listed
+static std::vector<float> buildCases(const Options& options) {
+  std::vector<float> magnitudes = {
+    0, 1, 0.5f, 0.1f, 0.2f, 0.3f, 1.1f, 3.14159265f, 2.7182818f, 10, 100, 1000, 4095, 123.456f, 1234.5678f,
+    9.9999995f, 9.9999996f, 9.999999f, 0.99999995f, 0.9999999f, 99.999995f, 999.99995f, 9999.9995f, 99999.995f,
+    999999.95f, 9999999.5f, 0.0000095f, 9.9999995e-6f, 9.9999995e7f, 9.9999995e-7f, 1.5f, 2.5f, 0.0000005f, 0.00000049f,
+    1e7f, 9999999, 10000001, 12345678, 1e8f, 1.5e9f, 4294967295.0f, 4294967296.0f, 1e10f, 1e16f, 1e32f, 1e38f,
+    1e-5f, 1.0001e-5f, 0.99999e-5f, 1.5e-6f, 1e-6f, 1e-10f, 1e-20f, 1e-30f, 1e-38f,
+    std::numeric_limits<float>::max(), std::numeric_limits<float>::min(), std::numeric_limits<float>::denorm_min(),
+    1e-40f, 1e-45f, std::numeric_limits<float>::epsilon(), 0.15f, 0.000123f, 1010749, 10750, 1075, 59.999996f, 60.000004f
+  };
+  std::vector<float> cases;
+  for (float magnitude : magnitudes) {
+    cases.push_back(magnitude);
+    cases.push_back(-magnitude);
+  }
+  cases.push_back(std::numeric_limits<float>::quiet_NaN());
+  cases.push_back(std::numeric_limits<float>::infinity());
+  cases.push_back(-std::numeric_limits<float>::infinity());
+  std::mt19937 random(options.seed);
+  std::uniform_real_distribution<float> lux(0, 120000);  // Sensor channels as the firmware stores them
+  std::uniform_int_distribution<int> adc(0, 4095);
+  std::uniform_real_distribution<float> humidity(0, 100);
+  std::uniform_real_distribution<float> tempF(-40, 185);
+  for (int i = 0; i < 1000; i++) {
+    cases.push_back(lux(random));
+    cases.push_back((float)adc(random));
+    cases.push_back(humidity(random));
+    cases.push_back(tempF(random));
+  }
+  std::uniform_int_distribution<uint32_t> bits;
+  for (int i = 0; i < options.random; i++) {
+    cases.push_back(fromBits(bits(random)));
+  }
+  return cases;
+}
+
+/*-------------------------------------------------------------- Golden File --------------------------------------------------------------*/
+
+// One line per case: the bits of the float in hex, then the text serializeJson() gives for it
+static bool writeGolden(const Options& options) {
+  FILE* file = fopen(options.file.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "cannot write %s\n", options.file.c_str());
+    return false;
+  }
+  std::vector<float> cases = buildCases(options);
+  for (float value : cases) {
+    JsonDocument doc;
+    doc.add(value);  // Inside an array, as the sensor files hold their readings
+    std::string text;
+    serializeJson(doc, text);
+    fprintf(file, "%08x %s\n", (unsigned)toBits(value), text.substr(1, text.size() - 2).c_str());
+  }
+  fclose(file);
+  printf("%zu cases written with ArduinoJson %s\n", cases.size(), ARDUINOJSON_VERSION);
+  return true;
+}
+#endif
+
+// Format the float of every line and compare with the text of the golden file
+static bool checkGolden(const Options& options) {
+  FILE* file = fopen(options.file.c_str(), "r");
+  if (!file) {
+    fprintf(stderr, "cannot read %s, write it with --write from a build against ArduinoJson 7.4.2\n", options.file.c_str());
+    return false;
+  }
+  char line[128];
+  long cases = 0;
+  long mismatches = 0;
+  while (fgets(line, sizeof(line), file)) {
+    unsigned bits;
+    char expected[64];
+    if (sscanf(line, "%x %63s", &bits, expected) != 2) {
+      continue;
+    }
+    char buffer[NUM_CHARS_JSON_NUMBER];
+    formatJsonFloat(fromBits(bits), buffer);
+    cases++;
+    if (strcmp(buffer, expected)) {
+      if (mismatches < 20) {
+        printf("  %08x %-16.9g serializeJson %-16s formatJsonFloat %s\n", bits, fromBits(bits), expected, buffer);
+      }
+      mismatches++;
+    }
+  }
+  fclose(file);
+  printf("%ld cases, %ld mismatch(es)\n", cases, mismatches);
+  printf("%s\n", (cases > 0 && mismatches == 0) ? "PASS" : "FAIL");
+  return cases > 0 && mismatches == 0;
+}
+
+/*------------------------------------------------------------------ Main ------------------------------------------------------------------*/
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--check") || !strcmp(name, "--write")) {
+      options.mode = name + 2;
+      options.file = value;
+    } else if (!strcmp(name, "--random")) {
+      options.random = atoi(value);
+    } else if (!strcmp(name, "--seed")) {
+      options.seed = atoi(value);
+    } else {
+      return false;
+    }
+  }
+  return !options.mode.empty() && options.random >= 0;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: json_float_golden (--check file | --write file) [--random n] [--seed n]\n");
+    return 2;
+  }
+  if (options.mode == "write") {
+#ifdef ARDUINOJSON_VERSION
+    return writeGolden(options) ? 0 : 1;
+#else
+    fprintf(stderr, "built without ArduinoJson, add -I <ArduinoJson>/src to write the golden file\n");
+    return 2;
+#endif
+  }
+  return checkGolden(options) ? 0 : 1;
+}
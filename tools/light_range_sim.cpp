@@ -0,0 +1,260 @@
+/*
+  Plant-Saver light auto-ranging simulation
+
+  Runs synthetic light traces through a model of the LTR390 and the auto-ranging of PlantSaverModels.cpp, one reading per
+  sampling period, with the settings of each reading chosen from the one before it as the firmware does across deep sleep.
+  Each trace is a run of days with a daylight curve peaking at the given level, passing clouds, and indoor lamps switched on
+  and off at random in the evenings. The sensor model counts with noise, quantization and a dark offset, clips at the full scale of its
+  resolution and takes the nominal conversion time of that resolution. Reports the error of the lux reported against the
+  true level, how often the result was saturated or had to be re-taken, and the mean conversion time per reading, for the
+  auto-ranging and for the fixed gain of 3 at 16 bits the firmware used before.
+  Exits with status 1 if an auto-ranged reading is left saturated or the error limit is exceeded, so it can be used as a check.
+
+  Build: g++ -std=c++17 -O2 light_range_sim.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o light_range_sim
+
+  Usage: light_range_sim [options]
+    --peak-lux <list>       Comma separated daylight peaks, one trace each (default 500,5000,30000,100000)
+    --headroom <list>       Comma separated range headrooms to compare (default 2, the firmware's)
+    --target-counts <list>  Comma separated counts a conversion should reach to compare (default 500, the firmware's)
+    --period-m <n>          Minutes between light readings (default 5)
+    --days <n>              Days per trace (default 14)
+    --lamp-lux <n>          Level under the indoor lamps (default 300)
+    --floor-lux <n>         Errors below this level are taken as a share of it, not of the true level (default 10)
+    --seed <n>              Seed for clouds, lamps and sensor noise (default 1)
+    --max-error <pct>       Fail if the 95th percentile error of the auto-ranged readings exceeds this (default 5)
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Settings the firmware used before auto-ranging: LTR390_GAIN_3 & LTR390_RESOLUTION_16BIT
+#define FIXED_GAIN 1
+#define FIXED_RESOLUTION 4
+
+/*------------------------------------------------------------ Sensor Model -------------------------------------------------------------*/
+
+#define SENSOR_DARK_COUNTS 0.1      // Mean dark count of one 100 ms conversion at gain 1, scaled with gain & integration time
+#define SENSOR_NOISE_COUNTS 1       // Standard deviation of the count noise
+#define SENSOR_NOISE_FRACTION 0.005  // Standard deviation of the noise proportional to the level, from flicker & the converter
+
+// One LTR390 conversion of the given true level. Gain times integration time (in 100 ms) is 0.6 lux over the lux per count
+static uint32_t convert(double lux, int gain, int resolution, std::mt19937& rng) {
+  double luxPerCount = getLuxPerCount(gain, resolution);
+  double expected = lux / luxPerCount + SENSOR_DARK_COUNTS * 0.6 / luxPerCount;
+  std::normal_distribution<double> normal(0, 1);
+  double counts = std::round(expected * (1 + SENSOR_NOISE_FRACTION * normal(rng)) + SENSOR_NOISE_COUNTS * normal(rng));
+  return (uint32_t)std::clamp(counts, 0.0, (double)getLightFullScale(resolution));
+}
+
+/*--------------------------------------------------------------- Options ---------------------------------------------------------------*/
+
+struct Options {
+  std::vector<double> peakLux = { 500, 5000, 30000, 100000 };
+  std::vector<double> headroom = { LIGHT_HEADROOM };
+  std::vector<double> targetCounts = { LIGHT_TARGET_COUNTS };
+  double periodM = 5;
+  int days = 14;
+  double lampLux = 300;
+  double floorLux = 10;
+  unsigned seed = 1;
+  double maxError = 5;
+};
+
+static std::vector<double> parseList(const char* text) {
+  std::vector<double> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    values.push_back(atof(item.c_str()));
+  }
+  return values;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--peak-lux")) {
+      options.peakLux = parseList(value);
+    } else if (!strcmp(name, "--headroom")) {
+      options.headroom = parseList(value);
+    } else if (!strcmp(name, "--target-counts")) {
+      options.targetCounts = parseList(value);
+    } else if (!strcmp(name, "--period-m")) {
+      options.periodM = atof(value);
+    } else if (!strcmp(name, "--days")) {
+      options.days = atoi(value);
+    } else if (!strcmp(name, "--lamp-lux")) {
+      options.lampLux = atof(value);
+    } else if (!strcmp(name, "--floor-lux")) {
+      options.floorLux = atof(value);
+    } else if (!strcmp(name, "--seed")) {
+      options.seed = atoi(value);
+    } else if (!strcmp(name, "--max-error")) {
+      options.maxError = atof(value);
+    } else {
+      return false;
+    }
+  }
+  if (options.periodM <= 0 || options.days <= 0 || options.floorLux <= 0 || options.peakLux.empty() || options.headroom.empty() || options.targetCounts.empty()) {
+    return false;
+  }
+  for (double headroom : options.headroom) {
+    if (headroom < 1) {
+      return false;
+    }
+  }
+  for (double targetCounts : options.targetCounts) {
+    if (targetCounts <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*-------------------------------------------------------------- Simulation -------------------------------------------------------------*/
+
+// True light level at each reading of a trace
+static std::vector<double> makeTrace(const Options& options, double peakLux, std::mt19937& rng) {
+  std::vector<double> trace;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  double cloud = 1;        // Share of the clear sky level getting through
+  bool lampOn = false;
+  int readingsPerDay = std::lround(24 * 60 / options.periodM);
+  for (int i = 0; i < options.days * readingsPerDay; i++) {
+    double hour = 24.0 * (i % readingsPerDay) / readingsPerDay;
+    double sun = (hour > 6 && hour < 20) ? std::pow(std::sin(M_PI * (hour - 6) / 14), 1.5) : 0;
+    if (uniform(rng) < options.periodM / 60) {  // A new cloud cover about once an hour
+      cloud = (uniform(rng) < 0.4) ? 1 : 0.1 + 0.7 * uniform(rng);
+    }
+    if (hour > 17 && hour < 23.5) {  // Lamps switched on & off in the evening, off overnight
+      if (uniform(rng) < options.periodM / 90) {
+        lampOn = !lampOn;
+      }
+    } else {
+      lampOn = false;
+    }
+    double lux = peakLux * sun * cloud + (lampOn ? options.lampLux : 0) + 0.02;  // Never fully dark
+    trace.push_back(lux);
+  }
+  return trace;
+}
+
+struct Results {
+  std::vector<double> error;  // Percent of the true level, or of the floor level below it
+  int saturated = 0;          // Readings left saturated
+  int retries = 0;            // Conversions re-taken at the widest range
+  double conversionMs = 0;
+  int readings = 0;
+};
+
+// Read a trace with fixed settings (autoRange false) or ranged from the previous reading
+static void runTrace(const std::vector<double>& trace, bool autoRange, double headroom, double targetCounts, double floorLux,
+                     std::mt19937& rng, Results& results) {
+  int widestGain, widestResolution;
+  chooseLightRange(NAN, widestGain, widestResolution, headroom, targetCounts);
+  float lastLux = NAN;
+  for (double lux : trace) {
+    int gain = FIXED_GAIN;
+    int resolution = FIXED_RESOLUTION;
+    if (autoRange) {
+      chooseLightRange(lastLux, gain, resolution, headroom, targetCounts);
+    }
+    uint32_t counts = convert(lux, gain, resolution, rng);
+    results.conversionMs += getLightConversionMs(resolution);
+    if (autoRange && lightSaturated(counts, resolution) && (gain != widestGain || resolution != widestResolution)) {  // As readLight()
+      gain = widestGain;
+      resolution = widestResolution;
+      counts = convert(lux, gain, resolution, rng);
+      results.conversionMs += getLightConversionMs(resolution);
+      results.retries++;
+    }
+    if (lightSaturated(counts, resolution)) {
+      results.saturated++;
+    }
+    lastLux = getLux(counts, gain, resolution);
+    results.error.push_back(100 * std::fabs(lastLux - lux) / std::max(lux, floorLux));
+    results.readings++;
+  }
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return NAN;
+  }
+  size_t index = std::min(values.size() - 1, (size_t)(fraction * values.size()));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: light_range_sim [--peak-lux list] [--headroom list] [--target-counts list] [--period-m n] [--days n]\n"
+                    "                       [--lamp-lux n] [--floor-lux n] [--seed n] [--max-error pct]\n");
+    return 2;
+  }
+  bool failed = false;
+  printf("  %-9s %-18s %10s %10s %10s %10s %10s\n", "peak lux", "ranging", "median err", "p95 err", "saturated", "retries", "conv ms");
+  for (double peakLux : options.peakLux) {
+    std::mt19937 traceRng(options.seed);
+    std::vector<double> trace = makeTrace(options, peakLux, traceRng);
+    std::vector<std::pair<double, double>> settings = { { 0, 0 } };  // Fixed settings first, then each auto-ranging tuning
+    for (double headroom : options.headroom) {
+      for (double targetCounts : options.targetCounts) {
+        settings.push_back({ headroom, targetCounts });
+      }
+    }
+    double fixedMs = 0;
+    for (const auto& [headroom, targetCounts] : settings) {
+      bool autoRange = headroom > 0;
+      std::mt19937 sensorRng(options.seed + 1);
+      Results results;
+      runTrace(trace, autoRange, headroom, targetCounts, options.floorLux, sensorRng, results);
+      double meanMs = results.conversionMs / results.readings;
+      char label[32];
+      if (autoRange) {
+        snprintf(label, sizeof(label), "auto x%g %g", headroom, targetCounts);
+      } else {
+        snprintf(label, sizeof(label), "fixed gain 3 16b");
+        fixedMs = meanMs;
+      }
+      char saved[16] = "";
+      if (autoRange && fixedMs > 0) {
+        snprintf(saved, sizeof(saved), " (%+.0f%%)", 100 * (meanMs - fixedMs) / fixedMs);
+      }
+      printf("  %-9.0f %-18s %9.2f%% %9.2f%% %10i %10i %10.1f%s\n", peakLux, label, percentile(results.error, 0.5),
+             percentile(results.error, 0.95), results.saturated, results.retries, meanMs, saved);
+      if (!autoRange) {
+        continue;  // Only the auto-ranging is checked
+      }
+      if (results.saturated > 0) {
+        printf("    %i reading(s) left saturated\n", results.saturated);
+        failed = true;
+      }
+      if (headroom == LIGHT_HEADROOM && targetCounts == LIGHT_TARGET_COUNTS && percentile(results.error, 0.95) > options.maxError) {
+        printf("    95th percentile error %.2f%% exceeds %.2f%%\n", percentile(results.error, 0.95), options.maxError);
+        failed = true;
+      }
+    }
+  }
+  printf("Errors are a share of the true level (of %g lux below it); conv ms is the mean conversion time per reading, retries included\n", options.floorLux);
+  printf("%s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}
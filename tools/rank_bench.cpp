@@ -0,0 +1,277 @@
+/*
+  Plant-Saver database ranking benchmark
+
+  Times the ranking of Container::getDBPlants() on synthetic databases of several sizes, built with the shared ranking code
+  of PlantSaverModels.cpp. Each database is written in the plantDB.txt layout of build_plant_db, with random requirements,
+  and a synthetic environment history fills the channel statistics. Each run is timed in two halves: pulling the requirement
+  values of every plant, done here by a small scanner standing in for the filtered deserializeJson() of the firmware, and
+  scoring them in RequirementBlocks against the statistics while keeping the NUM_DISPLAY_PLANTS best. Reports the host time
+  per plant of each half, their projection for the ESP32 from a CPU slowdown, and the card time of streaming the file at the
+  given read rate, which is outside the scoring target. Checks the top list against scoring every plant on its own with
+  ChannelStats::percentInRange(). Exits with status 1 if a top list is wrong or the projected scoring time of the largest
+  database exceeds the limit.
+
+  Build: g++ -std=c++17 -O2 rank_bench.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp -o rank_bench
+
+  Usage: rank_bench [options]
+    --plants <list>      Comma separated database sizes (default 100,1000,5000)
+    --readings <n>       Readings per channel in the environment history (default 2000)
+    --runs <n>           Rankings timed per database, the fastest is reported (default 5)
+    --cpu-factor <n>     ESP32 slowdown against this host (default 40)
+    --card-kbps <n>      Card read rate in KiB/s for streaming the database (default 400)
+    --max-ms <n>         Fail if the projected scoring time of the largest database exceeds this (default 1000)
+    --seed <n>           Seed for the database & the environment history (default 1)
+*/
+
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define NUM_CHANNELS 4
+#define NUM_DISPLAY_PLANTS 10
+
+/*-------------------------------------------------------------- Database ---------------------------------------------------------------*/
+
+// A database in the plantDB.txt layout, with names & facts of typical length
+static std::string buildDatabase(int numPlants, std::mt19937& random) {
+  std::uniform_int_distribution<int> zone(1, 13);
+  std::uniform_int_distribution<int> light(fullShade, fullSun);
+  std::uniform_int_distribution<int> waterCode(water, dry);
+  std::string text = "{\"plants\":[";
+  for (int id = 1; id <= numPlants; id++) {
+    int hardiness[2] = { zone(random), 0 };
+    hardiness[1] = std::min(13, hardiness[0] + zone(random) % 6);
+    int lightReq[2] = { light(random), light(random) };
+    int waterReq[2] = { waterCode(random), waterCode(random) };
+    std::sort(lightReq, lightReq + 2);
+    std::sort(waterReq, waterReq + 2);
+    auto range = [](const int values[2]) {
+      return (values[1] != values[0]) ? "[" + std::to_string(values[0]) + "," + std::to_string(values[1]) + "]" : "[" + std::to_string(values[0]) + "]";
+    };
+    text += (id > 1 ? ",\n" : "\n");
+    text += "{\"id\":" + std::to_string(id) + ",\"name\":\"Synthetic plant " + std::to_string(id) +
+            "\",\"data\":[{\"key\":\"USDA Hardiness zone\",\"value\":" + range(hardiness) +
+            "},{\"key\":\"Light requirement\",\"value\":" + range(lightReq) +
+            "},{\"key\":\"Water requirement\",\"value\":" + range(waterReq) +
+            "}],\"scientific_name\":\"Plantae synthetica " + std::to_string(id) +
+            "\",\"cultivation_fact\":\"Generated for the ranking benchmark, this fact is about as long as the shipped ones.\"}";
+  }
+  return text + "\n]}";
+}
+
+// Pull the next requirement range after *cursor the way getDBRequirements() does: first & last element, 0 if single
+static void pullRange(const char** cursor, int range[2]) {
+  const char* value = strstr(*cursor, "\"value\":[") + 9;
+  char* end;
+  range[0] = strtol(value, &end, 10);
+  range[1] = 0;
+  while (*end == ',') {
+    range[1] = strtol(end + 1, &end, 10);
+  }
+  *cursor = end;
+}
+
+/*------------------------------------------------------------- Environment -------------------------------------------------------------*/
+
+// A history of indoor readings: lux over a day curve, soil drying & re-watering, humidity & temperature around a mean
+static void fillStats(ChannelStats stats[], int readings, std::mt19937& random) {
+  std::normal_distribution<float> noise(0, 1);
+  float soil = 1200;
+  for (int i = 0; i < readings; i++) {
+    float hour = fmodf(i * 5 / 60.0f, 24);
+    float lux = (hour > 6 && hour < 20) ? 3000 * sinf((hour - 6) / 14 * 3.14159f) + 200 * noise(random) : 0;
+    soil = (soil > 3200) ? 1200 : soil + 4 + noise(random);
+    stats[lightFile].add(std::max(0.0f, lux), lightFile);
+    stats[waterFile].add(soil, waterFile);
+    stats[humidityFile].add(45 + 8 * noise(random), humidityFile);
+    stats[tempFile].add(70 + 3 * noise(random), tempFile);
+  }
+}
+
+/*--------------------------------------------------------------- Ranking ---------------------------------------------------------------*/
+
+// Requirements pulled from one database plant
+struct Requirements {
+  int hardiness[2];
+  int lightReq[2];
+  int waterReq[2];
+  unsigned long offset;
+};
+
+struct Ranking {
+  float topScores[NUM_DISPLAY_PLANTS];
+  unsigned long topOffsets[NUM_DISPLAY_PLANTS];
+  int numTop;
+};
+
+// The streaming half of getDBPlants(): pull the requirements of every plant in database order
+static std::vector<Requirements> pullRequirements(const std::string& database) {
+  std::vector<Requirements> plants;
+  const char* cursor = strstr(database.c_str(), "\"plants\":[") + 10;
+  while ((cursor = strchr(cursor, '{'))) {
+    Requirements plant;
+    plant.offset = cursor - database.c_str();
+    pullRange(&cursor, plant.hardiness);
+    pullRange(&cursor, plant.lightReq);
+    pullRange(&cursor, plant.waterReq);
+    plants.push_back(plant);
+    cursor = strstr(cursor, "\"}") + 2;
+  }
+  return plants;
+}
+
+// The scoring half of getDBPlants(): fill & score RequirementBlocks, keep the best NUM_DISPLAY_PLANTS
+static Ranking rankPlants(std::vector<Requirements>& plants, ChannelStats stats[]) {
+  static RequirementBlock block;
+  float blockScores[RANK_BLOCK_SIZE];
+  Ranking ranking = {};
+  block.size = 0;
+  for (size_t p = 0; p < plants.size(); p++) {
+    block.add(plants[p].hardiness, plants[p].lightReq, plants[p].waterReq, plants[p].offset);
+    if (block.size == RANK_BLOCK_SIZE || p + 1 == plants.size()) {
+      block.score(stats, blockScores);
+      for (int i = 0; i < block.size; i++) {
+        insertTopPlant(blockScores[i], block.offsets[i], ranking.topScores, ranking.topOffsets, ranking.numTop, NUM_DISPLAY_PLANTS);
+      }
+      block.size = 0;
+    }
+  }
+  return ranking;
+}
+
+// Score every plant on its own from the percentages shown in the main menu, as a reference for the block scoring
+static std::vector<float> referenceScores(std::vector<Requirements>& plants, ChannelStats stats[]) {
+  std::vector<float> scores;
+  for (Requirements& plant : plants) {
+    int thresholds[2];
+    float score = 0;
+    if (getLightThresholds(plant.lightReq, thresholds)) {
+      score += stats[lightFile].percentInRange(lightFile, thresholds) / 100.0f;
+    }
+    if (getWaterThresholds(plant.waterReq, thresholds)) {
+      score += stats[waterFile].percentInRange(waterFile, thresholds) / 100.0f;
+    }
+    if (getTempThresholds(plant.hardiness, thresholds)) {
+      score += stats[tempFile].percentInRange(tempFile, thresholds) / 100.0f;
+    }
+    scores.push_back(score);
+  }
+  return scores;
+}
+
+/*--------------------------------------------------------------- Options ---------------------------------------------------------------*/
+
+struct Options {
+  std::vector<int> plants = { 100, 1000, 5000 };
+  int readings = 2000;
+  int runs = 5;
+  float cpuFactor = 40;
+  float cardKbps = 400;
+  float maxMs = 1000;
+  unsigned seed = 1;
+};
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--plants")) {
+      options.plants.clear();
+      std::stringstream stream(value);
+      std::string item;
+      while (std::getline(stream, item, ',')) {
+        options.plants.push_back(atoi(item.c_str()));
+      }
+    } else if (!strcmp(name, "--readings")) {
+      options.readings = atoi(value);
+    } else if (!strcmp(name, "--runs")) {
+      options.runs = atoi(value);
+    } else if (!strcmp(name, "--cpu-factor")) {
+      options.cpuFactor = atof(value);
+    } else if (!strcmp(name, "--card-kbps")) {
+      options.cardKbps = atof(value);
+    } else if (!strcmp(name, "--max-ms")) {
+      options.maxMs = atof(value);
+    } else if (!strcmp(name, "--seed")) {
+      options.seed = atoi(value);
+    } else {
+      return false;
+    }
+  }
+  for (int plants : options.plants) {
+    if (plants <= 0) {
+      return false;
+    }
+  }
+  return !options.plants.empty() && options.readings > 0 && options.runs > 0 && options.cpuFactor > 0 && options.cardKbps > 0;
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: rank_bench [--plants list] [--readings n] [--runs n] [--cpu-factor n] [--card-kbps n] [--max-ms n] [--seed n]\n");
+    return 2;
+  }
+  std::mt19937 random(options.seed);
+  ChannelStats stats[NUM_CHANNELS];
+  fillStats(stats, options.readings, random);
+  bool failed = false;
+  float largestProjection = 0;
+  int largest = 0;
+  printf("%8s %9s %12s %12s %14s %12s %12s  %s\n", "plants", "db KiB", "pull us/pl", "score us/pl", "ESP32 score ms", "ESP32 pull ms",
+         "ESP32 card ms", "top list");
+  for (int numPlants : options.plants) {
+    std::string database = buildDatabase(numPlants, random);
+    std::vector<Requirements> plants;
+    Ranking ranking = {};
+    double pullMs = 1e30;
+    double scoreMs = 1e30;
+    for (int run = 0; run < options.runs; run++) {
+      auto startTime = std::chrono::steady_clock::now();
+      plants = pullRequirements(database);
+      auto pulledTime = std::chrono::steady_clock::now();
+      ranking = rankPlants(plants, stats);
+      auto endTime = std::chrono::steady_clock::now();
+      pullMs = std::min(pullMs, std::chrono::duration<double, std::milli>(pulledTime - startTime).count());
+      scoreMs = std::min(scoreMs, std::chrono::duration<double, std::milli>(endTime - pulledTime).count());
+    }
+
+    // The top list holds the best plants within the rounding of the whole-percent reference, best first
+    std::vector<float> sorted = referenceScores(plants, stats);
+    std::sort(sorted.rbegin(), sorted.rend());
+    bool correct = (int)plants.size() == numPlants && ranking.numTop == std::min(numPlants, NUM_DISPLAY_PLANTS);
+    for (int i = 0; correct && i < ranking.numTop; i++) {
+      correct = fabsf(ranking.topScores[i] - sorted[i]) < 0.02f && (i == 0 || ranking.topScores[i] <= ranking.topScores[i - 1]);
+    }
+    failed = failed || !correct;
+
+    float projectedMs = scoreMs * options.cpuFactor;
+    if (numPlants >= largest) {
+      largest = numPlants;
+      largestProjection = projectedMs;
+    }
+    printf("%8i %9.1f %12.3f %12.3f %14.1f %12.1f %12.1f  %s\n", numPlants, database.size() / 1024.0, pullMs * 1000 / numPlants,
+           scoreMs * 1000 / numPlants, projectedMs, pullMs * options.cpuFactor, database.size() / 1024.0 / options.cardKbps * 1000,
+           correct ? "ok" : "WRONG");
+  }
+  bool fast = largestProjection <= options.maxMs;
+  printf("%i plants scored in a projected %.1f ms on the ESP32 (limit %.0f ms)\n", largest, largestProjection, options.maxMs);
+  printf("%s\n", (failed || !fast) ? "FAIL" : "PASS");
+  return (failed || !fast) ? 1 : 0;
+}
@@ -0,0 +1,412 @@
+/*
+  Plant-Saver read cache benchmark
+
+  Replays the file reads of a display session (header, plant and environment on wake, database ranking for the select menu, serial
+  range queries) against a model of the SD card, once reading straight through the SD library and once through the
+  BlockCache of PlantSaverClasses.cpp at each RAM budget given. Reports the average card time of each operation and the
+  cache hit rate. Only time spent waiting on the card is modelled; parsing costs the same either way.
+
+  Build: g++ -std=c++17 -O2 read_cache_bench.cpp -o read_cache_bench
+
+  Usage: read_cache_bench [options]
+    --budget-kb <list>   Comma separated cache budgets to compare, in KiB (default 1,4,16,32)
+    --db-plants <n>      Plants in plantDB.txt (default 40, the shipped database holds 10)
+    --session <script>   Comma separated operations, each optionally repeated with *n (default "wake,db,query*20,db,query*20")
+                         wake  = header.txt, plant.txt & env.txt, db = rank the database for the select menu,
+                         query = one Q command, write = env & header rewritten (invalidates both)
+    --open-us <n>        Card time of SD.open(): path lookup through the directory sectors (default 1200)
+    --block-us <n>       Card time of one 512-byte block read over SPI (default 350)
+    --seed <n>           Seed for query ranges and database ranking (default 1)
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define MAX_SENSOR_READINGS 200
+#define DATE_LINE_LEN 23
+#define NUM_CHANNELS 4
+#define NUM_DISPLAY_PLANTS 10
+#define CACHE_BLOCK_SIZE 512
+#define CACHE_MIN_BLOCKS 2
+#define CACHE_MAX_FILES 8
+#define CACHE_SLOT_BYTES 16  // sizeof(CacheSlot)
+
+#define DB_PLANT_BYTES 260  // Average plantDB.txt entry written by build_plant_db
+
+struct CardModel {
+  double openUs = 1200;
+  double blockUs = 350;
+};
+
+/*------------------------------------------------------------ Readers ------------------------------------------------------------*/
+
+// Reads files of known sizes and charges card time
+class Reader {
+public:
+  virtual ~Reader() {}
+  virtual bool open(const std::string &name) = 0;
+  virtual void read(const std::string &name, uint32_t offset, uint32_t length) = 0;  // Sequential bytes of an open file
+  virtual void close(const std::string &name) = 0;
+  virtual void invalidate(const std::string &) {}
+  double cardUs = 0;
+  unsigned long hits = 0;
+  unsigned long misses = 0;
+};
+
+// The SD library: every open walks the directory, and each FIL keeps one sector buffered
+class DirectReader : public Reader {
+public:
+  DirectReader(const CardModel &card, const std::map<std::string, uint32_t> &sizes) : _card(card), _sizes(sizes) {}
+  bool open(const std::string &name) override {
+    cardUs += _card.openUs;
+    _buffered[name] = -1;
+    return _sizes.count(name) > 0;
+  }
+  void read(const std::string &name, uint32_t offset, uint32_t length) override {
+    uint32_t end = std::min(offset + length, _sizes.at(name));
+    for (uint32_t sector = offset / CACHE_BLOCK_SIZE; offset < end && sector <= (end - 1) / CACHE_BLOCK_SIZE; sector++) {
+      if (_buffered[name] != (long)sector) {
+        cardUs += _card.blockUs;
+        misses++;
+        _buffered[name] = sector;
+      }
+    }
+  }
+  void close(const std::string &name) override { _buffered.erase(name); }
+
+private:
+  CardModel _card;
+  const std::map<std::string, uint32_t> &_sizes;
+  std::map<std::string, long> _buffered;
+};
+
+// Same replacement policy as BlockCache: LRU blocks, a small LRU table of known files, one handle kept open for misses
+class CachedReader : public Reader {
+public:
+  CachedReader(const CardModel &card, const std::map<std::string, uint32_t> &sizes, size_t budgetBytes)
+      : _card(card), _sizes(sizes) {
+    int blocks = budgetBytes / (CACHE_BLOCK_SIZE + CACHE_SLOT_BYTES);
+    _slots.resize(std::max(blocks, CACHE_MIN_BLOCKS));
+  }
+  bool open(const std::string &name) override {
+    int oldest = 0;
+    for (int i = 0; i < (int)_files.size(); i++) {
+      if (_files[i].key != 0 && _files[i].name == name) {
+        _files[i].lastUsed = ++_tick;
+        return true;
+      }
+    }
+    if (_files.size() < CACHE_MAX_FILES) {
+      _files.push_back(FileEntry());
+      oldest = _files.size() - 1;
+    } else {
+      for (int i = 1; i < (int)_files.size(); i++) {
+        if (_files[i].key == 0 || (_files[oldest].key != 0 && _files[i].lastUsed < _files[oldest].lastUsed)) {
+          oldest = i;
+        }
+      }
+      if (_files[oldest].key != 0) {
+        invalidate(_files[oldest].name);
+      }
+    }
+    cardUs += _card.openUs;
+    if (!_sizes.count(name)) {
+      _openKey = 0;
+      return false;
+    }
+    _files[oldest] = { name, _nextKey++, ++_tick };
+    _openKey = _files[oldest].key;
+    return true;
+  }
+  void read(const std::string &name, uint32_t offset, uint32_t length) override {
+    uint32_t key = keyOf(name);
+    uint32_t end = std::min(offset + length, _sizes.at(name));
+    for (uint32_t block = offset / CACHE_BLOCK_SIZE; offset < end && block <= (end - 1) / CACHE_BLOCK_SIZE; block++) {
+      getBlock(key, block);
+    }
+  }
+  void close(const std::string &) override {}
+  void invalidate(const std::string &name) override {
+    for (FileEntry &file : _files) {
+      if (file.key == 0 || file.name != name) {
+        continue;
+      }
+      for (Slot &slot : _slots) {
+        if (slot.fileKey == file.key) {
+          slot = Slot();
+        }
+      }
+      if (_openKey == file.key) {
+        _openKey = 0;
+      }
+      file.key = 0;
+    }
+  }
+
+private:
+  struct Slot {
+    uint32_t fileKey = 0;
+    uint32_t index = 0;
+    uint32_t lastUsed = 0;
+  };
+  struct FileEntry {
+    std::string name;
+    uint32_t key = 0;
+    uint32_t lastUsed = 0;
+  };
+
+  uint32_t keyOf(const std::string &name) {
+    for (const FileEntry &file : _files) {
+      if (file.key != 0 && file.name == name) {
+        return file.key;
+      }
+    }
+    open(name);  // Evicted from the file table while in use, the firmware's CachedFile would fail here instead
+    return keyOf(name);
+  }
+
+  void getBlock(uint32_t key, uint32_t index) {
+    int oldest = 0;
+    for (int i = 0; i < (int)_slots.size(); i++) {
+      if (_slots[i].fileKey == key && _slots[i].index == index) {
+        _slots[i].lastUsed = ++_tick;
+        hits++;
+        return;
+      }
+      if (_slots[i].lastUsed < _slots[oldest].lastUsed) {
+        oldest = i;
+      }
+    }
+    misses++;
+    if (_openKey != key) {  // The kept handle belongs to another file
+      cardUs += _card.openUs;
+      _openKey = key;
+    }
+    cardUs += _card.blockUs;
+    _slots[oldest] = { key, index, ++_tick };
+  }
+
+  CardModel _card;
+  const std::map<std::string, uint32_t> &_sizes;
+  std::vector<Slot> _slots;
+  std::vector<FileEntry> _files;
+  uint32_t _nextKey = 1;
+  uint32_t _tick = 0;
+  uint32_t _openKey = 0;
+};
+
+/*------------------------------------------------------------ Session Model ------------------------------------------------------------*/
+
+static const char* channelFiles[NUM_CHANNELS] = { "/env/light.txt", "/env/water.txt", "/env/humidity.txt", "/env/temp.txt" };
+
+// readSDFile(): the whole file, front to back
+static void readWhole(Reader &reader, const std::string &name, const std::map<std::string, uint32_t> &sizes) {
+  if (reader.open(name)) {
+    reader.read(name, 0, sizes.at(name));
+  }
+  reader.close(name);
+}
+
+// getDBPlants(): stream every plant once, then re-read the best NUM_DISPLAY_PLANTS in full
+static void rankDB(Reader &reader, const std::map<std::string, uint32_t> &sizes, int dbPlants, std::mt19937 &rng) {
+  std::string name = "/plantDB.txt";
+  if (!reader.open(name)) {
+    return;
+  }
+  reader.read(name, 0, sizes.at(name));
+  std::vector<int> order(dbPlants);
+  for (int i = 0; i < dbPlants; i++) {
+    order[i] = i;
+  }
+  std::shuffle(order.begin(), order.end(), rng);
+  for (int i = 0; i < NUM_DISPLAY_PLANTS && i < dbPlants; i++) {
+    reader.read(name, 12 + order[i] * DB_PLANT_BYTES, DB_PLANT_BYTES);
+  }
+  reader.close(name);
+}
+
+// queryRange(): two binary searches over the dates lines, then each channel file streamed up to the last slot needed
+static void query(Reader &reader, const std::map<std::string, uint32_t> &sizes, std::mt19937 &rng) {
+  std::string dates = "/env/dates.txt";
+  if (!reader.open(dates)) {
+    return;
+  }
+  reader.read(dates, 0, 20);
+  std::uniform_int_distribution<int> line(0, MAX_SENSOR_READINGS - 1);
+  for (int search = 0; search < 2; search++) {
+    int target = line(rng);
+    int low = 0;
+    int high = MAX_SENSOR_READINGS;
+    while (low < high) {
+      int mid = (low + high) / 2;
+      reader.read(dates, 20 + mid * DATE_LINE_LEN, DATE_LINE_LEN);
+      if (mid < target) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+  }
+  reader.close(dates);
+  std::uniform_real_distribution<double> extent(0.1, 1.0);
+  for (const char* channel : channelFiles) {
+    if (reader.open(channel)) {
+      reader.read(channel, 0, (uint32_t)(sizes.at(channel) * extent(rng)));
+    }
+    reader.close(channel);
+  }
+}
+
+struct OpStats {
+  int count = 0;
+  double cardUs = 0;
+};
+
+// Run a session, returning the card time per operation name
+static std::map<std::string, OpStats> runSession(Reader &reader, const std::vector<std::string> &session,
+                                                 const std::map<std::string, uint32_t> &sizes, int dbPlants, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::map<std::string, OpStats> stats;
+  for (const std::string &op : session) {
+    double before = reader.cardUs;
+    if (op == "wake") {
+      readWhole(reader, "/header.txt", sizes);
+      readWhole(reader, "/plant1/plant.txt", sizes);
+      readWhole(reader, "/env/env.txt", sizes);
+    } else if (op == "db") {
+      rankDB(reader, sizes, dbPlants, rng);
+    } else if (op == "query") {
+      query(reader, sizes, rng);
+    } else if (op == "write") {  // pushJsonDoc() invalidates before writing, the files are read back on the next use
+      reader.invalidate("/env/env.txt");
+      reader.invalidate("/header.txt");
+      readWhole(reader, "/header.txt", sizes);
+      readWhole(reader, "/env/env.txt", sizes);
+    }
+    stats[op].count++;
+    stats[op].cardUs += reader.cardUs - before;
+  }
+  return stats;
+}
+
+static std::vector<std::string> parseSession(const std::string &script) {
+  std::vector<std::string> session;
+  std::stringstream stream(script);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    int repeat = 1;
+    size_t star = item.find('*');
+    if (star != std::string::npos) {
+      repeat = atoi(item.c_str() + star + 1);
+      item = item.substr(0, star);
+    }
+    if (item != "wake" && item != "db" && item != "query" && item != "write") {
+      fprintf(stderr, "unknown session operation %s\n", item.c_str());
+      exit(1);
+    }
+    for (int i = 0; i < repeat; i++) {
+      session.push_back(item);
+    }
+  }
+  return session;
+}
+
+int main(int argc, char** argv) {
+  std::vector<int> budgetsKB = { 1, 4, 16, 32 };
+  int dbPlants = 40;
+  std::string script = "wake,db,query*20,db,query*20";
+  CardModel card;
+  unsigned seed = 1;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", flag.c_str());
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (flag == "--budget-kb") {
+      budgetsKB.clear();
+      std::stringstream stream(value);
+      std::string item;
+      while (std::getline(stream, item, ',')) {
+        budgetsKB.push_back(atoi(item.c_str()));
+      }
+    } else if (flag == "--db-plants") {
+      dbPlants = atoi(value.c_str());
+    } else if (flag == "--session") {
+      script = value;
+    } else if (flag == "--open-us") {
+      card.openUs = atof(value.c_str());
+    } else if (flag == "--block-us") {
+      card.blockUs = atof(value.c_str());
+    } else if (flag == "--seed") {
+      seed = atoi(value.c_str());
+    } else {
+      fprintf(stderr, "unknown option %s\n", flag.c_str());
+      return 1;
+    }
+  }
+  std::vector<std::string> session = parseSession(script);
+
+  // Sizes of full files as the firmware writes them
+  std::map<std::string, uint32_t> sizes;
+  sizes["/header.txt"] = 450;
+  sizes["/plant1/plant.txt"] = 300;
+  sizes["/env/env.txt"] = 1500;
+  sizes["/env/dates.txt"] = 20 + MAX_SENSOR_READINGS * DATE_LINE_LEN;
+  for (const char* channel : channelFiles) {
+    sizes[channel] = 1400;
+  }
+  sizes["/plantDB.txt"] = 14 + dbPlants * DB_PLANT_BYTES;
+
+  DirectReader direct(card, sizes);
+  std::map<std::string, OpStats> directStats = runSession(direct, session, sizes, dbPlants, seed);
+  std::vector<std::map<std::string, OpStats>> cachedStats;
+  std::vector<double> hitRates;
+  for (int budgetKB : budgetsKB) {
+    CachedReader cached(card, sizes, (size_t)budgetKB * 1024);
+    cachedStats.push_back(runSession(cached, session, sizes, dbPlants, seed));
+    hitRates.push_back(100.0 * cached.hits / std::max(1ul, cached.hits + cached.misses));
+  }
+
+  printf("card time per operation in ms, %zu operations, plantDB.txt %u bytes\n\n", session.size(), sizes["/plantDB.txt"]);
+  printf("%-8s %6s %9s", "op", "count", "direct");
+  for (int budgetKB : budgetsKB) {
+    printf(" %8iK", budgetKB);
+  }
+  printf("\n");
+  double directTotal = 0;
+  std::vector<double> cachedTotals(budgetsKB.size(), 0);
+  for (const auto &entry : directStats) {
+    const OpStats &op = entry.second;
+    printf("%-8s %6i %9.2f", entry.first.c_str(), op.count, op.cardUs / op.count / 1000);
+    directTotal += op.cardUs;
+    for (size_t i = 0; i < budgetsKB.size(); i++) {
+      const OpStats &cachedOp = cachedStats[i][entry.first];
+      printf(" %9.2f", cachedOp.cardUs / cachedOp.count / 1000);
+      cachedTotals[i] += cachedOp.cardUs;
+    }
+    printf("\n");
+  }
+  printf("%-8s %6s %9.1f", "session", "", directTotal / 1000);
+  for (double total : cachedTotals) {
+    printf(" %9.1f", total / 1000);
+  }
+  printf("\n%-8s %6s %9s", "hit rate", "", "-");
+  for (double hitRate : hitRates) {
+    printf(" %8.1f%%", hitRate);
+  }
+  printf("\n");
+  return 0;
+}
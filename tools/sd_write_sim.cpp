@@ -0,0 +1,461 @@
+/*
+  Plant-Saver SD write simulator
+
+  Models the FAT32 volume on the device's micro-SD card the way FatFs drives it (a single-sector window for FAT and
+  directory sectors, both FAT copies written on every FAT flush, FSInfo rewritten whenever the free count changes) and
+  counts the sectors each storage operation of the firmware writes. Compares three ways of keeping sensor history:
+    json      every wake rewrites the four channel files, dates.txt (through tmp.txt), env.txt and header.txt
+    append    every wake appends a 32-byte record to a file through the FAT layer
+    log       every wake writes one record straight into the preallocated log.bin extent, and the JSON files are
+              rewritten once per checkpoint with all the readings logged since the last one
+  Prints the average sector writes of each operation, split into data/FAT/directory/FSInfo, then writes per day.
+
+  Build: g++ -std=c++17 -O2 sd_write_sim.cpp -o sd_write_sim
+
+  Usage: sd_write_sim [options]
+    --cluster-kb <n>      Cluster size of the card in KiB (default 32, the FAT32 default for SDHC cards)
+    --period-m <n>        Minutes between wakes that take a reading (default 1)
+    --checkpoint <n>      Logged readings per checkpoint (default LOG_CHECKPOINT_RECORDS)
+    --wakes <n>           Wakes simulated for each strategy, averages are taken over them (default 10000)
+    --channel-bytes <n>   Size of each full channel file (default 1400), likewise --env-bytes, --header-bytes
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define NUM_CHANNELS 4
+#define MAX_SENSOR_READINGS 200
+#define DATE_LINE_LEN 23
+#define LOG_RECORD_SIZE 32
+#define LOG_RECORDS 1024
+#define LOG_CHECKPOINT_RECORDS 16
+
+#define SECTOR_BYTES 512
+#define NUM_FATS 2
+#define FAT_ENTRIES_PER_SECTOR (SECTOR_BYTES / 4)
+#define DIR_ENTRIES_PER_SECTOR (SECTOR_BYTES / 32)
+#define MINUTES_PER_DAY 1440
+
+/*------------------------------------------------------------- FAT Model -------------------------------------------------------------*/
+
+enum SectorKind {
+  dataSector,
+  fatSector,
+  dirSector,
+  fsinfoSector,
+  numSectorKinds
+};
+
+struct WriteCounts {
+  double sectors[numSectorKinds] = {};
+  double total() const {
+    double sum = 0;
+    for (double count : sectors) {
+      sum += count;
+    }
+    return sum;
+  }
+  WriteCounts operator-(const WriteCounts &other) const {
+    WriteCounts difference;
+    for (int i = 0; i < numSectorKinds; i++) {
+      difference.sectors[i] = sectors[i] - other.sectors[i];
+    }
+    return difference;
+  }
+  WriteCounts &operator+=(const WriteCounts &other) {
+    for (int i = 0; i < numSectorKinds; i++) {
+      sectors[i] += other.sectors[i];
+    }
+    return *this;
+  }
+  WriteCounts scaled(double factor) const {
+    WriteCounts result;
+    for (int i = 0; i < numSectorKinds; i++) {
+      result.sectors[i] = sectors[i] * factor;
+    }
+    return result;
+  }
+};
+
+// A file as far as the FAT layer is concerned
+struct FatFile {
+  uint32_t dirSector = 0;     // Sector holding the directory entry
+  uint32_t firstCluster = 0;  // 0 while the file is empty
+  uint32_t size = 0;
+};
+
+// Cluster allocation and metadata flushes of one FAT32 volume
+class Volume {
+public:
+  explicit Volume(int sectorsPerCluster) : fat(1 << 20, 0), _sectorsPerCluster(sectorsPerCluster) {
+    fat[0] = fat[1] = 0x0FFFFFFF;
+    fat[2] = 0x0FFFFFFF;  // Root directory cluster
+  }
+
+  // A directory entry in the next slot of the history folder
+  FatFile newFile() {
+    FatFile file;
+    file.dirSector = kDirBase + _dirSlots++ / DIR_ENTRIES_PER_SECTOR;
+    touch(file.dirSector, dirSector);
+    return file;
+  }
+
+  // f_open with FA_CREATE_ALWAYS on an existing file: entry rewritten, cluster chain released
+  void truncate(FatFile &file) {
+    touch(file.dirSector, dirSector);
+    freeChain(file.firstCluster);
+    file.firstCluster = 0;
+    file.size = 0;
+  }
+
+  // f_write of n bytes at the end of the file. Full and partial sectors are both written once
+  void write(FatFile &file, uint32_t n) {
+    if (n == 0) {
+      return;
+    }
+    uint32_t clusterBytes = _sectorsPerCluster * SECTOR_BYTES;
+    uint32_t end = file.size + n;
+    uint32_t haveClusters = (file.size + clusterBytes - 1) / clusterBytes;
+    uint32_t needClusters = (end + clusterBytes - 1) / clusterBytes;
+    uint32_t last = lastCluster(file);
+    for (uint32_t i = haveClusters; i < needClusters; i++) {
+      last = allocate(last);
+      if (file.firstCluster == 0) {
+        file.firstCluster = last;
+      }
+    }
+    uint32_t firstSector = file.size / SECTOR_BYTES;
+    uint32_t lastSector = (end - 1) / SECTOR_BYTES;
+    counts.sectors[dataSector] += lastSector - firstSector + 1;
+    file.size = end;
+  }
+
+  // f_close: the directory entry takes the new size and time, then the volume is synced
+  void close(FatFile &file) {
+    touch(file.dirSector, dirSector);
+    sync();
+  }
+
+  // f_unlink
+  void remove(FatFile &file) {
+    touch(file.dirSector, dirSector);
+    freeChain(file.firstCluster);
+    file = FatFile();
+    sync();
+  }
+
+  // f_expand with opt=1: a contiguous chain is written into the FAT in one go
+  void expand(FatFile &file, uint32_t n) {
+    uint32_t clusterBytes = _sectorsPerCluster * SECTOR_BYTES;
+    uint32_t needClusters = (n + clusterBytes - 1) / clusterBytes;
+    uint32_t last = 0;
+    for (uint32_t i = 0; i < needClusters; i++) {
+      last = allocate(last);
+      if (file.firstCluster == 0) {
+        file.firstCluster = last;
+      }
+    }
+    file.size = n;
+    touch(file.dirSector, dirSector);
+  }
+
+  // Sector written directly with SD.writeRAW
+  void rawWrite() { counts.sectors[dataSector] += 1; }
+
+  WriteCounts counts;
+  std::vector<uint32_t> fat;
+
+private:
+  static constexpr uint32_t kFatBase = 32;          // Reserved sectors before the first FAT
+  static constexpr uint32_t kDirBase = 1u << 24;    // Directory sectors, kept apart from FAT sectors
+
+  // Modify a FAT or directory sector through the FatFs window, flushing whatever the window held before
+  void touch(uint32_t sector, int kind) {
+    if (!_windowValid || _window != sector) {
+      flushWindow();
+      _window = sector;
+      _windowKind = kind;
+      _windowValid = true;
+    }
+    _windowDirty = true;
+  }
+
+  void flushWindow() {
+    if (_windowDirty) {
+      counts.sectors[_windowKind] += (_windowKind == fatSector) ? NUM_FATS : 1;
+      _windowDirty = false;
+    }
+  }
+
+  void sync() {
+    flushWindow();
+    if (_fsiDirty) {
+      counts.sectors[fsinfoSector] += 1;
+      _fsiDirty = false;
+    }
+  }
+
+  uint32_t lastCluster(const FatFile &file) const {
+    uint32_t cluster = file.firstCluster;
+    while (cluster != 0 && fat[cluster] != 0x0FFFFFFF) {
+      cluster = fat[cluster];
+    }
+    return cluster;
+  }
+
+  // Next free cluster after the last one allocated, as FatFs searches
+  uint32_t allocate(uint32_t previous) {
+    uint32_t cluster = _lastAllocated;
+    do {
+      cluster = (cluster + 1 < fat.size()) ? cluster + 1 : 3;
+    } while (fat[cluster] != 0);
+    fat[cluster] = 0x0FFFFFFF;
+    touch(kFatBase + cluster / FAT_ENTRIES_PER_SECTOR, fatSector);
+    if (previous != 0) {
+      fat[previous] = cluster;
+      touch(kFatBase + previous / FAT_ENTRIES_PER_SECTOR, fatSector);
+    }
+    _lastAllocated = cluster;
+    _fsiDirty = true;
+    return cluster;
+  }
+
+  void freeChain(uint32_t cluster) {
+    while (cluster != 0 && cluster != 0x0FFFFFFF) {
+      uint32_t next = fat[cluster];
+      fat[cluster] = 0;
+      touch(kFatBase + cluster / FAT_ENTRIES_PER_SECTOR, fatSector);
+      cluster = next;
+      _fsiDirty = true;
+    }
+  }
+
+  int _sectorsPerCluster;
+  uint32_t _dirSlots = 0;
+  uint32_t _lastAllocated = 2;
+  uint32_t _window = 0;
+  int _windowKind = dirSector;
+  bool _windowValid = false;
+  bool _windowDirty = false;
+  bool _fsiDirty = false;
+};
+
+/*------------------------------------------------------------ Firmware Model ------------------------------------------------------------*/
+
+struct Options {
+  int clusterKB = 32;
+  int periodM = 1;
+  int checkpoint = LOG_CHECKPOINT_RECORDS;
+  int wakes = 10000;
+  uint32_t channelBytes = 1400;
+  uint32_t envBytes = 1500;
+  uint32_t headerBytes = 450;
+};
+
+// History files plus the root files rewritten every wake
+struct PlantFiles {
+  FatFile channels[NUM_CHANNELS];
+  FatFile dates;
+  FatFile env;
+  FatFile header;
+  FatFile history;  // Appended record file of the FAT append strategy
+  FatFile log;      // Preallocated extent of the raw log strategy
+};
+
+// pushJsonDoc(): truncate and rewrite the whole file
+static void rewrite(Volume &volume, FatFile &file, uint32_t bytes) {
+  volume.truncate(file);
+  volume.write(file, bytes);
+  volume.close(file);
+}
+
+// addTimeStamp(): copy dates.txt into tmp.txt with the new lines on top, copy it back, then delete tmp.txt
+static void rewriteDates(Volume &volume, FatFile &dates) {
+  uint32_t bytes = 20 + MAX_SENSOR_READINGS * DATE_LINE_LEN;
+  FatFile tmp = volume.newFile();
+  volume.write(tmp, bytes);
+  volume.close(tmp);
+  rewrite(volume, dates, bytes);
+  volume.remove(tmp);
+}
+
+static void rewriteChannels(Volume &volume, PlantFiles &files, const Options &options) {
+  for (FatFile &file : files.channels) {
+    rewrite(volume, file, options.channelBytes);
+  }
+}
+
+static PlantFiles createFiles(Volume &volume, const Options &options) {
+  PlantFiles files;
+  for (FatFile &file : files.channels) {
+    file = volume.newFile();
+    volume.write(file, options.channelBytes);
+    volume.close(file);
+  }
+  files.dates = volume.newFile();
+  files.env = volume.newFile();
+  files.header = volume.newFile();
+  files.history = volume.newFile();
+  files.log = volume.newFile();
+  rewrite(volume, files.dates, 20 + MAX_SENSOR_READINGS * DATE_LINE_LEN);
+  rewrite(volume, files.env, options.envBytes);
+  rewrite(volume, files.header, options.headerBytes);
+  return files;
+}
+
+struct Row {
+  std::string name;
+  WriteCounts counts;
+};
+
+static void printRow(const Row &row) {
+  printf("%-40s %8.2f %8.2f %8.2f %8.2f %9.2f\n", row.name.c_str(), row.counts.sectors[dataSector],
+         row.counts.sectors[fatSector], row.counts.sectors[dirSector], row.counts.sectors[fsinfoSector],
+         row.counts.total());
+}
+
+static int parseInt(const char* value, const char* flag) {
+  char* end = nullptr;
+  long parsed = strtol(value, &end, 10);
+  if (*end != '\0' || parsed <= 0) {
+    fprintf(stderr, "%s expects a positive number\n", flag);
+    exit(1);
+  }
+  return (int)parsed;
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string flag = argv[i];
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", flag.c_str());
+      return 1;
+    }
+    const char* value = argv[++i];
+    if (flag == "--cluster-kb") {
+      options.clusterKB = parseInt(value, argv[i - 1]);
+    } else if (flag == "--period-m") {
+      options.periodM = parseInt(value, argv[i - 1]);
+    } else if (flag == "--checkpoint") {
+      options.checkpoint = parseInt(value, argv[i - 1]);
+    } else if (flag == "--wakes") {
+      options.wakes = parseInt(value, argv[i - 1]);
+    } else if (flag == "--channel-bytes") {
+      options.channelBytes = parseInt(value, argv[i - 1]);
+    } else if (flag == "--env-bytes") {
+      options.envBytes = parseInt(value, argv[i - 1]);
+    } else if (flag == "--header-bytes") {
+      options.headerBytes = parseInt(value, argv[i - 1]);
+    } else {
+      fprintf(stderr, "unknown option %s\n", flag.c_str());
+      return 1;
+    }
+  }
+  int sectorsPerCluster = options.clusterKB * 1024 / SECTOR_BYTES;
+  if (sectorsPerCluster < 1) {
+    fprintf(stderr, "--cluster-kb must be at least 1\n");
+    return 1;
+  }
+  double wakes = options.wakes;
+  std::vector<Row> rows;
+
+  // JSON rewrite on every wake, per file and per wake
+  WriteCounts channelOps, datesOps, envOps, headerOps;
+  {
+    Volume volume(sectorsPerCluster);
+    PlantFiles files = createFiles(volume, options);
+    for (int i = 0; i < options.wakes; i++) {
+      WriteCounts before = volume.counts;
+      rewriteChannels(volume, files, options);
+      WriteCounts afterChannels = volume.counts;
+      rewriteDates(volume, files.dates);
+      WriteCounts afterDates = volume.counts;
+      rewrite(volume, files.env, options.envBytes);
+      WriteCounts afterEnv = volume.counts;
+      rewrite(volume, files.header, options.headerBytes);
+      channelOps += afterChannels - before;
+      datesOps += afterDates - afterChannels;
+      envOps += afterEnv - afterDates;
+      headerOps += volume.counts - afterEnv;
+    }
+  }
+  WriteCounts jsonWake = channelOps;
+  jsonWake += datesOps;
+  jsonWake += envOps;
+  jsonWake += headerOps;
+  rows.push_back({ "json: channel file rewrite", channelOps.scaled(1 / (wakes * NUM_CHANNELS)) });
+  rows.push_back({ "json: dates.txt rewrite via tmp.txt", datesOps.scaled(1 / wakes) });
+  rows.push_back({ "json: env.txt rewrite", envOps.scaled(1 / wakes) });
+  rows.push_back({ "json: header.txt rewrite", headerOps.scaled(1 / wakes) });
+  rows.push_back({ "json: wake", jsonWake.scaled(1 / wakes) });
+
+  // 32-byte record appended through the FAT layer
+  WriteCounts appendWake;
+  {
+    Volume volume(sectorsPerCluster);
+    PlantFiles files = createFiles(volume, options);
+    WriteCounts before = volume.counts;
+    for (int i = 0; i < options.wakes; i++) {
+      volume.write(files.history, LOG_RECORD_SIZE);
+      volume.close(files.history);
+    }
+    appendWake = (volume.counts - before).scaled(1 / wakes);
+  }
+  rows.push_back({ "append: record through FAT", appendWake });
+
+  // Raw log with checkpoints
+  WriteCounts logCreate, logRecord, logCheckpoint, logWake;
+  int numCheckpoints = 0;
+  {
+    Volume volume(sectorsPerCluster);
+    PlantFiles files = createFiles(volume, options);
+    WriteCounts before = volume.counts;
+    volume.expand(files.log, LOG_RECORDS * LOG_RECORD_SIZE);
+    volume.close(files.log);
+    logCreate = volume.counts - before;
+    before = volume.counts;
+    for (int i = 1; i <= options.wakes; i++) {
+      WriteCounts beforeRecord = volume.counts;
+      volume.rawWrite();
+      logRecord += volume.counts - beforeRecord;
+      if (i % options.checkpoint == 0) {  // One batched update of every file, then the header & env at shutdown
+        WriteCounts beforeCheckpoint = volume.counts;
+        rewriteChannels(volume, files, options);
+        rewriteDates(volume, files.dates);
+        rewrite(volume, files.env, options.envBytes);
+        rewrite(volume, files.header, options.headerBytes);
+        logCheckpoint += volume.counts - beforeCheckpoint;
+        numCheckpoints++;
+      }
+    }
+    logWake = (volume.counts - before).scaled(1 / wakes);
+  }
+  rows.push_back({ "log: log.bin creation (f_expand)", logCreate });
+  rows.push_back({ "log: record (SD.writeRAW)", logRecord.scaled(1 / wakes) });
+  if (numCheckpoints > 0) {
+    rows.push_back({ "log: checkpoint", logCheckpoint.scaled(1.0 / numCheckpoints) });
+  }
+  rows.push_back({ "log: wake, checkpoints amortized", logWake });
+
+  printf("cluster %i KiB, checkpoint every %i readings, %i wakes per strategy\n\n", options.clusterKB, options.checkpoint,
+         options.wakes);
+  printf("%-40s %8s %8s %8s %8s %9s\n", "sector writes per operation", "data", "fat", "dir", "fsinfo", "total");
+  for (const Row &row : rows) {
+    printRow(row);
+  }
+  double wakesPerDay = (double)MINUTES_PER_DAY / options.periodM;
+  printf("\nsector writes per day at one reading every %i min:\n", options.periodM);
+  printf("  json   %10.0f\n", jsonWake.total() / wakes * wakesPerDay);
+  printf("  append %10.0f  (history only, JSON files not kept)\n", appendWake.total() * wakesPerDay);
+  printf("  log    %10.0f  (%.1fx fewer than json)\n", logWake.total() * wakesPerDay,
+         jsonWake.total() / wakes / logWake.total());
+  return 0;
+}
@@ -0,0 +1,522 @@
+/*
+  Plant-Saver sensor file benchmark
+
+  Times the update of a full sensor file (200 readings) the way updatePlantData() makes it: load the file, add the new
+  readings, take the average and write the file back. Once through a JsonDocument with readSDFile()/pushJsonDoc(), once
+  through the SensorFile reader and writer of PlantSaverClasses.cpp, copied here over an in-memory File and formatting numbers
+  with the firmware's own formatJsonFloat() (PlantSaverModels.cpp). Both run on copies of the same file held in memory, so
+  only parsing and formatting are timed, and after every update the two files are compared byte for byte. Also counts the
+  bytes and 512-byte sectors each path writes to the card.
+
+  Build: g++ -std=c++17 -O2 -I <ArduinoJson>/src sensor_file_bench.cpp ../Plant_Saver_Fall_2025/PlantSaverModels.cpp \
+             -o sensor_file_bench
+         <ArduinoJson> is the library folder the firmware is built with (version 7.4.2), e.g. ~/Arduino/libraries/ArduinoJson
+
+  Usage: sensor_file_bench [options]
+    --channel <name>    light, water, humidity or temp, the kind of values written (default all four in turn)
+    --updates <n>       Updates per channel (default 2000)
+    --batch <n>         Readings added per update, 16 for a sensor log checkpoint (default 1)
+    --null-every <n>    Make every nth reading a missing sensor, stored as null (default 0, never)
+    --seed <n>          Seed for the synthetic readings (default 1)
+*/
+
+#include <ArduinoJson.h>
+#if !defined(ARDUINOJSON_VERSION_MAJOR) || ARDUINOJSON_VERSION_MAJOR != 7 || ARDUINOJSON_VERSION_MINOR != 4 || \
+  ARDUINOJSON_VERSION_REVISION != 2
+#error "Build against ArduinoJson 7.4.2, the version formatJsonFloat() was ported from; the byte comparison is only meaningful against it"
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include "../Plant_Saver_Fall_2025/PlantSaverModels.h"
+
+/*---------------------------------------------------------- Firmware Constants ---------------------------------------------------------*/
+
+// Mirrored from PlantSaverClasses.h
+#define MAX_SENSOR_READINGS 200
+#define MAX_CHARS_FILENAME 21
+#define SECTOR_SIZE 512
+
+enum ErrorStatus { noError, jsonError = 5, fileOperation };
+
+/*------------------------------------------------------------- Card Model --------------------------------------------------------------*/
+
+// A file on the card, counting what is written to it
+struct CardFile {
+  std::string data;
+  long bytesWritten = 0;
+  long sectorsWritten = 0;
+};
+
+// Stand-in for the SD library's File over a CardFile. Sectors are counted once per open, as the FAT layer buffers a sector
+class File {
+public:
+  File(CardFile* card = nullptr, const char* mode = "r") : _card(card) {
+    if (_card && mode[0] == 'w') {
+      _card->data.clear();
+    }
+  }
+  operator bool() const { return _card != nullptr; }
+  bool seek(uint32_t pos) {
+    if (pos > _card->data.size()) {
+      return false;
+    }
+    _pos = pos;
+    return true;
+  }
+  size_t write(const uint8_t* buffer, size_t size) {
+    if (_pos + size > _card->data.size()) {
+      _card->data.resize(_pos + size);
+    }
+    memcpy(&_card->data[_pos], buffer, size);
+    for (size_t sector = _pos / SECTOR_SIZE; size > 0 && sector <= (_pos + size - 1) / SECTOR_SIZE; sector++) {
+      _sectors.insert(sector);
+    }
+    _card->bytesWritten += size;
+    _pos += size;
+    return size;
+  }
+  void close() {
+    if (_card) {
+      _card->sectorsWritten += _sectors.size();
+    }
+    _card = nullptr;
+  }
+private:
+  CardFile* _card;
+  size_t _pos = 0;
+  std::set<size_t> _sectors;
+};
+
+/*----------------------------------------------------------- ArduinoJson Path ----------------------------------------------------------*/
+
+// readSDFile(), Container::addSensorReading(), Plant::getAvgReading() and pushJsonDoc() as they were
+static float jsonUpdate(CardFile& card, const float readings[], int numNew) {
+  JsonDocument sensorDoc;
+  deserializeJson(sensorDoc, card.data);
+  for (int j = 0; j < numNew; j++) {
+    int startIndex = sensorDoc["startIndex"];
+    sensorDoc["readings"][startIndex] = readings[j];
+    startIndex = (startIndex + 1) % MAX_SENSOR_READINGS;
+    sensorDoc["startIndex"] = startIndex;
+    int numReadings = sensorDoc["numReadings"];
+    if (numReadings < MAX_SENSOR_READINGS) {
+      sensorDoc["numReadings"] = numReadings + 1;
+    }
+  }
+  float avg = 0;
+  int numReadings = sensorDoc["numReadings"];
+  int numValid = 0;
+  JsonArray jsonReadings = sensorDoc["readings"];
+  for (int i = 0; i < numReadings; i++) {
+    if (!jsonReadings[i].isNull()) {
+      avg = avg + (float)jsonReadings[i];
+      numValid++;
+    }
+  }
+  avg = (numValid > 0) ? avg / numValid : 0;
+  std::string text;
+  serializeJson(sensorDoc, text);
+  File file(&card, "w");
+  file.write((const uint8_t*)text.data(), text.size());
+  file.close();
+  return avg;
+}
+
+/*---------------------------------------------------------- SensorFile Path -----------------------------------------------------------*/
+
+static const int startIndexField = MAX_SENSOR_READINGS;
+static const int numReadingsField = MAX_SENSOR_READINGS + 1;
+
+static int skipSpace(const char text[], int pos) {
+  while (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n') {
+    pos++;
+  }
+  return pos;
+}
+
+static int parseJsonNumber(const char text[], int pos, float &value) {
+  if (strncmp(&text[pos], "null", 4) == 0) {
+    value = NAN;
+    return pos + 4;
+  }
+  char* end;
+  value = strtof(&text[pos], &end);
+  return (end == &text[pos]) ? -1 : end - text;
+}
+
+// SensorFile of PlantSaverClasses.cpp, opening a CardFile in place of a file name
+class SensorFile {
+public:
+  ~SensorFile() { free(_text); }
+
+  int load(CardFile& card) {
+    _card = &card;
+    free(_text);
+    _loaded = 0;
+    _textLen = card.data.size();
+    _text = (_textLen > 0 && _textLen <= UINT16_MAX) ? (char*)malloc(_textLen + 1) : NULL;
+    if (!_text) {
+      return jsonError;
+    }
+    memcpy(_text, card.data.data(), _textLen);
+    _text[_textLen] = '\0';
+    bool found[3] = { 0 };
+    int pos = skipSpace(_text, 0);
+    if (_text[pos] != '{') {
+      return jsonError;
+    }
+    pos = skipSpace(_text, pos + 1);
+    while (_text[pos] == '"') {
+      const char* key = &_text[pos + 1];
+      const char* keyEnd = strchr(key, '"');
+      if (!keyEnd) {
+        return jsonError;
+      }
+      pos = skipSpace(_text, keyEnd - _text + 1);
+      if (_text[pos] != ':') {
+        return jsonError;
+      }
+      pos = skipSpace(_text, pos + 1);
+      if (strncmp(key, "readings\"", 9) == 0) {
+        if (_text[pos] != '[') {
+          return jsonError;
+        }
+        pos = skipSpace(_text, pos + 1);
+        arrayLen = 0;
+        while (_text[pos] != ']') {
+          if (arrayLen == MAX_SENSOR_READINGS) {
+            return jsonError;
+          }
+          int end = parseJsonNumber(_text, pos, readings[arrayLen]);
+          if (end < 0 || end - pos > UINT8_MAX) {
+            return jsonError;
+          }
+          _slotPos[arrayLen] = pos;
+          _slotLen[arrayLen] = end - pos;
+          arrayLen++;
+          pos = skipSpace(_text, end);
+          if (_text[pos] == ',') {
+            pos = skipSpace(_text, pos + 1);
+          } else if (_text[pos] != ']') {
+            return jsonError;
+          }
+        }
+        _closePos = pos;
+        found[2] = 1;
+        pos++;
+      } else {
+        int field;
+        if (strncmp(key, "startIndex\"", 11) == 0) {
+          field = 0;
+        } else if (strncmp(key, "numReadings\"", 12) == 0) {
+          field = 1;
+        } else {
+          return jsonError;
+        }
+        char* end;
+        int value = strtol(&_text[pos], &end, 10);
+        if (end == &_text[pos]) {
+          return jsonError;
+        }
+        _fieldPos[field] = pos;
+        _fieldLen[field] = end - &_text[pos];
+        (field == 0 ? startIndex : numReadings) = value;
+        found[field] = 1;
+        pos = end - _text;
+      }
+      pos = skipSpace(_text, pos);
+      if (_text[pos] == ',') {
+        pos = skipSpace(_text, pos + 1);
+      }
+    }
+    if (_text[pos] != '}' || !found[0] || !found[1] || !found[2]) {
+      return jsonError;
+    }
+    if (startIndex < 0 || startIndex >= MAX_SENSOR_READINGS || numReadings < 0 || numReadings > MAX_SENSOR_READINGS) {
+      return jsonError;
+    }
+    _loadedLen = arrayLen;
+    _loaded = 1;
+    return noError;
+  }
+
+  void add(float reading) {
+    for (int i = arrayLen; i < startIndex; i++) {
+      readings[i] = NAN;
+      _changed[i / 32] |= 1UL << (i % 32);
+    }
+    readings[startIndex] = reading;
+    _changed[startIndex / 32] |= 1UL << (startIndex % 32);
+    if (startIndex >= arrayLen) {
+      arrayLen = startIndex + 1;
+    }
+    startIndex = (startIndex + 1) % MAX_SENSOR_READINGS;
+    if (numReadings < MAX_SENSOR_READINGS) {
+      numReadings++;
+    }
+  }
+
+  int save() {
+    if (!_loaded) {
+      return fileOperation;
+    }
+    uint8_t fields[MAX_SENSOR_READINGS + 2];
+    int numFields = 0;
+    int header[2] = { startIndexField, numReadingsField };
+    if (_fieldPos[1] < _fieldPos[0]) {
+      header[0] = numReadingsField;
+      header[1] = startIndexField;
+    }
+    int nextHeader = 0;
+    for (int slot = 0; slot < arrayLen; slot++) {
+      if (!(_changed[slot / 32] & (1UL << (slot % 32)))) {
+        continue;
+      }
+      while (nextHeader < 2 && editPos(header[nextHeader]) < editPos(slot)) {
+        fields[numFields++] = header[nextHeader++];
+      }
+      fields[numFields++] = slot;
+    }
+    while (nextHeader < 2) {
+      fields[numFields++] = header[nextHeader++];
+    }
+    char text[NUM_CHARS_JSON_NUMBER + 1];
+    int from = _textLen;
+    int newLen = _textLen;
+    for (int i = 0; i < numFields; i++) {
+      int length = editText(fields[i], text);
+      if (length != editLen(fields[i]) && from == _textLen) {
+        from = editPos(fields[i]);
+      }
+      newLen += length - editLen(fields[i]);
+    }
+    bool shrinks = newLen < _textLen;
+    if (shrinks) {
+      from = 0;
+    }
+    File file(_card, shrinks ? "w" : "r+");
+    bool writeOK = 1;
+    int i = 0;
+    for (; i < numFields && editPos(fields[i]) < from; i++) {
+      int pos = editPos(fields[i]);
+      int length = editText(fields[i], text);
+      if (memcmp(&_text[pos], text, length) != 0) {
+        writeOK &= file.seek(pos) && file.write((uint8_t*)text, length) == (size_t)length;
+      }
+    }
+    if (from < _textLen) {
+      writeOK &= file.seek(from);
+      int copied = from;
+      for (; i < numFields; i++) {
+        int pos = editPos(fields[i]);
+        int length = editText(fields[i], text);
+        writeOK &= file.write((uint8_t*)&_text[copied], pos - copied) == (size_t)(pos - copied);
+        writeOK &= file.write((uint8_t*)text, length) == (size_t)length;
+        copied = pos + editLen(fields[i]);
+      }
+      writeOK &= file.write((uint8_t*)&_text[copied], _textLen - copied) == (size_t)(_textLen - copied);
+    }
+    file.close();
+    free(_text);
+    _text = NULL;
+    _loaded = 0;
+    _tailWritten = (from < _textLen);
+    return writeOK ? noError : fileOperation;
+  }
+
+  int startIndex = 0;
+  int numReadings = 0;
+  int arrayLen = 0;
+  float readings[MAX_SENSOR_READINGS] = {};
+  bool _tailWritten = 0;  // Bench only: save() rewrote more than the edited fields
+
+private:
+  int editText(int field, char buffer[]) {
+    if (field == startIndexField || field == numReadingsField) {
+      return snprintf(buffer, NUM_CHARS_JSON_NUMBER, "%i", (field == startIndexField) ? startIndex : numReadings);
+    }
+    if (field >= _loadedLen && field > 0) {
+      buffer[0] = ',';
+      return formatJsonFloat(readings[field], &buffer[1]) + 1;
+    }
+    return formatJsonFloat(readings[field], buffer);
+  }
+  int editPos(int field) {
+    if (field == startIndexField || field == numReadingsField) {
+      return _fieldPos[field - startIndexField];
+    }
+    return (field < _loadedLen) ? _slotPos[field] : _closePos;
+  }
+  int editLen(int field) {
+    if (field == startIndexField || field == numReadingsField) {
+      return _fieldLen[field - startIndexField];
+    }
+    return (field < _loadedLen) ? _slotLen[field] : 0;
+  }
+  CardFile* _card = nullptr;
+  char* _text = NULL;
+  int _textLen = 0;
+  int _fieldPos[2] = {};
+  int _fieldLen[2] = {};
+  uint16_t _slotPos[MAX_SENSOR_READINGS] = {};
+  uint8_t _slotLen[MAX_SENSOR_READINGS] = {};
+  int _closePos = 0;
+  int _loadedLen = 0;
+  bool _loaded = 0;
+  uint32_t _changed[(MAX_SENSOR_READINGS + 31) / 32] = {};
+};
+
+// updatePlantData()'s use of SensorFile, with Plant::getAvgReading()
+static float streamUpdate(CardFile& card, const float readings[], int numNew, bool &tailWritten) {
+  SensorFile sensorFile;
+  if (sensorFile.load(card)) {
+    fprintf(stderr, "SensorFile could not parse:\n%s\n", card.data.c_str());
+    exit(1);
+  }
+  for (int j = 0; j < numNew; j++) {
+    sensorFile.add(readings[j]);
+  }
+  float avg = 0;
+  int numValid = 0;
+  for (int i = 0; i < sensorFile.numReadings; i++) {
+    if (!std::isnan(sensorFile.readings[i])) {
+      avg = avg + sensorFile.readings[i];
+      numValid++;
+    }
+  }
+  avg = (numValid > 0) ? avg / numValid : 0;
+  sensorFile.save();
+  tailWritten = sensorFile._tailWritten;
+  return avg;
+}
+
+/*-------------------------------------------------------------- Readings ---------------------------------------------------------------*/
+
+// Synthetic readings shaped like each sensor's: the value range and the arithmetic the firmware produces them with
+struct Channel {
+  const char* name;
+  double low;
+  double high;
+  double step;  // Random walk step
+};
+
+static const Channel channels[] = {
+  { "light", 0, 60000, 800 },    // lux = 0.6 * ALS counts / (gain * integration time)
+  { "water", 900, 3300, 40 },    // Whole ADC counts
+  { "humidity", 20, 90, 1.5 },   // %RH from the AHT20
+  { "temp", 55, 95, 0.8 },       // deg F from the AHT20
+};
+
+static float nextReading(const Channel& channel, double &level, std::mt19937 &rng) {
+  std::normal_distribution<double> step(0, channel.step);
+  level = std::min(channel.high, std::max(channel.low, level + step(rng)));
+  if (!strcmp(channel.name, "light")) {
+    return (0.6 * (int)(level * 3 * 100 / 0.6)) / (3 * 100);
+  }
+  if (!strcmp(channel.name, "water")) {
+    return (int)level;
+  }
+  return (float)level;
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+struct Totals {
+  double nanoseconds = 0;
+  long bytes = 0;
+  long sectors = 0;
+};
+
+int main(int argc, char** argv) {
+  const char* channelName = nullptr;
+  int updates = 2000;
+  int batch = 1;
+  int nullEvery = 0;
+  unsigned seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "missing value for %s\n", argv[i]);
+      return 2;
+    }
+    const char* value = argv[++i];
+    if (!strcmp(argv[i - 1], "--channel")) {
+      channelName = value;
+    } else if (!strcmp(argv[i - 1], "--updates")) {
+      updates = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--batch")) {
+      batch = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--null-every")) {
+      nullEvery = atoi(value);
+    } else if (!strcmp(argv[i - 1], "--seed")) {
+      seed = atoi(value);
+    } else {
+      fprintf(stderr, "usage: sensor_file_bench [--channel name] [--updates n] [--batch n] [--null-every n] [--seed n]\n");
+      return 2;
+    }
+  }
+  if (updates < 1 || batch < 1 || batch > MAX_SENSOR_READINGS) {
+    fprintf(stderr, "--updates must be at least 1 and --batch within 1-%i\n", MAX_SENSOR_READINGS);
+    return 2;
+  }
+  bool mismatch = false;
+  printf("%-9s %11s %11s %7s %11s %11s %9s %9s\n", "channel", "json us", "stream us", "speedup", "json B/upd", "stream B/upd",
+         "json sec", "stream sec");
+  for (const Channel& channel : channels) {
+    if (channelName && strcmp(channelName, channel.name)) {
+      continue;
+    }
+    std::mt19937 rng(seed);
+    double level = (channel.low + channel.high) / 2;
+    CardFile jsonCard;
+    jsonCard.data = "{\"startIndex\":0,\"numReadings\":0,\"readings\":[]}";  // As clearSensorData() writes it
+    for (int i = 0; i < MAX_SENSOR_READINGS; i++) {  // Fill the buffer first, a full file is the steady state
+      float reading = nextReading(channel, level, rng);
+      jsonUpdate(jsonCard, &reading, 1);
+    }
+    CardFile streamCard;
+    streamCard.data = jsonCard.data;
+    jsonCard.bytesWritten = 0;
+    jsonCard.sectorsWritten = 0;
+    Totals json;
+    Totals stream;
+    long tailRewrites = 0;
+    std::vector<float> readings(batch);
+    for (int update = 0; update < updates; update++) {
+      for (int j = 0; j < batch; j++) {
+        readings[j] = (nullEvery > 0 && rng() % nullEvery == 0) ? NAN : nextReading(channel, level, rng);
+      }
+      auto start = std::chrono::steady_clock::now();
+      float jsonAvg = jsonUpdate(jsonCard, readings.data(), batch);
+      auto middle = std::chrono::steady_clock::now();
+      bool tailWritten = false;
+      float streamAvg = streamUpdate(streamCard, readings.data(), batch, tailWritten);
+      auto end = std::chrono::steady_clock::now();
+      json.nanoseconds += std::chrono::duration<double, std::nano>(middle - start).count();
+      stream.nanoseconds += std::chrono::duration<double, std::nano>(end - middle).count();
+      tailRewrites += tailWritten;
+      // A NaN added to a JsonDocument is a float, not null, so the old average turned NaN whenever a sensor was missing
+      if (!mismatch && (jsonCard.data != streamCard.data || (jsonAvg != streamAvg && !std::isnan(jsonAvg)))) {
+        mismatch = true;
+        printf("%s update %i differs (averages %g/%g)\nArduinoJson: %s\nSensorFile:  %s\n", channel.name, update, jsonAvg,
+               streamAvg, jsonCard.data.c_str(), streamCard.data.c_str());
+      }
+    }
+    printf("%-9s %11.2f %11.2f %6.1fx %11.0f %11.0f %9.2f %9.2f\n", channel.name, json.nanoseconds / updates / 1000,
+           stream.nanoseconds / updates / 1000, json.nanoseconds / stream.nanoseconds, (double)jsonCard.bytesWritten / updates,
+           (double)streamCard.bytesWritten / updates, (double)jsonCard.sectorsWritten / updates,
+           (double)streamCard.sectorsWritten / updates);
+    printf("          file %zu bytes, %.0f%% of updates patched in place\n", streamCard.data.size(),
+           100.0 * (updates - tailRewrites) / updates);
+  }
+  printf("%s\n", mismatch ? "FAIL: the files differ" : "Files identical after every update");
+  return mismatch ? 1 : 0;
+}
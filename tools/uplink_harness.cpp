@@ -0,0 +1,255 @@
+/*
+  Plant-Saver uplink harness
+
+  Builds the firmware's Uplink.cpp against the host HAL in tools/host_hal and runs it against a local MQTT broker such as
+  Mosquitto. A second connection subscribes to plantsaver/+/readings and records what the broker delivered. Each scenario
+  queues synthetic readings in a temporary folder standing in for the card, runs the uplink the way the firmware's uplink
+  state does, and checks the queue state the device would save and the readings that arrived:
+    deliver      every queued reading arrives once, in order, and the queue starts over
+    no-wifi      the network cannot be joined: nothing is sent, the queue is kept, the radio stays on for the timeout
+    no-broker    the broker refuses the connection: as above, without the Wi-Fi timeout
+    lost-link    the connection drops before the third batch: the first two stay sent, the rest go on the next uplink
+    lost-ack     the third batch reaches the broker but its echo is lost: it is sent again (at-least-once) on the next uplink
+    stale-ack    the third batch is answered by an echo of an earlier attempt at the same offset: it is not taken as acknowledged
+    queue-full   readings past UPLINK_MAX_PENDING are dropped and counted instead of queued (no broker needed)
+  Reports the batches and radio on-time of each uplink. Exits with status 1 if any check fails.
+
+  Build: g++ -std=c++17 -O2 -Ihost_hal uplink_harness.cpp ../Plant_Saver_Fall_2025/Uplink.cpp -o uplink_harness
+
+  Usage: uplink_harness [options]
+    --host <name>        Broker host (default 127.0.0.1), e.g. after `mosquitto -p 1883`
+    --port <n>           Broker port (default 1883)
+    --readings <n>       Readings queued per scenario (default 120)
+    --scenarios <list>   Comma separated scenarios to run (default all, in the order above)
+*/
+
+#include "Arduino.h"
+#include "SD.h"
+#include "WiFi.h"
+#include "PubSubClient.h"
+#include "../Plant_Saver_Fall_2025/Uplink.h"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+extern PubSubClient mqttClient;  // The firmware's client, for fault injection
+
+/*--------------------------------------------------------------- Observer --------------------------------------------------------------*/
+
+// Readings delivered by the broker, counted by timestamp & in arrival order, and the batches they came in
+static std::map<std::string, int> delivered;
+static std::vector<std::string> deliveredOrder;
+static int deliveredBatches = 0;
+
+static void observerCallback(char*, uint8_t* payload, unsigned int length) {
+  std::stringstream stream(std::string((char*)payload, length));
+  std::string line;
+  std::getline(stream, line);  // device,plant,offset
+  while (std::getline(stream, line)) {
+    delivered[line.substr(0, line.find(','))]++;
+    deliveredOrder.push_back(line.substr(0, line.find(',')));
+  }
+  deliveredBatches++;
+}
+
+static WiFiClient observerSocket;
+static PubSubClient observer(observerSocket);
+
+// Collect what the broker delivers for a short while after an uplink
+static void drainObserver() {
+  unsigned long startTime = millis();
+  while (millis() - startTime < 300) {
+    observer.loop();
+    delay(5);
+  }
+}
+
+/*--------------------------------------------------------------- Options ---------------------------------------------------------------*/
+
+struct Options {
+  std::string host = "127.0.0.1";
+  int port = 1883;
+  int readings = 120;
+  std::vector<std::string> scenarios = { "deliver", "no-wifi", "no-broker", "lost-link", "lost-ack", "stale-ack", "queue-full" };
+};
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) {
+      return false;
+    }
+    const char* value = argv[++i];
+    const char* name = argv[i - 1];
+    if (!strcmp(name, "--host")) {
+      options.host = value;
+    } else if (!strcmp(name, "--port")) {
+      options.port = atoi(value);
+    } else if (!strcmp(name, "--readings")) {
+      options.readings = atoi(value);
+    } else if (!strcmp(name, "--scenarios")) {
+      options.scenarios.clear();
+      std::stringstream stream(value);
+      std::string item;
+      while (std::getline(stream, item, ',')) {
+        options.scenarios.push_back(item);
+      }
+    } else {
+      return false;
+    }
+  }
+  return options.readings > 0 && options.port > 0;
+}
+
+/*-------------------------------------------------------------- Scenarios --------------------------------------------------------------*/
+
+static bool failed = false;
+
+static void check(bool condition, const char* what) {
+  if (!condition) {
+    printf("    FAILED: %s\n", what);
+    failed = true;
+  }
+}
+
+static void timeStamp(int index, char buffer[]) {
+  snprintf(buffer, 32, "2025-11-%02d %02d:%02d:00", 1 + index / 1440, index / 60 % 24, index % 60);
+}
+
+// A fresh card with count readings queued, and an uplink configured for the broker
+static void queueReadings(Uplink& uplink, const Options& options, int count) {
+  fs::path card = fs::temp_directory_path() / "plantsaver_uplink_card";
+  fs::remove_all(card);
+  fs::create_directories(card);
+  SD.begin(card.c_str());
+  uplink = Uplink();
+  snprintf(uplink.wifiSSID, NUM_CHARS_SSID, "harness");
+  snprintf(uplink.mqttHost, NUM_CHARS_HOST, "%s", options.host.c_str());
+  uplink.mqttPort = options.port;
+  uplink.batch = count;
+  for (int i = 0; i < count; i++) {
+    char stamp[32];
+    timeStamp(i, stamp);
+    uplink.queueReading(stamp, 100 + i, 2000 + i, 50, 70);
+  }
+  delivered.clear();
+  deliveredOrder.clear();
+  deliveredBatches = 0;
+}
+
+// One uplink as the firmware's uplink state runs it
+static bool runUplink(Uplink& uplink, const char* label) {
+  bool sent = uplink.sendBatch(7);
+  drainObserver();
+  printf("    %-10s %-7s %3i batch(es) delivered, radio on %5lu ms, cursor %6lu, %4i pending\n", label, sent ? "sent" : "failed",
+         deliveredBatches, uplink.radioOnTimeMs, uplink.cursor, uplink.pending);
+  deliveredBatches = 0;
+  return sent;
+}
+
+static int countDelivered(int count, int& duplicates) {
+  int received = 0;
+  duplicates = 0;
+  for (int i = 0; i < count; i++) {
+    char stamp[32];
+    timeStamp(i, stamp);
+    auto found = delivered.find(stamp);
+    if (found != delivered.end()) {
+      received++;
+      duplicates += found->second - 1;
+    }
+  }
+  return received;
+}
+
+static void runScenario(const std::string& scenario, const Options& options) {
+  printf("  %s\n", scenario.c_str());
+  Uplink uplink;
+  int duplicates;
+  if (scenario == "deliver") {
+    queueReadings(uplink, options, options.readings);
+    check(uplink.due(), "uplink due once the batch is queued");
+    check(runUplink(uplink, "uplink"), "uplink succeeds");
+    check(countDelivered(options.readings, duplicates) == options.readings && duplicates == 0, "every reading delivered once");
+    check(std::is_sorted(deliveredOrder.begin(), deliveredOrder.end()), "readings delivered in order");
+    check(uplink.cursor == 0 && uplink.pending == 0 && fs::file_size(fs::temp_directory_path() / "plantsaver_uplink_card/uplink.txt") == 0,
+          "queue starts over");
+  } else if (scenario == "no-wifi" || scenario == "no-broker") {
+    queueReadings(uplink, options, options.readings);
+    WiFi.reachable = scenario != "no-wifi";
+    if (scenario == "no-broker") {
+      snprintf(uplink.mqttHost, NUM_CHARS_HOST, "127.0.0.1");
+      uplink.mqttPort = 1;  // Nothing listens here
+    }
+    check(!runUplink(uplink, "uplink"), "uplink fails");
+    WiFi.reachable = true;
+    check(delivered.empty(), "nothing delivered");
+    check(uplink.cursor == 0 && uplink.pending == options.readings, "queue kept");
+  } else if (scenario == "lost-link" || scenario == "lost-ack" || scenario == "stale-ack") {
+    queueReadings(uplink, options, options.readings);
+    if (scenario == "lost-link") {
+      mqttClient.failPublish = 3;
+    } else if (scenario == "lost-ack") {
+      mqttClient.loseEcho = 3;
+    } else {
+      mqttClient.staleEcho = 3;
+    }
+    check(!runUplink(uplink, "uplink"), "interrupted uplink fails");
+    mqttClient.failPublish = 0;
+    mqttClient.loseEcho = 0;
+    mqttClient.staleEcho = 0;
+    check(uplink.cursor > 0 && uplink.pending > 0 && uplink.pending < options.readings, "acknowledged batches stay sent");
+    check(runUplink(uplink, "retry"), "next uplink succeeds");
+    check(countDelivered(options.readings, duplicates) == options.readings, "every reading delivered");
+    if (scenario == "lost-link") {
+      check(duplicates == 0, "no reading delivered twice");
+    } else {
+      printf("    %i reading(s) delivered twice\n", duplicates);
+      check(duplicates > 0, "unacknowledged batch sent again");
+    }
+    check(uplink.cursor == 0 && uplink.pending == 0, "queue starts over");
+  } else if (scenario == "queue-full") {
+    queueReadings(uplink, options, UPLINK_MAX_PENDING + options.readings);
+    printf("    %i queued, %lu dropped\n", uplink.pending, uplink.dropped);
+    check(uplink.pending == UPLINK_MAX_PENDING && uplink.dropped == (unsigned long)options.readings, "queue capped");
+  } else {
+    printf("    unknown scenario\n");
+    failed = true;
+  }
+}
+
+/*----------------------------------------------------------------- Main ----------------------------------------------------------------*/
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    fprintf(stderr, "usage: uplink_harness [--host name] [--port n] [--readings n] [--scenarios list]\n");
+    return 2;
+  }
+  bool needsBroker = false;
+  for (const std::string& scenario : options.scenarios) {
+    needsBroker = needsBroker || scenario != "queue-full";
+  }
+  if (needsBroker) {
+    observer.setServer(options.host.c_str(), options.port);
+    observer.setCallback(observerCallback);
+    if (!observer.connect("plantsaver-harness") || !observer.subscribe("plantsaver/+/readings")) {
+      fprintf(stderr, "cannot connect to the broker at %s:%i\n", options.host.c_str(), options.port);
+      return 2;
+    }
+  }
+  for (const std::string& scenario : options.scenarios) {
+    runScenario(scenario, options);
+  }
+  if (needsBroker) {
+    observer.disconnect();
+  }
+  fs::remove_all(fs::temp_directory_path() / "plantsaver_uplink_card");
+  printf("%s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}